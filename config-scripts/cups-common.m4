@@ -120,6 +120,15 @@ AC_CHECK_FUNCS(waitpid wait3)
 dnl Check for posix_spawn
 AC_CHECK_FUNCS(posix_spawn)
 
+dnl Check for splice
+AC_CHECK_FUNCS(splice)
+
+dnl Check for fallocate
+AC_CHECK_FUNCS(fallocate)
+
+dnl Check for Linux sendfile
+AC_CHECK_HEADER(sys/sendfile.h,AC_DEFINE(HAVE_SENDFILE))
+
 dnl See if the tm structure has the tm_gmtoff member...
 AC_MSG_CHECKING(for tm_gmtoff member in tm structure)
 AC_TRY_COMPILE([#include <time.h>],[struct tm t;
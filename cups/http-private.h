@@ -166,6 +166,7 @@ extern "C" {
  * Constants...
  */
 
+#  define _HTTP_MAX_BUFSIZE	262144	/* Maximum size of I/O buffers */
 #  define _HTTP_MAX_SBUFFER	65536	/* Size of (de)compression buffer */
 #  define _HTTP_RESOLVE_DEFAULT	0	/* Just resolve with default options */
 #  define _HTTP_RESOLVE_STDERR	1	/* Log resolve progress to stderr */
@@ -292,8 +293,8 @@ struct _http_s				/**** HTTP connection structure ****/
   http_encoding_t	data_encoding;	/* Chunked or not */
   int			_data_remaining;/* Number of bytes left (deprecated) */
   int			used;		/* Number of bytes used in buffer */
-  char			buffer[HTTP_MAX_BUFFER];
-					/* Buffer for incoming data */
+  char			_buffer[HTTP_MAX_BUFFER];
+					/* Default buffer for incoming data */
   int			_auth_type;	/* Authentication in use (deprecated) */
   unsigned char		_md5_state[88];	/* MD5 state (deprecated) */
   char			nonce[HTTP_MAX_VALUE];
@@ -318,8 +319,8 @@ struct _http_s				/**** HTTP connection structure ****/
   off_t			data_remaining;	/* Number of bytes left */
   http_addr_t		*hostaddr;	/* Current host address and port */
   http_addrlist_t	*addrlist;	/* List of valid addresses */
-  char			wbuffer[HTTP_MAX_BUFFER];
-					/* Buffer for outgoing data */
+  char			_wbuffer[HTTP_MAX_BUFFER];
+					/* Default buffer for outgoing data */
   int			wused;		/* Write buffer bytes used */
 
   /**** New in CUPS 1.3 ****/
@@ -358,6 +359,9 @@ struct _http_s				/**** HTTP connection structure ****/
 					/* Allocated field values */
   			*default_fields[HTTP_FIELD_MAX];
 					/* Default field values, if any */
+  char			*buffer,	/* Buffer for incoming data */
+			*wbuffer;	/* Buffer for outgoing data */
+  int			bufsize;	/* Size of I/O buffers */
 };
 #  endif /* !_HTTP_NO_PRIVATE */
 
@@ -431,12 +435,17 @@ extern const char	*_httpResolveURI(const char *uri, char *resolved_uri,
 			                 size_t resolved_size, int options,
 					 int (*cb)(void *context),
 					 void *context);
+extern ssize_t		_httpSendFile(http_t *http, int fd);
+extern ssize_t		_httpSpliceRead(http_t *http, int fd);
+extern ssize_t		_httpSpliceWrite(http_t *http, int fd, size_t length);
 extern const char	*_httpStatus(cups_lang_t *lang, http_status_t status);
 extern void		_httpTLSInitialize(void);
 extern size_t		_httpTLSPending(http_t *http);
 extern int		_httpTLSRead(http_t *http, char *buf, int len);
+extern int		_httpTLSResumed(http_t *http);
 extern int		_httpTLSSetCredentials(http_t *http);
 extern void		_httpTLSSetOptions(int options, int min_version, int max_version);
+extern void		_httpTLSSetSessionCache(int entries, int lifetime);
 extern int		_httpTLSStart(http_t *http);
 extern void		_httpTLSStop(http_t *http);
 extern int		_httpTLSWrite(http_t *http, const char *buf, int len);
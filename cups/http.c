@@ -24,10 +24,14 @@
 #  include <signal.h>
 #  include <sys/time.h>
 #  include <sys/resource.h>
+#  include <sys/uio.h>
 #endif /* WIN32 */
 #ifdef HAVE_POLL
 #  include <poll.h>
 #endif /* HAVE_POLL */
+#ifdef HAVE_SENDFILE
+#  include <sys/sendfile.h>
+#endif /* HAVE_SENDFILE */
 
 
 /*
@@ -57,6 +61,10 @@ static ssize_t		http_write(http_t *http, const char *buffer,
 			           size_t length);
 static ssize_t		http_write_chunk(http_t *http, const char *buffer,
 			                 size_t length);
+static int		http_write_wait(http_t *http);
+#ifndef WIN32
+static ssize_t		http_writev(http_t *http, struct iovec *iov, int iovcnt);
+#endif /* !WIN32 */
 static off_t		http_set_length(http_t *http);
 static void		http_set_timeout(int fd, double timeout);
 static void		http_set_wait(http_t *http);
@@ -367,6 +375,12 @@ httpClose(http_t *http)			/* I - HTTP connection */
   if (http->authstring && http->authstring != http->_authstring)
     free(http->authstring);
 
+  if (http->buffer != http->_buffer)
+    free(http->buffer);
+
+  if (http->wbuffer != http->_wbuffer)
+    free(http->wbuffer);
+
   free(http);
 }
 
@@ -1170,7 +1184,7 @@ httpGets(char   *line,			/* I - Line to read into */
         return (NULL);
       }
 
-      bytes = http_read(http, http->buffer + http->used, (size_t)(HTTP_MAX_BUFFER - http->used));
+      bytes = http_read(http, http->buffer + http->used, (size_t)(http->bufsize - http->used));
 
       DEBUG_printf(("4httpGets: read " CUPS_LLFMT " bytes.", CUPS_LLCAST bytes));
 
@@ -1696,8 +1710,8 @@ httpPeek(http_t *http,			/* I - HTTP connection */
       }
     }
 
-    if ((size_t)http->data_remaining > sizeof(http->buffer))
-      buflen = sizeof(http->buffer);
+    if (http->data_remaining > http->bufsize)
+      buflen = http->bufsize;
     else
       buflen = (ssize_t)http->data_remaining;
 
@@ -2486,6 +2500,83 @@ httpSetAuthString(http_t     *http,	/* I - HTTP connection */
 }
 
 
+/*
+ * 'httpSetBufferSize()' - Set the size of the connection's I/O buffers.
+ *
+ * Larger buffers reduce the number of system calls needed to transfer large
+ * message bodies.  The size is limited to the range @code HTTP_MAX_BUFFER@ to
+ * 262144 bytes and any buffered data is preserved.  The buffers cannot be
+ * made smaller than the amount of data currently buffered.
+ *
+ * @since CUPS 2.3@
+ */
+
+int					/* O - 0 on success, -1 on error */
+httpSetBufferSize(http_t *http,		/* I - HTTP connection */
+                  size_t size)		/* I - Buffer size in bytes */
+{
+  char	*buffer,			/* New input buffer */
+	*wbuffer;			/* New output buffer */
+
+
+  if (!http)
+    return (-1);
+
+  if (size < HTTP_MAX_BUFFER)
+    size = HTTP_MAX_BUFFER;
+  else if (size > _HTTP_MAX_BUFSIZE)
+    size = _HTTP_MAX_BUFSIZE;
+
+  if (size == (size_t)http->bufsize)
+    return (0);
+
+  if (size < (size_t)http->used || size < (size_t)http->wused)
+  {
+   /*
+    * Don't shrink below the amount of buffered data...
+    */
+
+    return (-1);
+  }
+
+  if (size == HTTP_MAX_BUFFER)
+  {
+    buffer  = http->_buffer;
+    wbuffer = http->_wbuffer;
+  }
+  else
+  {
+    buffer  = malloc(size);
+    wbuffer = malloc(size);
+
+    if (!buffer || !wbuffer)
+    {
+      free(buffer);
+      free(wbuffer);
+
+      _cupsSetError(IPP_STATUS_ERROR_INTERNAL, strerror(errno), 0);
+      return (-1);
+    }
+  }
+
+  if (http->used > 0)
+    memcpy(buffer, http->buffer, (size_t)http->used);
+  if (http->wused > 0)
+    memcpy(wbuffer, http->wbuffer, (size_t)http->wused);
+
+  if (http->buffer != http->_buffer)
+    free(http->buffer);
+  if (http->wbuffer != http->_wbuffer)
+    free(http->wbuffer);
+
+  http->buffer  = buffer;
+  http->wbuffer = wbuffer;
+  http->bufsize = (int)size;
+
+  return (0);
+}
+
+
 /*
  * 'httpSetCredentials()' - Set the credentials associated with an encrypted
  *			    connection.
@@ -2677,6 +2768,125 @@ httpSetTimeout(
 }
 
 
+/*
+ * '_httpSendFile()' - Send the rest of a message body from a file.
+ *
+ * This function sends the remaining message body directly from the file
+ * descriptor to the socket using sendfile(), without copying the data through
+ * a user space buffer.  Only unencrypted bodies with a Content-Length and no
+ * content coding are supported - 0 is returned without writing anything for
+ * other messages so that the caller can fall back to httpWrite2().
+ */
+
+ssize_t					/* O - Number of bytes sent, 0 if not supported, or -1 on error */
+_httpSendFile(http_t *http,		/* I - HTTP connection */
+              int    fd)		/* I - File to send */
+{
+#ifdef HAVE_SENDFILE
+  ssize_t	total = 0,		/* Total bytes sent */
+		bytes;			/* Bytes sent */
+
+
+  if (!http || fd < 0 || http->data_encoding != HTTP_ENCODING_LENGTH || http->data_remaining <= 0)
+    return (0);
+
+#  ifdef HAVE_SSL
+  if (http->tls)
+    return (0);
+#  endif /* HAVE_SSL */
+
+#  ifdef HAVE_LIBZ
+  if (http->coding != _HTTP_CODING_IDENTITY)
+    return (0);
+#  endif /* HAVE_LIBZ */
+
+  DEBUG_printf(("_httpSendFile(http=%p, fd=%d) data_remaining=" CUPS_LLFMT ", wused=%d", (void *)http, fd, CUPS_LLCAST http->data_remaining, http->wused));
+
+  http->activity = time(NULL);
+  http->error    = 0;
+
+ /*
+  * Send anything that is already buffered (HTTP header, IPP message, etc.)
+  * before the file data...
+  */
+
+  if (http->wused && httpFlushWrite(http) < 0)
+    return (-1);
+
+  while (http->data_remaining > 0)
+  {
+    if (http->timeout_value > 0.0)
+    {
+      struct pollfd	pfd;		/* Polled file descriptor */
+      int		nfds;		/* Result from poll() */
+
+      do
+      {
+	pfd.fd     = http->fd;
+	pfd.events = POLLOUT;
+
+	while ((nfds = poll(&pfd, 1, http->wait_value)) < 0 && (errno == EINTR || errno == EAGAIN))
+	  /* do nothing */;
+
+	if (nfds < 0)
+	{
+	  http->error = errno;
+	  return (-1);
+	}
+	else if (nfds == 0 && (!http->timeout_cb || !(*http->timeout_cb)(http, http->timeout_data)))
+	{
+	  http->error = EWOULDBLOCK;
+	  return (-1);
+	}
+      }
+      while (nfds <= 0);
+    }
+
+    bytes = http->data_remaining > 1048576 ? 1048576 : (ssize_t)http->data_remaining;
+
+    if ((bytes = sendfile(http->fd, fd, NULL, (size_t)bytes)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      http->error = errno;
+      return (-1);
+    }
+    else if (bytes == 0)
+    {
+      DEBUG_puts("2_httpSendFile: Unexpected end of file.");
+      http->error = EIO;
+      return (-1);
+    }
+
+    http->data_remaining -= bytes;
+    total                += bytes;
+  }
+
+ /*
+  * Update the state just like httpWrite2() does at the end of the content...
+  */
+
+  if (http->state == HTTP_STATE_POST_RECV)
+    http->state ++;
+  else if (http->state == HTTP_STATE_POST_SEND || http->state == HTTP_STATE_GET_SEND)
+    http->state = HTTP_STATE_WAITING;
+  else
+    http->state = HTTP_STATE_STATUS;
+
+  DEBUG_printf(("1_httpSendFile: Sent " CUPS_LLFMT " bytes, set state to %s.", CUPS_LLCAST total, httpStateString(http->state)));
+
+  return (total);
+
+#else
+  (void)http;
+  (void)fd;
+
+  return (0);
+#endif /* HAVE_SENDFILE */
+}
+
+
 /*
  * 'httpShutdown()' - Shutdown one side of an HTTP connection.
  *
@@ -2702,6 +2912,292 @@ httpShutdown(http_t *http)		/* I - HTTP connection */
 }
 
 
+/*
+ * '_httpSpliceRead()' - Move the rest of a message body to a file.
+ *
+ * This function moves the remaining message body directly from the socket to
+ * the file descriptor using splice() and a pipe, without copying the data
+ * through a user space buffer.  Only unencrypted bodies with a Content-Length
+ * and no content coding are supported - 0 is returned without reading anything
+ * for other messages so that the caller can fall back to httpRead2().
+ */
+
+ssize_t					/* O - Number of bytes copied, 0 if not supported, or -1 on error */
+_httpSpliceRead(http_t *http,		/* I - HTTP connection */
+                int    fd)		/* I - File to write to */
+{
+#ifdef HAVE_SPLICE
+  ssize_t	total = 0,		/* Total bytes copied */
+		bytes,			/* Bytes moved into pipe */
+		written;		/* Bytes moved out of pipe */
+  int		pipefds[2];		/* Pipe between socket and file */
+
+
+  if (!http || fd < 0 || http->data_encoding != HTTP_ENCODING_LENGTH || http->data_remaining <= 0)
+    return (0);
+
+#  ifdef HAVE_SSL
+  if (http->tls)
+    return (0);
+#  endif /* HAVE_SSL */
+
+#  ifdef HAVE_LIBZ
+  if (http->coding != _HTTP_CODING_IDENTITY)
+    return (0);
+#  endif /* HAVE_LIBZ */
+
+  DEBUG_printf(("_httpSpliceRead(http=%p, fd=%d) data_remaining=" CUPS_LLFMT ", used=%d", (void *)http, fd, CUPS_LLCAST http->data_remaining, http->used));
+
+  http->activity = time(NULL);
+  http->error    = 0;
+
+ /*
+  * Write any data that is already in the input buffer...
+  */
+
+  if (http->used > 0)
+  {
+    bytes = http->used > http->data_remaining ? (ssize_t)http->data_remaining : (ssize_t)http->used;
+
+    while (total < bytes)
+    {
+      if ((written = write(fd, http->buffer + total, (size_t)(bytes - total))) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        http->error = errno;
+        return (-1);
+      }
+
+      total += written;
+    }
+
+    http->used           -= (int)bytes;
+    http->data_remaining -= bytes;
+
+    if (http->used > 0)
+      memmove(http->buffer, http->buffer + bytes, (size_t)http->used);
+  }
+
+ /*
+  * Then move the rest from the socket through a pipe...
+  */
+
+  if (http->data_remaining > 0)
+  {
+    if (pipe(pipefds))
+    {
+      http->error = errno;
+      return (-1);
+    }
+
+    while (http->data_remaining > 0)
+    {
+      if (!http->blocking || http->timeout_value > 0.0)
+      {
+	while (!httpWait(http, http->wait_value))
+	{
+	  if (http->timeout_cb && (*http->timeout_cb)(http, http->timeout_data))
+	    continue;
+
+	  DEBUG_puts("2_httpSpliceRead: Timeout.");
+	  http->error = ETIMEDOUT;
+	  break;
+	}
+
+	if (http->error)
+	  break;
+      }
+
+      bytes = http->data_remaining > 65536 ? 65536 : (ssize_t)http->data_remaining;
+
+      if ((bytes = splice(http->fd, NULL, pipefds[1], NULL, (size_t)bytes, SPLICE_F_MOVE | SPLICE_F_MORE)) < 0)
+      {
+        if (errno == EINTR || errno == EAGAIN)
+          continue;
+
+        http->error = errno;
+        break;
+      }
+      else if (bytes == 0)
+      {
+        DEBUG_puts("2_httpSpliceRead: Unexpected end of message body.");
+        http->error = EPIPE;
+        break;
+      }
+
+      http->data_remaining -= bytes;
+      total                += bytes;
+
+      while (bytes > 0)
+      {
+        if ((written = splice(pipefds[0], NULL, fd, NULL, (size_t)bytes, SPLICE_F_MOVE | SPLICE_F_MORE)) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          http->error = errno;
+          break;
+        }
+
+        bytes -= written;
+      }
+
+      if (http->error)
+        break;
+    }
+
+    close(pipefds[0]);
+    close(pipefds[1]);
+
+    if (http->error)
+    {
+      errno = http->error;
+      return (-1);
+    }
+  }
+
+ /*
+  * Update the state just like httpRead2() does at the end of the content...
+  */
+
+  if (http->state == HTTP_STATE_POST_RECV)
+    http->state ++;
+  else if (http->state == HTTP_STATE_GET_SEND || http->state == HTTP_STATE_POST_SEND)
+    http->state = HTTP_STATE_WAITING;
+  else
+    http->state = HTTP_STATE_STATUS;
+
+  DEBUG_printf(("1_httpSpliceRead: Copied " CUPS_LLFMT " bytes, set state to %s.", CUPS_LLCAST total, httpStateString(http->state)));
+
+  return (total);
+
+#else
+  (void)http;
+  (void)fd;
+
+  return (0);
+#endif /* HAVE_SPLICE */
+}
+
+
+/*
+ * '_httpSpliceWrite()' - Move part of a message body from a pipe.
+ *
+ * This function moves "length" bytes that are already waiting in the pipe to
+ * the socket using splice(), without copying the data through a user space
+ * buffer.  The data is sent as a single chunk.  Only unencrypted, chunked
+ * bodies with no content coding are supported - 0 is returned without reading
+ * anything from the pipe for other messages so that the caller can fall back
+ * to httpWrite2().
+ */
+
+ssize_t					/* O - Number of bytes sent, 0 if not supported, or -1 on error */
+_httpSpliceWrite(http_t *http,		/* I - HTTP connection */
+                 int    fd,		/* I - Pipe to read from */
+                 size_t length)		/* I - Number of bytes to send */
+{
+#ifdef HAVE_SPLICE
+  ssize_t	total = 0,		/* Total bytes sent */
+		bytes;			/* Bytes sent */
+  char		header[16];		/* Chunk header */
+
+
+  if (!http || fd < 0 || length == 0 || http->data_encoding != HTTP_ENCODING_CHUNKED)
+    return (0);
+
+#  ifdef HAVE_SSL
+  if (http->tls)
+    return (0);
+#  endif /* HAVE_SSL */
+
+#  ifdef HAVE_LIBZ
+  if (http->coding != _HTTP_CODING_IDENTITY)
+    return (0);
+#  endif /* HAVE_LIBZ */
+
+  DEBUG_printf(("_httpSpliceWrite(http=%p, fd=%d, length=" CUPS_LLFMT ") wused=%d", (void *)http, fd, CUPS_LLCAST length, http->wused));
+
+  http->activity = time(NULL);
+  http->error    = 0;
+
+ /*
+  * Send anything that is already buffered before the chunk...
+  */
+
+  if (http->wused && httpFlushWrite(http) < 0)
+    return (-1);
+
+  snprintf(header, sizeof(header), "%x\r\n", (unsigned)length);
+
+  if (http_write(http, header, strlen(header)) < 0)
+    return (-1);
+
+  while (total < (ssize_t)length)
+  {
+    if (http->timeout_value > 0.0)
+    {
+      struct pollfd	pfd;		/* Polled file descriptor */
+      int		nfds;		/* Result from poll() */
+
+      do
+      {
+	pfd.fd     = http->fd;
+	pfd.events = POLLOUT;
+
+	while ((nfds = poll(&pfd, 1, http->wait_value)) < 0 && (errno == EINTR || errno == EAGAIN))
+	  /* do nothing */;
+
+	if (nfds < 0)
+	{
+	  http->error = errno;
+	  return (-1);
+	}
+	else if (nfds == 0 && (!http->timeout_cb || !(*http->timeout_cb)(http, http->timeout_data)))
+	{
+	  http->error = EWOULDBLOCK;
+	  return (-1);
+	}
+      }
+      while (nfds <= 0);
+    }
+
+    if ((bytes = splice(fd, NULL, http->fd, NULL, length - (size_t)total, SPLICE_F_MOVE | SPLICE_F_MORE)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      http->error = errno;
+      return (-1);
+    }
+    else if (bytes == 0)
+    {
+      DEBUG_puts("2_httpSpliceWrite: Unexpected end of pipe.");
+      http->error = EIO;
+      return (-1);
+    }
+
+    total += bytes;
+  }
+
+  if (http_write(http, "\r\n", 2) < 0)
+    return (-1);
+
+  DEBUG_printf(("1_httpSpliceWrite: Sent " CUPS_LLFMT " bytes.", CUPS_LLCAST total));
+
+  return (total);
+
+#else
+  (void)http;
+  (void)fd;
+  (void)length;
+
+  return (0);
+#endif /* HAVE_SPLICE */
+}
+
+
 /*
  * 'httpTrace()' - Send an TRACE request to the server.
  *
@@ -3202,7 +3698,7 @@ httpWrite2(http_t     *http,		/* I - HTTP connection */
 #endif /* HAVE_LIBZ */
   if (length > 0)
   {
-    if (http->wused && (length + (size_t)http->wused) > sizeof(http->wbuffer))
+    if (http->wused && (length + (size_t)http->wused) > (size_t)http->bufsize && length < (size_t)http->bufsize)
     {
       DEBUG_printf(("2httpWrite2: Flushing buffer (wused=%d, length="
                     CUPS_LLFMT ")", http->wused, CUPS_LLCAST length));
@@ -3210,7 +3706,7 @@ httpWrite2(http_t     *http,		/* I - HTTP connection */
       httpFlushWrite(http);
     }
 
-    if ((length + (size_t)http->wused) <= sizeof(http->wbuffer) && length < sizeof(http->wbuffer))
+    if ((length + (size_t)http->wused) <= (size_t)http->bufsize && length < (size_t)http->bufsize)
     {
      /*
       * Write to buffer...
@@ -3226,12 +3722,56 @@ httpWrite2(http_t     *http,		/* I - HTTP connection */
     else
     {
      /*
-      * Otherwise write the data directly...
+      * Otherwise write the data directly, along with any buffered data...
       */
 
       DEBUG_printf(("2httpWrite2: Writing " CUPS_LLFMT " bytes to socket...",
                     CUPS_LLCAST length));
 
+#ifdef WIN32
+      if (http->wused)
+        httpFlushWrite(http);
+
+#else
+      if (http->wused)
+      {
+        char		header[16];	/* Chunk header */
+        struct iovec	iov[4];		/* Header, buffered data, data, trailer */
+        int		iovcnt = 0;	/* Number of buffers */
+
+        if (http->data_encoding == HTTP_ENCODING_CHUNKED)
+        {
+          snprintf(header, sizeof(header), "%x\r\n", (unsigned)(length + (size_t)http->wused));
+
+          iov[iovcnt].iov_base = header;
+          iov[iovcnt].iov_len  = strlen(header);
+          iovcnt ++;
+        }
+
+        iov[iovcnt].iov_base = http->wbuffer;
+        iov[iovcnt].iov_len  = (size_t)http->wused;
+        iovcnt ++;
+
+        iov[iovcnt].iov_base = (void *)buffer;
+        iov[iovcnt].iov_len  = length;
+        iovcnt ++;
+
+        if (http->data_encoding == HTTP_ENCODING_CHUNKED)
+        {
+          iov[iovcnt].iov_base = (void *)"\r\n";
+          iov[iovcnt].iov_len  = 2;
+          iovcnt ++;
+        }
+
+        http->wused = 0;
+
+        if (http_writev(http, iov, iovcnt) < 0)
+          bytes = -1;
+        else
+          bytes = (ssize_t)length;
+      }
+      else
+#endif /* WIN32 */
       if (http->data_encoding == HTTP_ENCODING_CHUNKED)
 	bytes = (ssize_t)http_write_chunk(http, buffer, length);
       else
@@ -3928,6 +4468,9 @@ http_create(
   http->addrlist = myaddrlist;
   http->blocking = blocking;
   http->fd       = -1;
+  http->buffer   = http->_buffer;
+  http->wbuffer  = http->_wbuffer;
+  http->bufsize  = HTTP_MAX_BUFFER;
 #ifdef HAVE_GSSAPI
   http->gssctx   = GSS_C_NO_CONTEXT;
   http->gssname  = GSS_C_NO_NAME;
@@ -4626,62 +5169,8 @@ http_write(http_t     *http,		/* I - HTTP connection */
   {
     DEBUG_printf(("3http_write: About to write %d bytes.", (int)length));
 
-    if (http->timeout_value > 0.0)
-    {
-#ifdef HAVE_POLL
-      struct pollfd	pfd;		/* Polled file descriptor */
-#else
-      fd_set		output_set;	/* Output ready for write? */
-      struct timeval	timeout;	/* Timeout value */
-#endif /* HAVE_POLL */
-      int		nfds;		/* Result from select()/poll() */
-
-      do
-      {
-#ifdef HAVE_POLL
-	pfd.fd     = http->fd;
-	pfd.events = POLLOUT;
-
-	while ((nfds = poll(&pfd, 1, http->wait_value)) < 0 &&
-	       (errno == EINTR || errno == EAGAIN))
-	  /* do nothing */;
-
-#else
-	do
-	{
-	  FD_ZERO(&output_set);
-	  FD_SET(http->fd, &output_set);
-
-	  timeout.tv_sec  = http->wait_value / 1000;
-	  timeout.tv_usec = 1000 * (http->wait_value % 1000);
-
-	  nfds = select(http->fd + 1, NULL, &output_set, NULL, &timeout);
-	}
-#  ifdef WIN32
-	while (nfds < 0 && (WSAGetLastError() == WSAEINTR ||
-			    WSAGetLastError() == WSAEWOULDBLOCK));
-#  else
-	while (nfds < 0 && (errno == EINTR || errno == EAGAIN));
-#  endif /* WIN32 */
-#endif /* HAVE_POLL */
-
-        if (nfds < 0)
-	{
-	  http->error = errno;
-	  return (-1);
-	}
-	else if (nfds == 0 && (!http->timeout_cb || !(*http->timeout_cb)(http, http->timeout_data)))
-	{
-#ifdef WIN32
-	  http->error = WSAEWOULDBLOCK;
-#else
-	  http->error = EWOULDBLOCK;
-#endif /* WIN32 */
-	  return (-1);
-	}
-      }
-      while (nfds <= 0);
-    }
+    if (http->timeout_value > 0.0 && http_write_wait(http))
+      return (-1);
 
 #ifdef HAVE_SSL
     if (http->tls)
@@ -4763,6 +5252,9 @@ http_write_chunk(http_t     *http,	/* I - HTTP connection */
 {
   char		header[16];		/* Chunk header */
   ssize_t	bytes;			/* Bytes written */
+#ifndef WIN32
+  struct iovec	iov[3];			/* Chunk header, data, and trailer */
+#endif /* !WIN32 */
 
 
   DEBUG_printf(("7http_write_chunk(http=%p, buffer=%p, length=" CUPS_LLFMT ")", (void *)http, (void *)buffer, CUPS_LLCAST length));
@@ -4772,6 +5264,8 @@ http_write_chunk(http_t     *http,	/* I - HTTP connection */
   */
 
   snprintf(header, sizeof(header), "%x\r\n", (unsigned)length);
+
+#ifdef WIN32
   if (http_write(http, header, strlen(header)) < 0)
   {
     DEBUG_puts("8http_write_chunk: http_write of length failed.");
@@ -4790,5 +5284,175 @@ http_write_chunk(http_t     *http,	/* I - HTTP connection */
     return (-1);
   }
 
+#else
+  iov[0].iov_base = header;
+  iov[0].iov_len  = strlen(header);
+  iov[1].iov_base = (void *)buffer;
+  iov[1].iov_len  = length;
+  iov[2].iov_base = (void *)"\r\n";
+  iov[2].iov_len  = 2;
+
+  if (http_writev(http, iov, 3) < 0)
+  {
+    DEBUG_puts("8http_write_chunk: http_writev failed.");
+    return (-1);
+  }
+
+  bytes = (ssize_t)length;
+#endif /* WIN32 */
+
   return (bytes);
 }
+
+
+/*
+ * 'http_write_wait()' - Wait for a connection to be ready for writing.
+ *
+ * The timeout callback, if any, is called each time the wait value expires
+ * and can keep waiting by returning 1.
+ */
+
+static int				/* O - 0 when ready, -1 on error or timeout */
+http_write_wait(http_t *http)		/* I - HTTP connection */
+{
+#ifdef HAVE_POLL
+  struct pollfd		pfd;		/* Polled file descriptor */
+#else
+  fd_set		output_set;	/* Output ready for write? */
+  struct timeval	timeout;	/* Timeout value */
+#endif /* HAVE_POLL */
+  int			nfds;		/* Result from select()/poll() */
+
+
+  do
+  {
+#ifdef HAVE_POLL
+    pfd.fd     = http->fd;
+    pfd.events = POLLOUT;
+
+    while ((nfds = poll(&pfd, 1, http->wait_value)) < 0 &&
+           (errno == EINTR || errno == EAGAIN))
+      /* do nothing */;
+
+#else
+    do
+    {
+      FD_ZERO(&output_set);
+      FD_SET(http->fd, &output_set);
+
+      timeout.tv_sec  = http->wait_value / 1000;
+      timeout.tv_usec = 1000 * (http->wait_value % 1000);
+
+      nfds = select(http->fd + 1, NULL, &output_set, NULL, &timeout);
+    }
+#  ifdef WIN32
+    while (nfds < 0 && (WSAGetLastError() == WSAEINTR ||
+			WSAGetLastError() == WSAEWOULDBLOCK));
+#  else
+    while (nfds < 0 && (errno == EINTR || errno == EAGAIN));
+#  endif /* WIN32 */
+#endif /* HAVE_POLL */
+
+    if (nfds < 0)
+    {
+      http->error = errno;
+      return (-1);
+    }
+    else if (nfds == 0 && (!http->timeout_cb || !(*http->timeout_cb)(http, http->timeout_data)))
+    {
+#ifdef WIN32
+      http->error = WSAEWOULDBLOCK;
+#else
+      http->error = EWOULDBLOCK;
+#endif /* WIN32 */
+      return (-1);
+    }
+  }
+  while (nfds <= 0);
+
+  return (0);
+}
+
+
+#ifndef WIN32
+/*
+ * 'http_writev()' - Write multiple buffers to a connection.
+ *
+ * Unencrypted data is sent with as few writev() calls as possible, waiting
+ * for the connection and handling errors the same way as http_write().
+ * Encrypted data and the last buffer are sent using http_write().
+ */
+
+static ssize_t				/* O - Number of bytes written or -1 on error */
+http_writev(http_t       *http,		/* I - HTTP connection */
+            struct iovec *iov,		/* I - Buffers to write */
+            int          iovcnt)	/* I - Number of buffers */
+{
+  ssize_t	tbytes = 0,		/* Total bytes written */
+		bytes;			/* Bytes written */
+
+
+  DEBUG_printf(("2http_writev(http=%p, iov=%p, iovcnt=%d)", (void *)http, (void *)iov, iovcnt));
+
+  http->error = 0;
+
+  while (iovcnt > 1 && !http->tls)
+  {
+    if (http->timeout_value > 0.0 && http_write_wait(http))
+      return (-1);
+
+    if ((bytes = writev(http->fd, iov, iovcnt)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      else if (errno == EWOULDBLOCK || errno == EAGAIN)
+      {
+	if (http->timeout_cb && (*http->timeout_cb)(http, http->timeout_data))
+          continue;
+        else if (!http->timeout_cb && errno == EAGAIN)
+	  continue;
+
+        http->error = errno;
+      }
+      else if (errno != http->error && errno != ECONNRESET)
+      {
+        http->error = errno;
+	continue;
+      }
+
+      DEBUG_printf(("3http_writev: error writing data (%s).", strerror(http->error)));
+
+      return (-1);
+    }
+
+    tbytes += bytes;
+
+    while (iovcnt > 0 && (size_t)bytes >= iov->iov_len)
+    {
+      bytes -= (ssize_t)iov->iov_len;
+      iov ++;
+      iovcnt --;
+    }
+
+    if (iovcnt > 0)
+    {
+      iov->iov_base = (char *)iov->iov_base + bytes;
+      iov->iov_len  -= (size_t)bytes;
+    }
+  }
+
+ /*
+  * Write any remaining buffers...
+  */
+
+  for (; iovcnt > 0; iov ++, iovcnt --)
+  {
+    if ((bytes = http_write(http, iov->iov_base, iov->iov_len)) < 0)
+      return (-1);
+
+    tbytes += bytes;
+  }
+
+  return (tbytes);
+}
+#endif /* !WIN32 */
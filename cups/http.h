@@ -642,6 +642,9 @@ extern void		httpShutdown(http_t *http) _CUPS_API_2_0;
 extern const char	*httpStateString(http_state_t state) _CUPS_API_2_0;
 extern const char	*httpURIStatusString(http_uri_status_t status) _CUPS_API_2_0;
 
+/* New in CUPS 2.3 */
+extern int		httpSetBufferSize(http_t *http, size_t size) _CUPS_API_2_3;
+
 /*
  * C++ magic...
  */
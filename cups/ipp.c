@@ -18,6 +18,18 @@
 #endif /* WIN32 */
 
 
+/*
+ * Local types...
+ */
+
+typedef struct _ipp_wbuffer_s		/**** Message write buffer ****/
+{
+  ipp_uchar_t	*data;			/* Encoded message */
+  size_t	size,			/* Size of buffer */
+		used;			/* Bytes used */
+} _ipp_wbuffer_t;
+
+
 /*
  * Local functions...
  */
@@ -42,6 +54,8 @@ static void		ipp_set_error(ipp_status_t status, const char *format,
 			              ...);
 static _ipp_value_t	*ipp_set_value(ipp_t *ipp, ipp_attribute_t **attr,
 			               int element);
+static ssize_t		ipp_write_buffer(_ipp_wbuffer_t *wbuf,
+			                 ipp_uchar_t *buffer, size_t length);
 static ssize_t		ipp_write_file(int *fd, ipp_uchar_t *buffer,
 			               size_t length);
 
@@ -5316,11 +5330,46 @@ ipp_state_t				/* O - Current state */
 ippWrite(http_t *http,			/* I - HTTP connection */
          ipp_t  *ipp)			/* I - IPP data */
 {
+  _ipp_wbuffer_t	wbuf;		/* Message write buffer */
+
+
   DEBUG_printf(("ippWrite(http=%p, ipp=%p)", (void *)http, (void *)ipp));
 
   if (!http)
     return (IPP_STATE_ERROR);
 
+  if (http->blocking && ipp && ipp->state == IPP_STATE_IDLE && (wbuf.size = ippLength(ipp)) > 0 && (wbuf.data = malloc(wbuf.size)) != NULL)
+  {
+   /*
+    * Encode the whole message and hand it to the HTTP layer in one piece, so
+    * that it is sent with as few system calls as possible...
+    */
+
+    wbuf.used = 0;
+
+    if (ippWriteIO(&wbuf, (ipp_iocb_t)ipp_write_buffer, 1, NULL, ipp) == IPP_STATE_DATA && wbuf.used == wbuf.size)
+    {
+      if (httpWrite2(http, (char *)wbuf.data, wbuf.used) < 0)
+        ipp->state = IPP_STATE_ERROR;
+    }
+    else
+    {
+     /*
+      * Encoding failed, so fall back to writing the message directly...
+      */
+
+      DEBUG_printf(("1ippWrite: Unable to buffer message (" CUPS_LLFMT " of " CUPS_LLFMT " bytes).", CUPS_LLCAST wbuf.used, CUPS_LLCAST wbuf.size));
+
+      ipp->state   = IPP_STATE_IDLE;
+      ipp->current = NULL;
+    }
+
+    free(wbuf.data);
+
+    if (ipp->state != IPP_STATE_IDLE)
+      return (ipp->state);
+  }
+
   return (ippWriteIO(http, (ipp_iocb_t)httpWrite2, http->blocking, NULL, ipp));
 }
 
@@ -6900,6 +6949,26 @@ ipp_set_value(ipp_t           *ipp,	/* IO - IPP message */
 }
 
 
+/*
+ * 'ipp_write_buffer()' - Append IPP data to a message write buffer.
+ */
+
+static ssize_t				/* O - Number of bytes written or -1 on error */
+ipp_write_buffer(
+    _ipp_wbuffer_t *wbuf,		/* I - Message write buffer */
+    ipp_uchar_t    *buffer,		/* I - Data to write */
+    size_t         length)		/* I - Number of bytes to write */
+{
+  if (length > (wbuf->size - wbuf->used))
+    return (-1);
+
+  memcpy(wbuf->data + wbuf->used, buffer, length);
+  wbuf->used += length;
+
+  return ((ssize_t)length);
+}
+
+
 /*
  * 'ipp_write_file()' - Write IPP data to a file.
  */
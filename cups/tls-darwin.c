@@ -1127,6 +1127,19 @@ _httpTLSRead(http_t *http,		/* I - HTTP connection */
 }
 
 
+/*
+ * '_httpTLSResumed()' - Return whether a TLS connection resumed a previous session.
+ */
+
+int					/* O - 1 if resumed, 0 for a full handshake */
+_httpTLSResumed(http_t *http)		/* I - HTTP connection */
+{
+  (void)http;
+
+  return (0);
+}
+
+
 /*
  * '_httpTLSSetOptions()' - Set TLS protocol and cipher suite options.
  */
@@ -1145,6 +1158,21 @@ _httpTLSSetOptions(int options,		/* I - Options */
 }
 
 
+/*
+ * '_httpTLSSetSessionCache()' - Set server-side session resumption options.
+ *
+ * Session resumption is not currently configurable with this TLS library.
+ */
+
+void
+_httpTLSSetSessionCache(int entries,	/* I - Maximum number of cached sessions */
+                        int lifetime)	/* I - Lifetime of sessions in seconds */
+{
+  (void)entries;
+  (void)lifetime;
+}
+
+
 /*
  * '_httpTLSStart()' - Set up SSL/TLS support on a connection.
  */
@@ -32,6 +32,26 @@ static _cups_mutex_t	tls_mutex = _CUPS_MUTEX_INITIALIZER;
 static int		tls_options = -1,/* Options for TLS connections */
 			tls_min_version = _HTTP_TLS_1_0,
 			tls_max_version = _HTTP_TLS_MAX;
+static cups_array_t	*tls_sessions = NULL;
+					/* Server session cache */
+static int		tls_session_entries = 0,
+					/* Maximum number of cached sessions */
+			tls_session_lifetime = 0;
+					/* Lifetime of sessions in seconds */
+static gnutls_datum_t	tls_ticket_key = { NULL, 0 };
+					/* Server session ticket key */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct _http_tls_session_s	/**** Cached TLS session ****/
+{
+  time_t		expires;	/* Expiration time */
+  gnutls_datum_t	key,		/* Session ID */
+			data;		/* Session data */
+} _http_tls_session_t;
 
 
 /*
@@ -43,6 +63,10 @@ static const char	*http_gnutls_default_path(char *buffer, size_t bufsize);
 static void		http_gnutls_load_crl(void);
 static const char	*http_gnutls_make_path(char *buffer, size_t bufsize, const char *dirname, const char *filename, const char *ext);
 static ssize_t		http_gnutls_read(gnutls_transport_ptr_t ptr, void *data, size_t length);
+static int		http_gnutls_session_compare(_http_tls_session_t *a, _http_tls_session_t *b);
+static int		http_gnutls_session_remove(void *ptr, gnutls_datum_t key);
+static gnutls_datum_t	http_gnutls_session_retrieve(void *ptr, gnutls_datum_t key);
+static int		http_gnutls_session_store(void *ptr, gnutls_datum_t key, gnutls_datum_t data);
 static ssize_t		http_gnutls_write(gnutls_transport_ptr_t ptr, const void *data, size_t length);
 
 
@@ -1109,6 +1133,171 @@ http_gnutls_read(
 }
 
 
+/*
+ * 'http_gnutls_session_compare()' - Compare two cached sessions by ID.
+ */
+
+static int				/* O - Result of comparison */
+http_gnutls_session_compare(
+    _http_tls_session_t *a,		/* I - First session */
+    _http_tls_session_t *b)		/* I - Second session */
+{
+  if (a->key.size != b->key.size)
+    return ((int)a->key.size - (int)b->key.size);
+  else
+    return (memcmp(a->key.data, b->key.data, a->key.size));
+}
+
+
+/*
+ * 'http_gnutls_session_remove()' - Remove a session from the cache.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+http_gnutls_session_remove(
+    void           *ptr,		/* I - Callback data (unused) */
+    gnutls_datum_t key)			/* I - Session ID */
+{
+  _http_tls_session_t	search,		/* Search key */
+			*session;	/* Matching session */
+
+
+  (void)ptr;
+
+  search.key = key;
+
+  _cupsMutexLock(&tls_mutex);
+
+  if ((session = (_http_tls_session_t *)cupsArrayFind(tls_sessions, &search)) != NULL)
+  {
+    cupsArrayRemove(tls_sessions, session);
+    free(session);
+  }
+
+  _cupsMutexUnlock(&tls_mutex);
+
+  return (session ? 0 : -1);
+}
+
+
+/*
+ * 'http_gnutls_session_retrieve()' - Find a session in the cache.
+ */
+
+static gnutls_datum_t			/* O - Session data or empty datum */
+http_gnutls_session_retrieve(
+    void           *ptr,		/* I - Callback data (unused) */
+    gnutls_datum_t key)			/* I - Session ID */
+{
+  _http_tls_session_t	search,		/* Search key */
+			*session;	/* Matching session */
+  gnutls_datum_t	data = { NULL, 0 };
+					/* Copy of session data */
+
+
+  (void)ptr;
+
+  search.key = key;
+
+  _cupsMutexLock(&tls_mutex);
+
+  if ((session = (_http_tls_session_t *)cupsArrayFind(tls_sessions, &search)) != NULL)
+  {
+    if (session->expires < time(NULL))
+    {
+      cupsArrayRemove(tls_sessions, session);
+      free(session);
+    }
+    else if ((data.data = gnutls_malloc(session->data.size)) != NULL)
+    {
+     /*
+      * GNU TLS frees the returned data, so return a copy...
+      */
+
+      memcpy(data.data, session->data.data, session->data.size);
+      data.size = session->data.size;
+    }
+  }
+
+  _cupsMutexUnlock(&tls_mutex);
+
+  return (data);
+}
+
+
+/*
+ * 'http_gnutls_session_store()' - Add a session to the cache.
+ *
+ * Expired sessions are purged when the cache is full; if it is still full the
+ * session closest to expiring is replaced.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+http_gnutls_session_store(
+    void           *ptr,		/* I - Callback data (unused) */
+    gnutls_datum_t key,			/* I - Session ID */
+    gnutls_datum_t data)		/* I - Session data */
+{
+  _http_tls_session_t	*session,	/* New session */
+			*current,	/* Current session */
+			*oldest;	/* Session closest to expiring */
+  time_t		curtime = time(NULL);
+					/* Current time */
+
+
+  (void)ptr;
+
+  if ((session = malloc(sizeof(_http_tls_session_t) + key.size + data.size)) == NULL)
+    return (-1);
+
+  session->expires   = curtime + tls_session_lifetime;
+  session->key.data  = (unsigned char *)(session + 1);
+  session->key.size  = key.size;
+  session->data.data = session->key.data + key.size;
+  session->data.size = data.size;
+
+  memcpy(session->key.data, key.data, key.size);
+  memcpy(session->data.data, data.data, data.size);
+
+  _cupsMutexLock(&tls_mutex);
+
+  if (!tls_sessions)
+    tls_sessions = cupsArrayNew((cups_array_func_t)http_gnutls_session_compare, NULL);
+
+  if ((current = (_http_tls_session_t *)cupsArrayFind(tls_sessions, session)) != NULL)
+  {
+    cupsArrayRemove(tls_sessions, current);
+    free(current);
+  }
+
+  if (cupsArrayCount(tls_sessions) >= tls_session_entries)
+  {
+    for (current = (_http_tls_session_t *)cupsArrayFirst(tls_sessions), oldest = NULL; current; current = (_http_tls_session_t *)cupsArrayNext(tls_sessions))
+    {
+      if (current->expires < curtime)
+      {
+        cupsArrayRemove(tls_sessions, current);
+        free(current);
+      }
+      else if (!oldest || current->expires < oldest->expires)
+        oldest = current;
+    }
+
+    if (cupsArrayCount(tls_sessions) >= tls_session_entries && oldest)
+    {
+      cupsArrayRemove(tls_sessions, oldest);
+      free(oldest);
+    }
+  }
+
+  cupsArrayAdd(tls_sessions, session);
+
+  _cupsMutexUnlock(&tls_mutex);
+
+  return (0);
+}
+
+
 /*
  * 'http_gnutls_write()' - Write function for the GNU TLS library.
  */
@@ -1199,6 +1388,17 @@ _httpTLSRead(http_t *http,		/* I - Connection to server */
 }
 
 
+/*
+ * '_httpTLSResumed()' - Return whether a TLS connection resumed a previous session.
+ */
+
+int					/* O - 1 if resumed, 0 for a full handshake */
+_httpTLSResumed(http_t *http)		/* I - HTTP connection */
+{
+  return (http->tls && gnutls_session_is_resumed(http->tls));
+}
+
+
 /*
  * '_httpTLSSetCredentials()' - Set the TLS credentials.
  */
@@ -1230,6 +1430,35 @@ _httpTLSSetOptions(int options,		/* I - Options */
 }
 
 
+/*
+ * '_httpTLSSetSessionCache()' - Set server-side session resumption options.
+ *
+ * When "lifetime" is greater than 0, server connections issue session tickets
+ * and keep up to "entries" sessions in memory for clients that resume using
+ * a session ID.  A "lifetime" of 0 disables session resumption.
+ */
+
+void
+_httpTLSSetSessionCache(int entries,	/* I - Maximum number of cached sessions */
+                        int lifetime)	/* I - Lifetime of sessions in seconds */
+{
+  _cupsMutexLock(&tls_mutex);
+
+  tls_session_entries  = entries > 0 ? entries : 0;
+  tls_session_lifetime = lifetime > 0 ? lifetime : 0;
+
+  if (!tls_session_lifetime && tls_ticket_key.data)
+  {
+    gnutls_free(tls_ticket_key.data);
+
+    tls_ticket_key.data = NULL;
+    tls_ticket_key.size = 0;
+  }
+
+  _cupsMutexUnlock(&tls_mutex);
+}
+
+
 /*
  * '_httpTLSStart()' - Set up SSL/TLS support on a connection.
  */
@@ -1574,6 +1803,36 @@ _httpTLSStart(http_t *http)		/* I - Connection to server */
   gnutls_priority_deinit(priority);
 #endif /* HAVE_GNUTLS_PRIORITY_SET_DIRECT */
 
+  if (http->mode == _HTTP_MODE_SERVER)
+  {
+   /*
+    * Enable session resumption as configured...
+    */
+
+    _cupsMutexLock(&tls_mutex);
+
+    if (tls_session_lifetime > 0)
+    {
+      if (!tls_ticket_key.data)
+        gnutls_session_ticket_key_generate(&tls_ticket_key);
+
+      if (tls_ticket_key.data)
+        gnutls_session_ticket_enable_server(http->tls, &tls_ticket_key);
+
+      gnutls_db_set_cache_expiration(http->tls, tls_session_lifetime);
+
+      if (tls_session_entries > 0)
+      {
+        gnutls_db_set_retrieve_function(http->tls, http_gnutls_session_retrieve);
+        gnutls_db_set_remove_function(http->tls, http_gnutls_session_remove);
+        gnutls_db_set_store_function(http->tls, http_gnutls_session_store);
+        gnutls_db_set_ptr(http->tls, NULL);
+      }
+    }
+
+    _cupsMutexUnlock(&tls_mutex);
+  }
+
   gnutls_transport_set_ptr(http->tls, (gnutls_transport_ptr_t)http);
   gnutls_transport_set_pull_function(http->tls, http_gnutls_read);
 #ifdef HAVE_GNUTLS_TRANSPORT_SET_PULL_TIMEOUT_FUNCTION
@@ -0,0 +1,594 @@
+/*
+ * Job archive support for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#include "ippserver.h"
+
+
+/*
+ * When "JobArchive" is enabled, completed jobs that leave the in-memory job
+ * history are written to an archive in the printer's spool directory so that
+ * Get-Jobs can report them for as long as the files are kept.
+ *
+ * The archive consists of two files.  "history.jobs" holds fixed-size
+ * records indexed by job-id - the record for job N is at offset N times the
+ * record size - with the job state, times, and user name so that Get-Jobs can
+ * filter jobs without reading their attributes.  "history.attrs" holds the
+ * IPP-encoded job attributes for each record.  Get-Jobs walks the records
+ * from the newest job-id down, reading blocks of records at a time, and only
+ * loads the attributes of jobs that are returned.
+ *
+ * Each record also links to the user's previous archived job, and the
+ * printer keeps the newest archived job-id for each user (built when the
+ * archive is opened), so "my-jobs" requests only read the user's records.
+ * Get-Jobs always reports jobs in job-id order, so there is no separate
+ * completion-time index; instead a request skips at most SERVER_ARCHIVE_SCAN
+ * records that don't match its "which-jobs" value.  Memory use grows with
+ * the number of users in the archive, not the number of jobs.
+ */
+
+#define SERVER_ARCHIVE_BLOCK	64	/* Records read at a time */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct server_arecord_s		/**** Archive record ****/
+{
+  int		id;			/* job-id or 0 if unused */
+  ipp_jstate_t	state;			/* job-state value */
+  server_jreason_t state_reasons;	/* job-state-reasons values */
+  int		impressions,		/* job-impressions value */
+		impcompleted;		/* job-impressions-completed value */
+  time_t	created,		/* time-at-creation value */
+		processing,		/* time-at-processing value */
+		completed;		/* time-at-completed value */
+  off_t		offset;			/* Offset of attributes */
+  size_t	length;			/* Length of attributes */
+  int		prev_user_id;		/* Previous archived job-id for user or 0 */
+  char		username[256];		/* job-originating-user-name value */
+} server_arecord_t;
+
+typedef struct server_auser_s		/**** Archived jobs for a user ****/
+{
+  char		*name;			/* job-originating-user-name value */
+  int		last_id;		/* Newest archived job-id */
+} server_auser_t;
+
+typedef struct server_abuffer_s		/**** Attribute buffer ****/
+{
+  ipp_uchar_t	*data;			/* Buffer */
+  size_t	used,			/* Bytes used */
+		alloc;			/* Bytes allocated */
+} server_abuffer_t;
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_users(server_auser_t *a, server_auser_t *b);
+static void	free_user(server_auser_t *user);
+static server_auser_t *get_user(server_printer_t *printer, const char *username, int create);
+static int	load_job(server_printer_t *printer, server_arecord_t *record, server_job_t *job);
+static int	match_record(server_arecord_t *record, ipp_jstate_t state, int comparison);
+static ssize_t	read_buffer(server_abuffer_t *buffer, ipp_uchar_t *data, size_t length);
+static int	read_record(server_printer_t *printer, int id, server_arecord_t *record);
+static ssize_t	write_buffer(server_abuffer_t *buffer, ipp_uchar_t *data, size_t length);
+
+
+/*
+ * 'serverArchiveJob()' - Add a completed job to the printer's job archive.
+ *
+ * The printer must be locked for writing by the caller.
+ */
+
+void
+serverArchiveJob(server_job_t *job)	/* I - Job */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+  server_arecord_t	record,		/* Archive record */
+			next;		/* Record of user's next newer job */
+  server_abuffer_t	buffer = { NULL, 0, 0 };
+					/* Encoded attributes */
+  ipp_t			*attrs;		/* Job attributes */
+  ipp_state_t		state;		/* Write state */
+  server_auser_t	*user;		/* User's archived jobs */
+  int			next_id = 0;	/* User's next newer archived job-id */
+
+
+  if (printer->archive_fd < 0)
+    return;
+
+  if (read_record(printer, job->id, &record))
+  {
+   /*
+    * Jobs recovered from the journal may already be in the archive...
+    */
+
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Job #%d is already archived.", job->id);
+    return;
+  }
+
+ /*
+  * Encode the job attributes...
+  */
+
+  attrs = ippNew();
+  serverCopyAttributes(attrs, job->attrs, NULL, NULL, IPP_TAG_JOB, 0);
+
+  while ((state = ippWriteIO(&buffer, (ipp_iocb_t)write_buffer, 1, NULL, attrs)) != IPP_STATE_DATA)
+  {
+    if (state == IPP_STATE_ERROR)
+      break;
+  }
+
+  ippDelete(attrs);
+
+  if (state != IPP_STATE_DATA)
+  {
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to encode job for archive.");
+    free(buffer.data);
+    return;
+  }
+
+ /*
+  * Append the attributes and then write the record...
+  */
+
+  memset(&record, 0, sizeof(record));
+
+  record.id            = job->id;
+  record.state         = job->state;
+  record.state_reasons = job->state_reasons;
+  record.impressions   = job->impressions;
+  record.impcompleted  = job->impcompleted;
+  record.created       = job->created;
+  record.processing    = job->processing;
+  record.completed     = job->completed;
+  record.offset        = lseek(printer->archive_data_fd, 0, SEEK_END);
+  record.length        = buffer.used;
+
+  strlcpy(record.username, job->username ? job->username : "anonymous", sizeof(record.username));
+
+ /*
+  * Link the record into the user's list of jobs, which is in descending
+  * job-id order even though jobs are not always archived in order...
+  */
+
+  if ((user = get_user(printer, record.username, 1)) != NULL)
+  {
+    record.prev_user_id = user->last_id;
+
+    while (record.prev_user_id > job->id && read_record(printer, record.prev_user_id, &next))
+    {
+      next_id             = record.prev_user_id;
+      record.prev_user_id = next.prev_user_id;
+    }
+  }
+
+  if (record.offset < 0 || write(printer->archive_data_fd, buffer.data, buffer.used) != (ssize_t)buffer.used)
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to write job to archive: %s", strerror(errno));
+  else if (pwrite(printer->archive_fd, &record, sizeof(record), (off_t)job->id * (off_t)sizeof(record)) != (ssize_t)sizeof(record))
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to write job to archive: %s", strerror(errno));
+  else
+  {
+    if (next_id > 0)
+    {
+      next.prev_user_id = job->id;
+
+      if (pwrite(printer->archive_fd, &next, sizeof(next), (off_t)next_id * (off_t)sizeof(next)) != (ssize_t)sizeof(next))
+        serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to write job to archive: %s", strerror(errno));
+    }
+    else if (user)
+      user->last_id = job->id;
+
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Archived job #%d.", job->id);
+  }
+
+  free(buffer.data);
+}
+
+
+/*
+ * 'serverCloseArchive()' - Close the printer's job archive.
+ */
+
+void
+serverCloseArchive(
+    server_printer_t *printer)		/* I - Printer */
+{
+  if (printer->archive_fd >= 0)
+  {
+    close(printer->archive_fd);
+    printer->archive_fd = -1;
+  }
+
+  if (printer->archive_data_fd >= 0)
+  {
+    close(printer->archive_data_fd);
+    printer->archive_data_fd = -1;
+  }
+
+  cupsArrayDelete(printer->archive_users);
+  printer->archive_users = NULL;
+}
+
+
+/*
+ * 'serverOpenArchive()' - Open the printer's job archive.
+ *
+ * The printer's next job-id is set to follow the newest archived job.
+ */
+
+void
+serverOpenArchive(
+    server_printer_t *printer)		/* I - Printer */
+{
+  char			filename[1024];	/* Archive filename */
+  server_arecord_t	records[SERVER_ARCHIVE_BLOCK],
+					/* Block of records */
+			*record;	/* Current record */
+  int			first,		/* First job-id in block */
+			count,		/* Records in block */
+			last_id = 0;	/* Newest archived job-id */
+  ssize_t		bytes;		/* Bytes read */
+  server_auser_t	*user;		/* User's archived jobs */
+
+
+  printer->archive_fd      = -1;
+  printer->archive_data_fd = -1;
+  printer->archive_users   = NULL;
+
+  if (!JobArchive)
+    return;
+
+  snprintf(filename, sizeof(filename), "%s/history.jobs", printer->pinfo.spool_directory);
+  if ((printer->archive_fd = open(filename, O_RDWR | O_CREAT, 0600)) < 0)
+  {
+    serverLogPrinter(SERVER_LOGLEVEL_ERROR, printer, "Unable to open job archive \"%s\": %s", filename, strerror(errno));
+    return;
+  }
+
+  snprintf(filename, sizeof(filename), "%s/history.attrs", printer->pinfo.spool_directory);
+  if ((printer->archive_data_fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0600)) < 0)
+  {
+    serverLogPrinter(SERVER_LOGLEVEL_ERROR, printer, "Unable to open job archive \"%s\": %s", filename, strerror(errno));
+    serverCloseArchive(printer);
+    return;
+  }
+
+  printer->archive_users = cupsArrayNew3((cups_array_func_t)compare_users, NULL, NULL, 0, NULL, (cups_afree_func_t)free_user);
+
+ /*
+  * Find the newest archived job for each user...
+  */
+
+  for (first = 0; (bytes = pread(printer->archive_fd, records, sizeof(records), (off_t)first * (off_t)sizeof(server_arecord_t))) > 0; first += count)
+  {
+    if ((count = (int)((size_t)bytes / sizeof(server_arecord_t))) == 0)
+      break;
+
+    for (record = records; record < (records + count); record ++)
+    {
+      if (record->id <= 0 || record->id != first + (int)(record - records))
+        continue;			/* Unused record */
+
+      last_id = record->id;
+
+      if ((user = get_user(printer, record->username, 1)) != NULL && user->last_id < record->id)
+        user->last_id = record->id;
+    }
+  }
+
+  if (last_id > 0)
+  {
+    serverLogPrinter(SERVER_LOGLEVEL_INFO, printer, "Job archive contains jobs up to #%d from %d users.", last_id, cupsArrayCount(printer->archive_users));
+
+    if (printer->next_job_id <= last_id)
+      printer->next_job_id = last_id + 1;
+  }
+}
+
+
+/*
+ * 'serverReadArchivedJob()' - Read the next matching job from the archive.
+ *
+ * Jobs are returned in descending job-id order starting below "before".  The
+ * "state" and "comparison" values filter jobs like "which-jobs" in Get-Jobs:
+ * a negative comparison matches jobs at or before the state, zero matches the
+ * state, and a positive comparison matches jobs at or after the state.
+ * "scan" is the number of non-matching records that can still be skipped;
+ * start each request with SERVER_ARCHIVE_SCAN.
+ *
+ * On success the job's attributes are loaded into "job" and must be freed by
+ * the caller with ippDelete().  The printer must be locked by the caller.
+ */
+
+int					/* O - job-id or 0 if none */
+serverReadArchivedJob(
+    server_printer_t *printer,		/* I  - Printer */
+    int              before,		/* I  - Return a job-id less than this */
+    int              first_job_id,	/* I  - Lowest job-id to return */
+    ipp_jstate_t     state,		/* I  - Job state to match */
+    int              comparison,	/* I  - State comparison */
+    const char       *username,		/* I  - User name to match or `NULL` */
+    int              *scan,		/* IO - Records left to skip */
+    server_job_t     *job)		/* O  - Job */
+{
+  server_arecord_t	records[SERVER_ARCHIVE_BLOCK],
+					/* Block of records */
+			*record;	/* Current record */
+  struct stat		fileinfo;	/* Archive file information */
+  int			first,		/* First job-id in block */
+			count,		/* Records in block */
+			id;		/* Current job-id */
+  ssize_t		bytes;		/* Bytes read */
+  server_auser_t	*user;		/* User's archived jobs */
+
+
+  if (printer->archive_fd < 0 || fstat(printer->archive_fd, &fileinfo))
+    return (0);
+
+  if (first_job_id < 1)
+    first_job_id = 1;
+
+  if (username)
+  {
+   /*
+    * Follow the user's list of jobs...
+    */
+
+    if ((user = get_user(printer, username, 0)) == NULL)
+      return (0);
+
+    for (id = user->last_id; id >= first_job_id && *scan > 0 && read_record(printer, id, records); id = records->prev_user_id)
+    {
+      if (id >= before)
+        continue;
+
+      if (match_record(records, state, comparison))
+        return (load_job(printer, records, job));
+
+      (*scan) --;
+    }
+
+    return (0);
+  }
+
+  if ((off_t)before * (off_t)sizeof(server_arecord_t) > fileinfo.st_size)
+    before = (int)(fileinfo.st_size / (off_t)sizeof(server_arecord_t));
+
+  while (before > first_job_id && *scan > 0)
+  {
+   /*
+    * Read the block of records below "before"...
+    */
+
+    if ((first = before - SERVER_ARCHIVE_BLOCK) < first_job_id)
+      first = first_job_id;
+
+    if ((bytes = pread(printer->archive_fd, records, (size_t)(before - first) * sizeof(server_arecord_t), (off_t)first * (off_t)sizeof(server_arecord_t))) < 0)
+    {
+      serverLogPrinter(SERVER_LOGLEVEL_ERROR, printer, "Unable to read job archive: %s", strerror(errno));
+      return (0);
+    }
+
+    count = (int)((size_t)bytes / sizeof(server_arecord_t));
+
+    for (record = records + count - 1; record >= records && *scan > 0; record --)
+    {
+      if (record->id != first + (int)(record - records))
+        continue;			/* Unused record */
+
+      if (match_record(record, state, comparison))
+        return (load_job(printer, record, job));
+
+      (*scan) --;
+    }
+
+    before = first;
+  }
+
+  if (*scan <= 0)
+    serverLogPrinter(SERVER_LOGLEVEL_DEBUG, printer, "Stopped reading job archive after %d non-matching jobs.", SERVER_ARCHIVE_SCAN);
+
+  return (0);
+}
+
+
+/*
+ * 'compare_users()' - Compare the user names of two archive users.
+ */
+
+static int				/* O - Result of comparison */
+compare_users(server_auser_t *a,	/* I - First user */
+              server_auser_t *b)	/* I - Second user */
+{
+  return (strcasecmp(a->name, b->name));
+}
+
+
+/*
+ * 'free_user()' - Free an archive user.
+ */
+
+static void
+free_user(server_auser_t *user)		/* I - User */
+{
+  free(user->name);
+  free(user);
+}
+
+
+/*
+ * 'get_user()' - Find or create the archived jobs for a user.
+ */
+
+static server_auser_t *			/* O - User or `NULL` */
+get_user(server_printer_t *printer,	/* I - Printer */
+         const char       *username,	/* I - User name */
+         int              create)	/* I - Create the user if needed? */
+{
+  server_auser_t	key,		/* Search key */
+			*user;		/* User */
+
+
+  key.name = (char *)username;
+
+  if ((user = (server_auser_t *)cupsArrayFind(printer->archive_users, &key)) == NULL && create && (user = calloc(1, sizeof(server_auser_t))) != NULL)
+  {
+    if ((user->name = strdup(username)) == NULL)
+    {
+      free(user);
+      return (NULL);
+    }
+
+    cupsArrayAdd(printer->archive_users, user);
+  }
+
+  return (user);
+}
+
+
+/*
+ * 'load_job()' - Load an archived job's attributes.
+ */
+
+static int				/* O - job-id */
+load_job(server_printer_t *printer,	/* I - Printer */
+         server_arecord_t *record,	/* I - Archive record */
+         server_job_t     *job)		/* O - Job */
+{
+  server_abuffer_t	buffer;		/* Encoded attributes */
+  ipp_state_t		ipp_state;	/* Read state */
+  ipp_attribute_t	*attr;		/* time-at-creation attribute */
+
+
+  memset(job, 0, sizeof(server_job_t));
+
+  job->id            = record->id;
+  job->printer       = printer;
+  job->state         = record->state;
+  job->state_reasons = record->state_reasons;
+  job->impressions   = record->impressions;
+  job->impcompleted  = record->impcompleted;
+  job->created       = record->created;
+  job->processing    = record->processing;
+  job->completed     = record->completed;
+  job->fd            = -1;
+  job->queue_index   = -1;
+  job->attrs         = ippNew();
+
+  buffer.used  = 0;
+  buffer.alloc = record->length;
+
+  if ((buffer.data = malloc(record->length)) != NULL && pread(printer->archive_data_fd, buffer.data, record->length, record->offset) == (ssize_t)record->length)
+  {
+    while ((ipp_state = ippReadIO(&buffer, (ipp_iocb_t)read_buffer, 1, NULL, job->attrs)) != IPP_STATE_DATA)
+    {
+      if (ipp_state == IPP_STATE_ERROR)
+      {
+	serverLogPrinter(SERVER_LOGLEVEL_ERROR, printer, "Unable to load job #%d from archive.", job->id);
+	break;
+      }
+    }
+  }
+  else
+    serverLogPrinter(SERVER_LOGLEVEL_ERROR, printer, "Unable to load job #%d from archive.", job->id);
+
+  free(buffer.data);
+
+  if ((attr = ippFindAttribute(job->attrs, "time-at-creation", IPP_TAG_INTEGER)) != NULL)
+    ippSetInteger(job->attrs, &attr, 0, serverGetJobTime(job, job->created));
+
+  job->username = ippGetString(ippFindAttribute(job->attrs, "job-originating-user-name", IPP_TAG_NAME), 0, NULL);
+  job->name     = ippGetString(ippFindAttribute(job->attrs, "job-name", IPP_TAG_NAME), 0, NULL);
+  job->format   = ippGetString(ippFindAttribute(job->attrs, "document-format", IPP_TAG_MIMETYPE), 0, NULL);
+
+  return (job->id);
+}
+
+
+/*
+ * 'match_record()' - See if an archive record matches a job state filter.
+ */
+
+static int				/* O - 1 if matching, 0 otherwise */
+match_record(server_arecord_t *record,	/* I - Archive record */
+             ipp_jstate_t     state,	/* I - Job state to match */
+             int              comparison)/* I - State comparison */
+{
+  return ((comparison < 0 && record->state <= state) ||
+          (comparison == 0 && record->state == state) ||
+          (comparison > 0 && record->state >= state));
+}
+
+
+/*
+ * 'read_buffer()' - Read data from an attribute buffer.
+ */
+
+static ssize_t				/* O - Number of bytes read */
+read_buffer(server_abuffer_t *buffer,	/* I - Buffer */
+            ipp_uchar_t      *data,	/* I - Data */
+            size_t           length)	/* I - Number of bytes */
+{
+  if (length > (buffer->alloc - buffer->used))
+    length = buffer->alloc - buffer->used;
+
+  memcpy(data, buffer->data + buffer->used, length);
+  buffer->used += length;
+
+  return ((ssize_t)length);
+}
+
+
+/*
+ * 'read_record()' - Read the archive record for a job.
+ */
+
+static int				/* O - 1 if the job is archived, 0 otherwise */
+read_record(server_printer_t *printer,	/* I - Printer */
+            int              id,	/* I - job-id */
+            server_arecord_t *record)	/* O - Archive record */
+{
+  return (pread(printer->archive_fd, record, sizeof(server_arecord_t), (off_t)id * (off_t)sizeof(server_arecord_t)) == (ssize_t)sizeof(server_arecord_t) && record->id == id);
+}
+
+
+/*
+ * 'write_buffer()' - Append data to an attribute buffer.
+ */
+
+static ssize_t				/* O - Number of bytes written or -1 on error */
+write_buffer(server_abuffer_t *buffer,	/* I - Buffer */
+             ipp_uchar_t      *data,	/* I - Data */
+             size_t           length)	/* I - Number of bytes */
+{
+  if (buffer->used + length > buffer->alloc)
+  {
+    ipp_uchar_t	*temp;			/* New buffer */
+    size_t	alloc;			/* New allocation */
+
+    for (alloc = buffer->alloc ? buffer->alloc : 4096; alloc < (buffer->used + length); alloc *= 2);
+
+    if ((temp = realloc(buffer->data, alloc)) == NULL)
+      return (-1);
+
+    buffer->data  = temp;
+    buffer->alloc = alloc;
+  }
+
+  memcpy(buffer->data + buffer->used, data, length);
+  buffer->used += length;
+
+  return ((ssize_t)length);
+}
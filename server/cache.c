@@ -0,0 +1,726 @@
+/*
+ * Transform cache support for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#include "ippserver.h"
+#include <cups/dir.h>
+#ifndef WIN32
+#  include <sys/mman.h>
+#endif /* !WIN32 */
+
+
+/*
+ * When a proxy fetches a document in a format other than the spooled one, the
+ * document is transformed for every Fetch-Document request.  So that proxy
+ * retries and jobs that print the same document don't repeat the work, the
+ * output of successful transforms is kept in the "cache" subdirectory of the
+ * spool directory.  Files are named by a SHA-256 digest of the document data,
+ * the command, the source and destination formats, and the job and printer
+ * attributes that affect the output.  The job status attributes reported by
+ * the command ("ATTR: job-..." messages) are kept in a "key.attrs" file next
+ * to the output so they can be reported again.  The digest of the document
+ * is computed once per job.
+ *
+ * The cache index is an array sorted by key plus a list of the same entries
+ * in least-recently used order.  Output is written to a temporary file and
+ * renamed into place when the transform succeeds, and the least-recently used
+ * files are removed when the cache grows beyond "TransformCacheSize".  A
+ * client that is still sending a removed file keeps reading its open copy.
+ */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct server_centry_s		/**** Transform cache entry ****/
+{
+  char			key[65];	/* SHA-256 digest as hex string */
+  off_t			size;		/* Size of output */
+  time_t		mtime;		/* Modification time (when loading) */
+  struct server_centry_s *prev,		/* Previous (more recently used) entry */
+			*next;		/* Next (less recently used) entry */
+} server_centry_t;
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const cache_job_attrs[] =
+{					/* Job attributes in key */
+  "copies",
+  "finishings",
+  "finishings-col",
+  "materials-col",
+  "media",
+  "media-col",
+  "multiple-document-handling",
+  "orientation-requested",
+  "output-bin",
+  "page-ranges",
+  "platform-temperatures",
+  "print-accuracy",
+  "print-base",
+  "print-color-mode",
+  "print-content-optimize",
+  "print-quality",
+  "print-rendering-intent",
+  "print-scaling",
+  "print-supports",
+  "printer-resolution",
+  "sides"
+};
+static const char * const cache_printer_attrs[] =
+{					/* Printer attributes in key */
+  "materials-col-default",
+  "media-default",
+  "platform-temperature-default",
+  "print-base-default",
+  "print-quality-default",
+  "print-scaling-default",
+  "print-supports-default",
+  "pwg-raster-document-resolution-supported",
+  "pwg-raster-document-sheet-back",
+  "pwg-raster-document-type-supported",
+  "sides-default"
+};
+static char		cache_directory[1024] = "";
+					/* Cache directory */
+static cups_array_t	*cache_entries = NULL;
+					/* Entries sorted by key */
+static server_centry_t	*cache_first = NULL,
+					/* Most recently used entry */
+			*cache_last = NULL;
+					/* Least recently used entry */
+static _cups_mutex_t	cache_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for cache */
+static off_t		cache_size = 0;	/* Total size of entries */
+static int		cache_temp = 0;	/* Temporary file counter */
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_entries(server_centry_t *a, server_centry_t *b);
+static int	compare_mtimes(server_centry_t **a, server_centry_t **b);
+static void	delete_entry(server_centry_t *entry);
+static int	get_digest(const char *filename, char *digest, size_t digestsize);
+static void	link_entry(server_centry_t *entry);
+static void	trim_cache(void);
+static void	unlink_entry(server_centry_t *entry);
+static void	update_stats(int hit);
+static int	write_attrs(const char *key, const char *attrs);
+
+
+/*
+ * 'serverAddCachedTransform()' - Add transform output to the cache.
+ *
+ * The temporary file from serverCreateCachedTransform() is renamed into the
+ * cache and the least-recently used files are removed as needed.
+ */
+
+void
+serverAddCachedTransform(
+    const char *key,			/* I - Cache key */
+    const char *tempfile,		/* I - Temporary file with output */
+    const char *attrs)			/* I - "ATTR:" messages from command */
+{
+  server_centry_t	*entry,		/* Cache entry */
+			ekey;		/* Search key */
+  struct stat		fileinfo;	/* Output file information */
+  char			filename[1024];	/* Cache filename */
+
+
+  if (stat(tempfile, &fileinfo) || fileinfo.st_size == 0 || fileinfo.st_size > TransformCacheSize)
+  {
+   /*
+    * Don't cache empty output or output that would flush the whole cache...
+    */
+
+    unlink(tempfile);
+    return;
+  }
+
+  snprintf(filename, sizeof(filename), "%s/%s", cache_directory, key);
+
+  _cupsMutexLock(&cache_mutex);
+
+  if (!write_attrs(key, attrs))
+  {
+    unlink(tempfile);
+  }
+  else if (rename(tempfile, filename))
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to add \"%s\" to transform cache: %s", filename, strerror(errno));
+    unlink(tempfile);
+  }
+  else
+  {
+    strlcpy(ekey.key, key, sizeof(ekey.key));
+
+    if ((entry = (server_centry_t *)cupsArrayFind(cache_entries, &ekey)) != NULL)
+    {
+     /*
+      * Another request cached the same output first, replace it...
+      */
+
+      unlink_entry(entry);
+      cache_size -= entry->size;
+    }
+    else if ((entry = calloc(1, sizeof(server_centry_t))) != NULL)
+    {
+      strlcpy(entry->key, key, sizeof(entry->key));
+      cupsArrayAdd(cache_entries, entry);
+    }
+    else
+    {
+      unlink(filename);
+      write_attrs(key, NULL);
+    }
+
+    if (entry)
+    {
+      entry->size = fileinfo.st_size;
+      cache_size  += entry->size;
+
+      link_entry(entry);
+      trim_cache();
+    }
+  }
+
+  _cupsMutexUnlock(&cache_mutex);
+}
+
+
+/*
+ * 'serverCreateCachedTransform()' - Create a temporary file for transform
+ *                                   output.
+ */
+
+int					/* O - File descriptor or -1 on error */
+serverCreateCachedTransform(
+    const char *key,			/* I - Cache key */
+    char       *tempfile,		/* I - Temporary filename buffer */
+    size_t     tempsize)		/* I - Size of filename buffer */
+{
+  int	fd;				/* File descriptor */
+
+
+  _cupsMutexLock(&cache_mutex);
+  cache_temp ++;
+  snprintf(tempfile, tempsize, "%s/%s.%d.tmp", cache_directory, key, cache_temp);
+  _cupsMutexUnlock(&cache_mutex);
+
+  if ((fd = open(tempfile, O_WRONLY | O_CREAT | O_TRUNC | O_EXCL, 0600)) < 0)
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create transform cache file \"%s\": %s", tempfile, strerror(errno));
+  else
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  return (fd);
+}
+
+
+/*
+ * 'serverFindCachedTransform()' - Find cached output for a job.
+ *
+ * On a cache hit the cached output is opened for reading and "attrs" is set
+ * to the "ATTR:" messages the command reported, one per line.  Otherwise -1 is
+ * returned and "key" is set to the cache key for serverCreateCachedTransform()
+ * or to the empty string if the output cannot be cached.
+ */
+
+int					/* O - File descriptor or -1 on miss */
+serverFindCachedTransform(
+    server_job_t *job,			/* I - Job */
+    const char   *command,		/* I - Command */
+    const char   *format,		/* I - Destination MIME media type */
+    char         *key,			/* O - Cache key */
+    size_t       keysize,		/* I - Size of key buffer */
+    char         *attrs,		/* O - "ATTR:" messages from command */
+    size_t       attrsize)		/* I - Size of messages buffer */
+{
+  size_t		i,		/* Looping var */
+			length;		/* Length of value */
+  char			data[16384],	/* Key data */
+			*dataptr,	/* Pointer into key data */
+			*dataend;	/* End of key data */
+  ipp_attribute_t	*attr;		/* Current attribute */
+  unsigned char		hash[64];	/* SHA-256 hash */
+  ssize_t		hashsize;	/* Size of hash */
+  server_centry_t	*entry,		/* Cache entry */
+			ekey;		/* Search key */
+  char			filename[1024];	/* Cache filename */
+  int			fd = -1,	/* Cached output */
+			attrfd;		/* Cached "ATTR:" messages */
+  ssize_t		bytes;		/* Bytes read */
+
+
+  *key   = '\0';
+  *attrs = '\0';
+
+  if (TransformCacheSize <= 0 || !cache_entries || !job->filename || keysize < sizeof(ekey.key))
+    return (-1);
+
+ /*
+  * Build the key from the document digest, the command, the formats, and
+  * the attributes that affect the output.  The print file doesn't change
+  * once the job is fetchable, so the digest is only computed once...
+  */
+
+  _cupsRWLockWrite(&job->rwlock);
+
+  if (!job->digest[0] && !get_digest(job->filename, job->digest, sizeof(job->digest)))
+    job->digest[0] = '\0';
+
+  strlcpy(data, job->digest, sizeof(data));
+
+  _cupsRWUnlock(&job->rwlock);
+
+  if (!data[0])
+    return (-1);
+
+  dataptr = data + strlen(data);
+  dataend = data + sizeof(data);
+
+  snprintf(dataptr, (size_t)(dataend - dataptr), "\n%s\n%s\n%s\n", command, job->format, format ? format : "");
+  dataptr += strlen(dataptr);
+
+  _cupsRWLockRead(&job->rwlock);
+
+  for (i = 0; i < (sizeof(cache_job_attrs) / sizeof(cache_job_attrs[0])) && dataptr < dataend; i ++)
+  {
+    if ((attr = ippFindAttribute(job->attrs, cache_job_attrs[i], IPP_TAG_ZERO)) != NULL)
+    {
+      snprintf(dataptr, (size_t)(dataend - dataptr), "%s=", cache_job_attrs[i]);
+      dataptr += strlen(dataptr);
+      length  = ippAttributeString(attr, dataptr, (size_t)(dataend - dataptr));
+      dataptr = length < (size_t)(dataend - dataptr - 1) ? dataptr + length : dataend;
+
+      if (dataptr < dataend)
+        *dataptr++ = '\n';
+    }
+  }
+
+  _cupsRWUnlock(&job->rwlock);
+
+  _cupsRWLockRead(&job->printer->rwlock);
+
+  for (i = 0; i < (sizeof(cache_printer_attrs) / sizeof(cache_printer_attrs[0])) && dataptr < dataend; i ++)
+  {
+    if ((attr = ippFindAttribute(job->printer->pinfo.attrs, cache_printer_attrs[i], IPP_TAG_ZERO)) != NULL)
+    {
+      snprintf(dataptr, (size_t)(dataend - dataptr), "%s=", cache_printer_attrs[i]);
+      dataptr += strlen(dataptr);
+      length  = ippAttributeString(attr, dataptr, (size_t)(dataend - dataptr));
+      dataptr = length < (size_t)(dataend - dataptr - 1) ? dataptr + length : dataend;
+
+      if (dataptr < dataend)
+        *dataptr++ = '\n';
+    }
+  }
+
+  _cupsRWUnlock(&job->printer->rwlock);
+
+  if (dataptr >= dataend)
+  {
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Not caching transform output, too many attributes.");
+    return (-1);
+  }
+
+  if ((hashsize = cupsHashData("sha2-256", data, (size_t)(dataptr - data), hash, sizeof(hash))) < 0)
+    return (-1);
+
+  cupsHashString(hash, (size_t)hashsize, key, keysize);
+
+ /*
+  * Look up the key...
+  */
+
+  strlcpy(ekey.key, key, sizeof(ekey.key));
+
+  _cupsMutexLock(&cache_mutex);
+
+  if ((entry = (server_centry_t *)cupsArrayFind(cache_entries, &ekey)) != NULL)
+  {
+    snprintf(filename, sizeof(filename), "%s/%s", cache_directory, key);
+
+    if ((fd = open(filename, O_RDONLY)) >= 0)
+    {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+      unlink_entry(entry);
+      link_entry(entry);
+
+      snprintf(filename, sizeof(filename), "%s/%s.attrs", cache_directory, key);
+
+      if ((attrfd = open(filename, O_RDONLY)) >= 0)
+      {
+        if ((bytes = read(attrfd, attrs, attrsize - 1)) > 0)
+          attrs[bytes] = '\0';
+
+        close(attrfd);
+      }
+    }
+    else
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to open transform cache file \"%s\": %s", filename, strerror(errno));
+      delete_entry(entry);
+    }
+  }
+
+  update_stats(fd >= 0);
+
+  _cupsMutexUnlock(&cache_mutex);
+
+  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Transform cache %s for key %s.", fd >= 0 ? "hit" : "miss", key);
+
+  return (fd);
+}
+
+
+/*
+ * 'serverOpenTransformCache()' - Open the transform cache.
+ *
+ * Output cached by a previous run is kept, oldest first for eviction, and
+ * any incomplete temporary files are removed.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+serverOpenTransformCache(void)
+{
+  cups_dir_t		*dir;		/* Cache directory */
+  cups_dentry_t		*dent;		/* Directory entry */
+  char			filename[1024];	/* Cache filename */
+  server_centry_t	*entry,		/* Cache entry */
+			**entries = NULL;
+					/* Entries to sort by time */
+  int			i,		/* Looping var */
+			num_entries = 0,/* Number of entries */
+			alloc_entries = 0;
+					/* Allocated entries */
+
+
+  if (TransformCacheSize <= 0)
+    return (1);
+
+  snprintf(cache_directory, sizeof(cache_directory), "%s/cache", SpoolDirectory);
+
+  if (mkdir(cache_directory, 0700) && errno != EEXIST)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create transform cache directory \"%s\": %s", cache_directory, strerror(errno));
+    return (0);
+  }
+
+  cache_entries = cupsArrayNew((cups_array_func_t)compare_entries, NULL);
+
+  if ((dir = cupsDirOpen(cache_directory)) == NULL)
+    return (1);
+
+  while ((dent = cupsDirRead(dir)) != NULL)
+  {
+    if (strlen(dent->filename) == 70 && strspn(dent->filename, "0123456789abcdef") == 64 && !strcmp(dent->filename + 64, ".attrs"))
+    {
+     /*
+      * Keep the "ATTR:" messages for output that is still cached...
+      */
+
+      snprintf(filename, sizeof(filename), "%s/%.64s", cache_directory, dent->filename);
+
+      if (access(filename, 0))
+      {
+        snprintf(filename, sizeof(filename), "%s/%s", cache_directory, dent->filename);
+        unlink(filename);
+      }
+      continue;
+    }
+    else if (strlen(dent->filename) != 64 || strspn(dent->filename, "0123456789abcdef") != 64)
+    {
+      snprintf(filename, sizeof(filename), "%s/%s", cache_directory, dent->filename);
+      unlink(filename);
+      continue;
+    }
+
+    if (num_entries >= alloc_entries)
+    {
+      server_centry_t	**temp;		/* New entries */
+
+      if ((temp = realloc(entries, (size_t)(alloc_entries + 256) * sizeof(server_centry_t *))) == NULL)
+        break;
+
+      entries       = temp;
+      alloc_entries += 256;
+    }
+
+    if ((entry = calloc(1, sizeof(server_centry_t))) == NULL)
+      break;
+
+    strlcpy(entry->key, dent->filename, sizeof(entry->key));
+    entry->size  = dent->fileinfo.st_size;
+    entry->mtime = dent->fileinfo.st_mtime;
+
+    entries[num_entries ++] = entry;
+  }
+
+  cupsDirClose(dir);
+
+ /*
+  * Add the entries from newest to oldest and then trim the cache to size...
+  */
+
+  if (num_entries > 1)
+    qsort(entries, (size_t)num_entries, sizeof(server_centry_t *), (int (*)(const void *, const void *))compare_mtimes);
+
+  for (i = num_entries - 1; i >= 0; i --)
+  {
+    cupsArrayAdd(cache_entries, entries[i]);
+    link_entry(entries[i]);
+    cache_size += entries[i]->size;
+  }
+
+  free(entries);
+
+  trim_cache();
+
+  serverLog(SERVER_LOGLEVEL_INFO, "Using transform cache \"%s\" with %d files (%ld bytes).", cache_directory, cupsArrayCount(cache_entries), (long)cache_size);
+
+  return (1);
+}
+
+
+/*
+ * 'compare_entries()' - Compare two cache entries.
+ */
+
+static int				/* O - Result of comparison */
+compare_entries(server_centry_t *a,	/* I - First entry */
+                server_centry_t *b)	/* I - Second entry */
+{
+  return (strcmp(a->key, b->key));
+}
+
+
+/*
+ * 'compare_mtimes()' - Compare the modification times of two cache entries.
+ */
+
+static int				/* O - Result of comparison */
+compare_mtimes(server_centry_t **a,	/* I - First entry */
+               server_centry_t **b)	/* I - Second entry */
+{
+  if ((*a)->mtime < (*b)->mtime)
+    return (-1);
+  else if ((*a)->mtime > (*b)->mtime)
+    return (1);
+  else
+    return (0);
+}
+
+
+/*
+ * 'delete_entry()' - Remove an entry and its file from the cache.
+ *
+ * The cache must be locked by the caller.
+ */
+
+static void
+delete_entry(server_centry_t *entry)	/* I - Cache entry */
+{
+  char	filename[1024];			/* Cache filename */
+
+
+  snprintf(filename, sizeof(filename), "%s/%s", cache_directory, entry->key);
+  unlink(filename);
+  write_attrs(entry->key, NULL);
+
+  unlink_entry(entry);
+  cupsArrayRemove(cache_entries, entry);
+
+  cache_size -= entry->size;
+
+  free(entry);
+}
+
+
+/*
+ * 'get_digest()' - Get the SHA-256 digest of a file as a hex string.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+get_digest(const char *filename,	/* I - File to hash */
+           char       *digest,		/* I - Digest buffer */
+           size_t     digestsize)	/* I - Size of digest buffer */
+{
+#ifdef WIN32
+  (void)filename;
+  (void)digest;
+  (void)digestsize;
+
+  return (0);
+
+#else
+  int		fd;			/* File descriptor */
+  struct stat	fileinfo;		/* File information */
+  void		*data;			/* Mapped file data */
+  unsigned char	hash[64];		/* SHA-256 hash */
+  ssize_t	hashsize;		/* Size of hash */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+  if (fstat(fd, &fileinfo) || fileinfo.st_size == 0 || (data = mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    return (0);
+  }
+
+  close(fd);
+
+  hashsize = cupsHashData("sha2-256", data, (size_t)fileinfo.st_size, hash, sizeof(hash));
+
+  munmap(data, (size_t)fileinfo.st_size);
+
+  if (hashsize < 0)
+    return (0);
+
+  cupsHashString(hash, (size_t)hashsize, digest, digestsize);
+
+  return (1);
+#endif /* WIN32 */
+}
+
+
+/*
+ * 'link_entry()' - Make an entry the most recently used.
+ *
+ * The cache must be locked by the caller.
+ */
+
+static void
+link_entry(server_centry_t *entry)	/* I - Cache entry */
+{
+  entry->prev = NULL;
+  entry->next = cache_first;
+
+  if (cache_first)
+    cache_first->prev = entry;
+  else
+    cache_last = entry;
+
+  cache_first = entry;
+}
+
+
+/*
+ * 'trim_cache()' - Remove the least-recently used entries until the cache
+ *                  fits in "TransformCacheSize".
+ *
+ * The cache must be locked by the caller.
+ */
+
+static void
+trim_cache(void)
+{
+  while (cache_last && cache_size > TransformCacheSize)
+  {
+    serverLog(SERVER_LOGLEVEL_DEBUG, "Removing %s (%ld bytes) from transform cache.", cache_last->key, (long)cache_last->size);
+
+    delete_entry(cache_last);
+  }
+
+  update_stats(-1);
+}
+
+
+/*
+ * 'unlink_entry()' - Remove an entry from the least-recently used list.
+ *
+ * The cache must be locked by the caller.
+ */
+
+static void
+unlink_entry(server_centry_t *entry)	/* I - Cache entry */
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache_first = entry->next;
+
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache_last = entry->prev;
+
+  entry->prev = entry->next = NULL;
+}
+
+
+/*
+ * 'update_stats()' - Update the transform cache statistics.
+ *
+ * The cache must be locked by the caller.
+ */
+
+static void
+update_stats(int hit)			/* I - 1 for hit, 0 for miss, -1 for size only */
+{
+  _cupsMutexLock(&StatsMutex);
+
+  if (hit > 0)
+    Stats.cache_hits ++;
+  else if (hit == 0)
+    Stats.cache_misses ++;
+
+  Stats.cache_size = cache_size;
+
+  _cupsMutexUnlock(&StatsMutex);
+}
+
+
+/*
+ * 'write_attrs()' - Save or remove the "ATTR:" messages for a cache entry.
+ *
+ * The cache must be locked by the caller.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+write_attrs(const char *key,		/* I - Cache key */
+            const char *attrs)		/* I - "ATTR:" messages or NULL to remove */
+{
+  char		filename[1024];		/* Attributes filename */
+  int		fd;			/* Attributes file */
+  size_t	length;			/* Length of messages */
+
+
+  snprintf(filename, sizeof(filename), "%s/%s.attrs", cache_directory, key);
+
+  if (!attrs || !*attrs)
+  {
+    unlink(filename);
+    return (1);
+  }
+
+  length = strlen(attrs);
+
+  if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 || write(fd, attrs, length) != (ssize_t)length)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to write transform cache file \"%s\": %s", filename, strerror(errno));
+
+    if (fd >= 0)
+      close(fd);
+
+    unlink(filename);
+    return (0);
+  }
+
+  close(fd);
+
+  return (1);
+}
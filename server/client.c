@@ -9,6 +9,7 @@
  */
 
 #include "ippserver.h"
+#include <cups/cups-private.h>
 #include "printer-png.h"
 #include "printer3d-png.h"
 
@@ -17,16 +18,25 @@
  * Local functions...
  */
 
+static void		cork_client(server_client_t *client, int on);
+#ifdef HAVE_SSL
+static void		count_handshake(server_client_t *client);
+#endif /* HAVE_SSL */
+static int		create_listener(http_addr_t *addr);
 static void		html_escape(server_client_t *client, const char *s,
 			            size_t slen);
 static void		html_footer(server_client_t *client);
 static void		html_header(server_client_t *client, const char *title);
 static void		html_printf(server_client_t *client, const char *format, ...) __attribute__((__format__(__printf__, 2, 3)));
 static int		parse_options(server_client_t *client, cups_option_t **options);
+static void		*run_acceptor(cups_array_t *listeners);
+static int		send_file(server_client_t *client, int fd);
 static int		show_materials(server_client_t *client, server_printer_t *printer, const char *encoding);
 static int		show_media(server_client_t *client, server_printer_t *printer, const char *encoding);
+static int		show_stats(server_client_t *client);
 static int		show_status(server_client_t *client, server_printer_t *printer, const char *encoding);
 static int		show_supplies(server_client_t *client, server_printer_t *printer, const char *encoding);
+static int		wait_clients(int accepting);
 
 
 /*
@@ -47,8 +57,12 @@ serverCreateClient(int sock)		/* I - Listen socket */
     return (NULL);
   }
 
+  _cupsMutexLock(&StatsMutex);
   client->number     = next_client_number ++;
+  _cupsMutexUnlock(&StatsMutex);
+
   client->fetch_file = -1;
+  client->activity   = time(NULL);
 
  /*
   * Accept the client and get the remote address...
@@ -67,6 +81,11 @@ serverCreateClient(int sock)		/* I - Listen socket */
 
   serverLogClient(SERVER_LOGLEVEL_INFO, client, "Accepted connection from \"%s\".", client->hostname);
 
+  _cupsMutexLock(&StatsMutex);
+  Stats.clients ++;
+  Stats.accepted ++;
+  _cupsMutexUnlock(&StatsMutex);
+
   return (client);
 }
 
@@ -79,7 +98,8 @@ int					/* O - 1 on success, 0 on error */
 serverCreateListeners(const char *host,	/* I - Hostname, IP address, or NULL for any address */
                       int        port)	/* I - Port number */
 {
-  int			sock;		/* Listener socket */
+  int			sock,		/* Listener socket */
+			acceptor;	/* Acceptor thread number */
   http_addrlist_t	*addrlist,	/* Listen address(es) */
 			*addr;		/* Current address */
   char			service[32],	/* Service port */
@@ -105,23 +125,50 @@ serverCreateListeners(const char *host,	/* I - Hostname, IP address, or NULL for
 
   for (addr = addrlist; addr; addr = addr->next)
   {
-    if ((sock = httpAddrListen(&(addr->addr), port)) < 0)
+   /*
+    * Create one socket per acceptor thread - with more than one acceptor the
+    * sockets share the address using SO_REUSEPORT and the kernel spreads new
+    * connections across them...
+    */
+
+    for (acceptor = 0; acceptor < AcceptThreads; acceptor ++)
     {
-      char temp[256];			/* Numeric address */
+#ifdef AF_LOCAL
+     /*
+      * Domain sockets can't share their path, so only the first acceptor gets
+      * one...
+      */
 
-      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to listen on address \"%s\": %s", httpAddrString(&(addr->addr), temp, sizeof(temp)), cupsLastErrorString());
-      continue;
-    }
+      if (acceptor > 0 && addr->addr.addr.sa_family == AF_LOCAL)
+        break;
+#endif /* AF_LOCAL */
+
+      if (AcceptThreads > 1)
+        sock = create_listener(&(addr->addr));
+      else
+        sock = httpAddrListen(&(addr->addr), port);
+
+      if (sock < 0)
+      {
+	char temp[256];			/* Numeric address */
+
+	serverLog(SERVER_LOGLEVEL_ERROR, "Unable to listen on address \"%s\": %s", httpAddrString(&(addr->addr), temp, sizeof(temp)), cupsLastErrorString());
+
+	httpAddrFreeList(addrlist);
+	return (0);
+      }
 
-    lis = calloc(1, sizeof(server_listener_t));
-    lis->fd = sock;
-    strlcpy(lis->host, host, sizeof(lis->host));
-    lis->port = port;
+      lis = calloc(1, sizeof(server_listener_t));
+      lis->fd = sock;
+      strlcpy(lis->host, host, sizeof(lis->host));
+      lis->port     = port;
+      lis->acceptor = acceptor;
 
-    if (!Listeners)
-      Listeners = cupsArrayNew(NULL, NULL);
+      if (!Listeners)
+	Listeners = cupsArrayNew(NULL, NULL);
 
-    cupsArrayAdd(Listeners, lis);
+      cupsArrayAdd(Listeners, lis);
+    }
   }
 
   httpAddrFreeList(addrlist);
@@ -155,6 +202,15 @@ serverDeleteClient(server_client_t *client)	/* I - Client */
   ippDelete(client->response);
 
   free(client);
+
+ /*
+  * Let the main loop know it can accept another client...
+  */
+
+  _cupsMutexLock(&StatsMutex);
+  Stats.clients --;
+  _cupsCondBroadcast(&StatsCondition);
+  _cupsMutexUnlock(&StatsMutex);
 }
 
 
@@ -170,50 +226,93 @@ serverProcessClient(
   * Loop until we are out of requests or timeout (30 seconds)...
   */
 
-#ifdef HAVE_SSL
-  int first_time = 1;			/* First time request? */
-#endif /* HAVE_SSL */
-
-  while (httpWait(client->http, 30000))
+  while (httpWait(client->http, SERVER_CLIENT_TIMEOUT * 1000))
   {
-#ifdef HAVE_SSL
-    if (first_time && Encryption != HTTP_ENCRYPTION_NEVER)
-    {
-     /*
-      * See if we need to negotiate a TLS connection...
-      */
+    if (!serverProcessClientInput(client))
+      break;
+  }
 
-      char buf[1];			/* First byte from client */
+ /*
+  * Close the conection to the client and return...
+  */
 
-      if (Encryption == HTTP_ENCRYPTION_ALWAYS ||
-          (recv(httpGetFd(client->http), buf, 1, MSG_PEEK) == 1 && (!buf[0] || !strchr("DGHOPT", buf[0]))))
-      {
-        serverLogClient(SERVER_LOGLEVEL_INFO, client, "Starting HTTPS session.");
+  serverDeleteClient(client);
 
-	if (httpEncryption(client->http, HTTP_ENCRYPTION_ALWAYS))
-	{
-	  serverLogClient(SERVER_LOGLEVEL_ERROR, client, "Unable to encrypt connection: %s", cupsLastErrorString());
-	  break;
-        }
+  return (NULL);
+}
+
+
+/*
+ * 'serverProcessClientInput()' - Process pending input from a client.
+ *
+ * This function is called when data is available on the client connection
+ * and processes requests until no more buffered input remains.
+ */
+
+int					/* O - 1 to keep connection, 0 to close */
+serverProcessClientInput(
+    server_client_t *client)		/* I - Client */
+{
+  int	pipelined = 0;			/* Number of pipelined requests */
+
+
+#ifdef HAVE_SSL
+  if (!client->tls_checked && Encryption != HTTP_ENCRYPTION_NEVER)
+  {
+   /*
+    * See if we need to negotiate a TLS connection...
+    */
+
+    char buf[1];			/* First byte from client */
+
+    if (Encryption == HTTP_ENCRYPTION_ALWAYS ||
+        (recv(httpGetFd(client->http), buf, 1, MSG_PEEK) == 1 && (!buf[0] || !strchr("DGHOPT", buf[0]))))
+    {
+      serverLogClient(SERVER_LOGLEVEL_INFO, client, "Starting HTTPS session.");
 
-        serverLogClient(SERVER_LOGLEVEL_INFO, client, "Connection now encrypted.");
+      if (httpEncryption(client->http, HTTP_ENCRYPTION_ALWAYS))
+      {
+	serverLogClient(SERVER_LOGLEVEL_ERROR, client, "Unable to encrypt connection: %s", cupsLastErrorString());
+	return (0);
       }
 
-      first_time = 0;
+      count_handshake(client);
     }
+  }
 #endif /* HAVE_SSL */
 
-    if (!serverProcessHTTP(client))
-      break;
-  }
+  client->tls_checked = 1;
 
  /*
-  * Close the conection to the client and return...
+  * Process requests until the input buffer is empty.  Pipelined requests that
+  * are already buffered are answered in order, with the socket corked so the
+  * responses are coalesced into as few packets as possible...
   */
 
-  serverDeleteClient(client);
+  do
+  {
+    if (!serverProcessHTTP(client))
+      return (0);
 
-  return (NULL);
+    if (httpGetReady(client->http) > 0)
+    {
+      if (!client->corked)
+        cork_client(client, 1);
+
+      pipelined ++;
+    }
+  }
+  while (httpGetReady(client->http) > 0);
+
+  if (pipelined)
+    serverLogClient(SERVER_LOGLEVEL_DEBUG, client, "Processed %d pipelined requests.", pipelined + 1);
+
+  if (client->corked)
+    cork_client(client, 0);
+
+  client->activity = time(NULL);
+
+  return (1);
 }
 
 
@@ -268,6 +367,13 @@ serverProcessHTTP(
   client->response  = NULL;
   client->operation = HTTP_STATE_WAITING;
 
+ /*
+  * Return to the default buffer size between requests; document transfers
+  * use BufferSize...
+  */
+
+  httpSetBufferSize(client->http, HTTP_MAX_BUFFER);
+
  /*
   * Read a request from the connection...
   */
@@ -375,7 +481,7 @@ serverProcessHTTP(
 	return (0);
       }
 
-      serverLogClient(SERVER_LOGLEVEL_INFO, client, "Connection now encrypted.");
+      count_handshake(client);
     }
     else
 #endif /* HAVE_SSL */
@@ -482,6 +588,8 @@ serverProcessHTTP(
         }
 	else if (!strcmp(client->uri, "/"))
 	  return (serverRespondHTTP(client, HTTP_STATUS_OK, NULL, "text/html", 0));
+	else if (!strcmp(client->uri, "/stats"))
+	  return (serverRespondHTTP(client, HTTP_STATUS_OK, NULL, "text/plain", 0));
 
         return (serverRespondHTTP(client, HTTP_STATUS_NOT_FOUND, NULL, NULL, 0));
 
@@ -524,8 +632,6 @@ serverProcessHTTP(
 
               int		fd;		/* Icon file */
               struct stat	fileinfo;	/* Icon file information */
-              char		buffer[4096];	/* Copy buffer */
-              ssize_t		bytes;		/* Bytes */
 
               if (printer->pinfo.icon)
               {
@@ -539,9 +645,7 @@ serverProcessHTTP(
                     return (0);
                   }
 
-                  while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
-                    httpWrite2(client->http, buffer, (size_t)bytes);
-
+                  send_file(client, fd);
                   httpFlushWrite(client->http);
 
                   close(fd);
@@ -595,10 +699,8 @@ serverProcessHTTP(
               key.lang = uriptr;
               if ((match = (server_lang_t *)cupsArrayFind(printer->pinfo.strings, &key)) != NULL)
               {
-                int		fd;		/* Icon file */
-                struct stat	fileinfo;	/* Icon file information */
-                char		buffer[4096];	/* Copy buffer */
-                ssize_t		bytes;		/* Bytes */
+                int		fd;		/* Strings file */
+                struct stat	fileinfo;	/* Strings file information */
 
                 serverLogClient(SERVER_LOGLEVEL_DEBUG, client, "Strings file is \"%s\".", match->filename);
 
@@ -610,9 +712,7 @@ serverProcessHTTP(
                     return (0);
                   }
 
-                  while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
-                    httpWrite2(client->http, buffer, (size_t)bytes);
-
+                  send_file(client, fd);
                   httpFlushWrite(client->http);
 
                   close(fd);
@@ -626,6 +726,10 @@ serverProcessHTTP(
 	{
           return (show_status(client, NULL, encoding));
 	}
+	else if (!strcmp(client->uri, "/stats"))
+	{
+          return (show_stats(client));
+	}
 
         return (serverRespondHTTP(client, HTTP_STATUS_NOT_FOUND, NULL, NULL, 0));
 
@@ -690,10 +794,20 @@ serverRespondHTTP(
   if (code == HTTP_STATUS_CONTINUE)
   {
    /*
-    * 100-continue doesn't send any headers...
+    * 100-continue doesn't send any headers.  The client waits for it before
+    * sending the request body, so it has to go out now rather than sit in a
+    * corked socket...
     */
 
-    return (httpWriteResponse(client->http, HTTP_STATUS_CONTINUE) == 0);
+    if (httpWriteResponse(client->http, HTTP_STATUS_CONTINUE))
+      return (0);
+
+    if (client->corked)
+      cork_client(client, 0);
+    else
+      httpFlushWrite(client->http);
+
+    return (1);
   }
 
  /*
@@ -780,16 +894,12 @@ serverRespondHTTP(
 
     if (client->fetch_file >= 0)
     {
-      ssize_t	bytes;			/* Bytes read */
-      char	buffer[32768];		/* Buffer */
-
       serverLogClient(SERVER_LOGLEVEL_DEBUG, client, "serverRespondHTTP: Sending file.");
 
       if (client->fetch_compression)
         httpSetField(client->http, HTTP_FIELD_CONTENT_ENCODING, "gzip");
 
-      while ((bytes = read(client->fetch_file, buffer, sizeof(buffer))) > 0)
-        httpWrite2(client->http, buffer, (size_t)bytes);
+      send_file(client, client->fetch_file);
 
       serverLogClient(SERVER_LOGLEVEL_DEBUG, client, "serverRespondHTTP: Sent file.");
 
@@ -826,18 +936,43 @@ serverRun(void)
   struct timeval	timeout;	/* Timeout for poll() */
   server_listener_t	*lis;		/* Listener */
   server_client_t	*client;	/* New client */
-  time_t                next_clean = 0; /* Next time to clean old jobs */
+  int			accepting = 1;	/* Accepting new clients? */
 
 
   serverLog(SERVER_LOGLEVEL_DEBUG, "serverRun: %d printers configured.", cupsArrayCount(Printers));
   serverLog(SERVER_LOGLEVEL_DEBUG, "serverRun: %d listeners configured.", cupsArrayCount(Listeners));
 
+#ifdef HAVE_EPOLL
+  if (ConnectionMode == SERVER_CONNMODE_EVENTS)
+  {
+   /*
+    * Use the event loop and worker threads instead of a thread per client...
+    */
+
+    serverRunEvents();
+    return;
+  }
+#endif /* HAVE_EPOLL */
+
+  if (AcceptThreads > 1 && !serverStartAcceptors())
+    return;
+
  /*
   * Loop until we are killed or have a hard error...
   */
 
   for (;;)
   {
+   /*
+    * Stop accepting connections while we are at the MaxClients limit - new
+    * connections wait in the listen backlog until a client thread exits...
+    */
+
+    if (AcceptThreads > 1)
+      accepting = 0;
+    else
+      accepting = wait_clients(accepting);
+
    /*
     * Setup select() data for the Bonjour service socket and listeners...
     */
@@ -845,7 +980,7 @@ serverRun(void)
     FD_ZERO(&input);
     max_fd = 0;
 
-    for (lis = (server_listener_t *)cupsArrayFirst(Listeners); lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
+    for (lis = (server_listener_t *)cupsArrayFirst(Listeners); accepting && lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
     {
       FD_SET(lis->fd, &input);
       if (max_fd < lis->fd)
@@ -859,7 +994,7 @@ serverRun(void)
       max_fd = fd;
 #endif /* HAVE_DNSSD */
 
-    timeout.tv_sec  = 86400;
+    timeout.tv_sec  = (AcceptThreads > 1 || accepting) ? 1 : 0;
     timeout.tv_usec = 0;
 
     if (select(max_fd + 1, &input, NULL, NULL, &timeout) < 0 && errno != EINTR)
@@ -868,26 +1003,14 @@ serverRun(void)
       break;
     }
 
-    for (lis = (server_listener_t *)cupsArrayFirst(Listeners); lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
+    for (lis = (server_listener_t *)cupsArrayFirst(Listeners); accepting && lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
     {
       if (FD_ISSET(lis->fd, &input))
       {
         serverLog(SERVER_LOGLEVEL_DEBUG, "serverRun: Incoming connection on listener %s:%d.", lis->host, lis->port);
 
         if ((client = serverCreateClient(lis->fd)) != NULL)
-        {
-          _cups_thread_t t = _cupsThreadCreate((_cups_thread_func_t)serverProcessClient, client);
-
-          if (t)
-          {
-            _cupsThreadDetach(t);
-          }
-          else
-          {
-            serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create client thread (%s)", strerror(errno));
-            serverDeleteClient(client);
-          }
-        }
+          serverStartClient(client);
       }
     }
 
@@ -899,13 +1022,207 @@ serverRun(void)
     }
 #endif /* HAVE_DNSSD */
 
-    if (time(NULL) >= next_clean)
-    {
-      serverCleanAllJobs();
+    serverRunTimers();
+  }
+}
 
-      next_clean = time(NULL) + 30;
+
+/*
+ * 'serverStartAcceptors()' - Start the acceptor threads.
+ *
+ * Each acceptor thread accepts connections on its own set of SO_REUSEPORT
+ * listener sockets.
+ */
+
+int					/* O - 1 on success, 0 on error */
+serverStartAcceptors(void)
+{
+  int			acceptor;	/* Acceptor thread number */
+  cups_array_t		*listeners;	/* Listeners for acceptor */
+  server_listener_t	*lis;		/* Listener */
+  _cups_thread_t	t;		/* Acceptor thread */
+
+
+  for (acceptor = 0; acceptor < AcceptThreads; acceptor ++)
+  {
+   /*
+    * Give each thread its own array so they don't share the array cursor...
+    */
+
+    listeners = cupsArrayNew(NULL, NULL);
+
+    for (lis = (server_listener_t *)cupsArrayFirst(Listeners); lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
+      if (lis->acceptor == acceptor)
+        cupsArrayAdd(listeners, lis);
+
+    if ((t = _cupsThreadCreate((_cups_thread_func_t)run_acceptor, listeners)) == 0)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create acceptor thread (%s)", strerror(errno));
+      cupsArrayDelete(listeners);
+      return (0);
     }
+
+    _cupsThreadDetach(t);
   }
+
+  serverLog(SERVER_LOGLEVEL_DEBUG, "serverStartAcceptors: Started %d acceptor threads.", AcceptThreads);
+
+  return (1);
+}
+
+
+/*
+ * 'serverStartClient()' - Start processing requests from a new client.
+ */
+
+int					/* O - 1 on success, 0 on error */
+serverStartClient(
+    server_client_t *client)		/* I - Client */
+{
+  _cups_thread_t	t;		/* Client thread */
+
+
+#ifdef HAVE_EPOLL
+  if (ConnectionMode == SERVER_CONNMODE_EVENTS)
+  {
+    serverWatchClient(client);
+    return (1);
+  }
+#endif /* HAVE_EPOLL */
+
+  if ((t = _cupsThreadCreate((_cups_thread_func_t)serverProcessClient, client)) == 0)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create client thread (%s)", strerror(errno));
+    serverDeleteClient(client);
+    return (0);
+  }
+
+  _cupsThreadDetach(t);
+
+  return (1);
+}
+
+
+/*
+ * 'cork_client()' - Hold back or release partial packets on a client socket.
+ *
+ * While corked, response data is only sent in full packets.  Uncorking sends
+ * anything that remains.  Buffered response data is flushed to the socket
+ * first either way.
+ */
+
+static void
+cork_client(server_client_t *client,	/* I - Client */
+            int             on)		/* I - 1 to cork, 0 to uncork */
+{
+#ifdef TCP_CORK
+  int	val = on;			/* Option value */
+#endif /* TCP_CORK */
+
+
+  httpFlushWrite(client->http);
+
+#ifdef TCP_CORK
+  if (setsockopt(httpGetFd(client->http), IPPROTO_TCP, TCP_CORK, &val, sizeof(val)))
+    serverLogClient(SERVER_LOGLEVEL_DEBUG, client, "Unable to set TCP_CORK: %s", strerror(errno));
+#endif /* TCP_CORK */
+
+  client->corked = on;
+}
+
+
+#ifdef HAVE_SSL
+/*
+ * 'count_handshake()' - Log and count a completed TLS handshake.
+ */
+
+static void
+count_handshake(server_client_t *client)/* I - Client */
+{
+  int	resumed = _httpTLSResumed(client->http);
+					/* Resumed session? */
+
+
+  serverLogClient(SERVER_LOGLEVEL_INFO, client, "Connection now encrypted (%s).", resumed ? "resumed session" : "full handshake");
+
+  _cupsMutexLock(&StatsMutex);
+  if (resumed)
+    Stats.tls_resumed ++;
+  else
+    Stats.tls_full ++;
+  _cupsMutexUnlock(&StatsMutex);
+}
+#endif /* HAVE_SSL */
+
+
+/*
+ * 'create_listener()' - Create a listener socket that shares its address.
+ *
+ * This is httpAddrListen() with SO_REUSEPORT so that multiple acceptor threads
+ * can listen on the same address and port.
+ */
+
+static int				/* O - Socket or -1 on error */
+create_listener(http_addr_t *addr)	/* I - Address and port to bind to */
+{
+  int	fd,				/* Socket */
+	val = 1,			/* Socket value */
+	status;				/* Bind status */
+
+
+  if ((fd = socket(addr->addr.sa_family, SOCK_STREAM, 0)) < 0)
+  {
+    _cupsSetHTTPError(HTTP_STATUS_ERROR);
+    return (-1);
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+#ifdef SO_REUSEPORT
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+#endif /* SO_REUSEPORT */
+#ifdef IPV6_V6ONLY
+  if (addr->addr.sa_family == AF_INET6)
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &val, sizeof(val));
+#endif /* IPV6_V6ONLY */
+
+#ifdef AF_LOCAL
+  if (addr->addr.sa_family == AF_LOCAL)
+  {
+    mode_t	mask;			/* Umask setting */
+
+   /*
+    * Remove any existing domain socket file and let all users access the new
+    * one...
+    */
+
+    unlink(addr->un.sun_path);
+
+    mask   = umask(0);
+    status = bind(fd, (struct sockaddr *)addr, (socklen_t)httpAddrLength(addr));
+
+    umask(mask);
+    chmod(addr->un.sun_path, 0140777);
+  }
+  else
+#endif /* AF_LOCAL */
+  {
+    status = bind(fd, (struct sockaddr *)addr, (socklen_t)httpAddrLength(addr));
+  }
+
+  if (status || listen(fd, SOMAXCONN))
+  {
+    _cupsSetHTTPError(HTTP_STATUS_ERROR);
+    close(fd);
+    return (-1);
+  }
+
+  fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &val, sizeof(val));
+#endif /* SO_NOSIGPIPE */
+
+  return (fd);
 }
 
 
@@ -1264,6 +1581,97 @@ parse_options(server_client_t *client,	/* I - Client */
 }
 
 
+/*
+ * 'run_acceptor()' - Accept new connections on a set of listeners.
+ */
+
+static void *				/* O - Thread exit status */
+run_acceptor(cups_array_t *listeners)	/* I - Listeners for this thread */
+{
+  int			accepting = 1,	/* Accepting new clients? */
+			max_fd;		/* Number of file descriptors */
+  fd_set		input;		/* select() input set */
+  server_listener_t	*lis;		/* Listener */
+  server_client_t	*client;	/* New client */
+
+
+  for (;;)
+  {
+    if (!(accepting = wait_clients(accepting)))
+      continue;
+
+    FD_ZERO(&input);
+    max_fd = 0;
+
+    for (lis = (server_listener_t *)cupsArrayFirst(listeners); lis; lis = (server_listener_t *)cupsArrayNext(listeners))
+    {
+      FD_SET(lis->fd, &input);
+      if (max_fd < lis->fd)
+        max_fd = lis->fd;
+    }
+
+    if (select(max_fd + 1, &input, NULL, NULL, NULL) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      serverLog(SERVER_LOGLEVEL_ERROR, "Acceptor thread failed (%s)", strerror(errno));
+      break;
+    }
+
+    for (lis = (server_listener_t *)cupsArrayFirst(listeners); lis; lis = (server_listener_t *)cupsArrayNext(listeners))
+    {
+      if (FD_ISSET(lis->fd, &input))
+      {
+        serverLog(SERVER_LOGLEVEL_DEBUG, "run_acceptor: Incoming connection on listener %s:%d (acceptor %d).", lis->host, lis->port, lis->acceptor);
+
+        if ((client = serverCreateClient(lis->fd)) != NULL)
+          serverStartClient(client);
+      }
+    }
+  }
+
+  cupsArrayDelete(listeners);
+
+  return (NULL);
+}
+
+
+/*
+ * 'send_file()' - Send the rest of a response body from a file.
+ *
+ * Uses sendfile() when the response has a Content-Length and needs no TLS or
+ * content coding, otherwise copies the file through a buffer.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+send_file(server_client_t *client,	/* I - Client */
+          int             fd)		/* I - File to send */
+{
+  ssize_t	bytes;			/* Bytes read/sent */
+  char		buffer[32768];		/* Copy buffer */
+
+
+  if ((bytes = _httpSendFile(client->http, fd)) < 0)
+  {
+    serverLogClient(SERVER_LOGLEVEL_ERROR, client, "Unable to send file: %s", strerror(httpError(client->http)));
+    return (0);
+  }
+  else if (bytes > 0)
+    return (1);
+
+  httpSetBufferSize(client->http, (size_t)BufferSize);
+
+  while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    if (httpWrite2(client->http, buffer, (size_t)bytes) < 0)
+      return (0);
+  }
+
+  return (bytes == 0);
+}
+
+
 /*
  * 'show_materials()' - Show material load state.
  */
@@ -1626,6 +2034,8 @@ show_media(server_client_t  *client,	/* I - Client connection */
 
     _cupsRWUnlock(&printer->rwlock);
 
+    serverSignalPrinterStateReasons(printer);
+
     html_printf(client, "<blockquote>Media updated.</blockquote>\n");
   }
 
@@ -1709,6 +2119,54 @@ show_media(server_client_t  *client,	/* I - Client connection */
 }
 
 
+/*
+ * 'show_stats()' - Show server statistics.
+ *
+ * The statistics are provided as plain text "name value" lines that can be
+ * scraped by monitoring tools.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+show_stats(server_client_t *client)	/* I - Client connection */
+{
+  server_stats_t	stats;		/* Copy of statistics */
+  char			buffer[1024];	/* Statistics text */
+
+
+  _cupsMutexLock(&StatsMutex);
+  stats = Stats;
+  _cupsMutexUnlock(&StatsMutex);
+
+  snprintf(buffer, sizeof(buffer),
+           "ippserver_clients %d\n"
+           "ippserver_clients_accepted %u\n"
+           "ippserver_clients_deferred %u\n"
+           "ippserver_clients_max %d\n"
+           "ippserver_requests_queued %d\n"
+           "ippserver_requests_queued_high %d\n"
+           "ippserver_requests_queued_max %d\n"
+           "ippserver_requests_rejected %u\n"
+           "ippserver_tls_handshakes_full %u\n"
+           "ippserver_tls_handshakes_resumed %u\n"
+           "ippserver_transform_cache_bytes %lld\n"
+           "ippserver_transform_cache_bytes_max %lld\n"
+           "ippserver_transform_cache_hits %u\n"
+           "ippserver_transform_cache_misses %u\n"
+           "ippserver_transforms %d\n"
+           "ippserver_transforms_max %d\n"
+           "ippserver_transforms_queued %d\n",
+           stats.clients, stats.accepted, stats.deferred, MaxClients, stats.queued, stats.queued_max, MaxQueuedRequests, stats.rejected, stats.tls_full, stats.tls_resumed, (long long)stats.cache_size, (long long)TransformCacheSize, stats.cache_hits, stats.cache_misses, stats.transforms, MaxTransforms, stats.transforms_queued);
+
+  if (!serverRespondHTTP(client, HTTP_STATUS_OK, NULL, "text/plain", strlen(buffer)))
+    return (0);
+
+  httpWrite2(client->http, buffer, strlen(buffer));
+  httpFlushWrite(client->http);
+
+  return (1);
+}
+
+
 /*
  * 'show_status()' - Show printer/system state.
  */
@@ -1753,9 +2211,9 @@ show_status(server_client_t  *client,	/* I - Client connection */
     else
       html_printf(client, "<p class=\"buttons\"><p class=\"buttons\"><a class=\"button\" href=\"/\">Show Printers</a> <a class=\"button\" href=\"%s/media\">Show Media</a> <a class=\"button\" href=\"%s/supplies\">Show Supplies</a></p>\n", printer->resource, printer->resource);
     html_printf(client, "<h1><img align=\"left\" src=\"%s/icon.png\" width=\"64\" height=\"64\">%s Jobs</h1>\n", printer->resource, printer->dnssd_name);
-    html_printf(client, "<p>%s, %d job(s).", printer->state == IPP_PSTATE_IDLE ? "Idle" : printer->state == IPP_PSTATE_PROCESSING ? "Printing" : "Stopped", cupsArrayCount(printer->jobs));
+    html_printf(client, "<p>%s, %d job(s), %d running and %d waiting transform(s).", printer->state == IPP_PSTATE_IDLE ? "Idle" : printer->state == IPP_PSTATE_PROCESSING ? "Printing" : "Stopped", cupsArrayCount(printer->jobs), printer->num_transforms, printer->num_queued_transforms);
     for (i = 0, reason = 1; i < (int)(sizeof(reasons) / sizeof(reasons[0])); i ++, reason <<= 1)
-      if (printer->state_reasons & reason)
+      if ((printer->state_reasons | printer->spool_reasons) & reason)
         html_printf(client, "\n<br>&nbsp;&nbsp;&nbsp;&nbsp;%s", reasons[i]);
     html_printf(client, "</p>\n");
 
@@ -1804,9 +2262,9 @@ show_status(server_client_t  *client,	/* I - Client connection */
     {
       html_printf(client, "<div class=\"%s\">\n", (i & 1) ? "odd" : "even");
       html_printf(client, "  <h1><img align=\"left\" src=\"%s/icon.png\" width=\"64\" height=\"64\">%s</h1>\n", printer->resource, printer->dnssd_name);
-      html_printf(client, "  <p>%s, %d job(s).", printer->state == IPP_PSTATE_IDLE ? "Idle" : printer->state == IPP_PSTATE_PROCESSING ? "Printing" : "Stopped", cupsArrayCount(printer->jobs));
+      html_printf(client, "  <p>%s, %d job(s), %d running and %d waiting transform(s).", printer->state == IPP_PSTATE_IDLE ? "Idle" : printer->state == IPP_PSTATE_PROCESSING ? "Printing" : "Stopped", cupsArrayCount(printer->jobs), printer->num_transforms, printer->num_queued_transforms);
       for (j = 0, reason = 1; j < (int)(sizeof(reasons) / sizeof(reasons[0])); j ++, reason <<= 1)
-        if (printer->state_reasons & reason)
+        if ((printer->state_reasons | printer->spool_reasons) & reason)
           html_printf(client, "\n<br>&nbsp;&nbsp;&nbsp;&nbsp;%s", reasons[j]);
       html_printf(client, "</p>\n");
       if (!strncmp(printer->resource, "/ipp/print3d", 12))
@@ -1949,6 +2407,8 @@ show_supplies(
 
     _cupsRWUnlock(&printer->rwlock);
 
+    serverSignalPrinterStateReasons(printer);
+
     html_printf(client, "<blockquote>Supplies updated.</blockquote>\n");
   }
 
@@ -1976,3 +2436,33 @@ show_supplies(
 
   return (1);
 }
+
+
+/*
+ * 'wait_clients()' - Wait for clients to close if we are at the MaxClients limit.
+ */
+
+static int				/* O - 1 if accepting new clients, 0 otherwise */
+wait_clients(int accepting)		/* I - Currently accepting new clients? */
+{
+  _cupsMutexLock(&StatsMutex);
+
+  if (MaxClients > 0 && Stats.clients >= MaxClients)
+  {
+    if (accepting)
+    {
+      serverLog(SERVER_LOGLEVEL_INFO, "Too many clients (%d), deferring new connections.", Stats.clients);
+      Stats.deferred ++;
+    }
+
+    _cupsCondWait(&StatsCondition, &StatsMutex, 1.0);
+
+    accepting = Stats.clients < MaxClients;
+  }
+  else
+    accepting = 1;
+
+  _cupsMutexUnlock(&StatsMutex);
+
+  return (accepting);
+}
@@ -13,6 +13,7 @@
 #include <cups/dir.h>
 #include <fnmatch.h>
 #include <grp.h>
+#include <cups/http-private.h>
 #include <cups/ipp-private.h>
 
 
@@ -39,31 +40,11 @@ static void		dnssd_client_cb(AvahiClient *c, AvahiClientState state, void *userd
 #endif /* HAVE_AVAHI */
 static int		error_cb(_ipp_file_t *f, server_pinfo_t *pinfo, const char *error);
 static void		free_lang(server_lang_t *a);
+static off_t		get_size(const char *value);
 static int		load_system(const char *conf);
 static int		token_cb(_ipp_file_t *f, _ipp_vars_t *vars, server_pinfo_t *pinfo, const char *token);
 
 
-/*
- * 'serverCleanAllJobs()' - Clean old jobs for all printers...
- */
-
-void
-serverCleanAllJobs(void)
-{
-  server_printer_t  *printer;             /* Current printer */
-
-
-  serverLog(SERVER_LOGLEVEL_DEBUG, "Cleaning old jobs.");
-
-  _cupsMutexLock(&printer_mutex);
-
-  for (printer = (server_printer_t *)cupsArrayFirst(Printers); printer; printer = (server_printer_t *)cupsArrayNext(Printers))
-    serverCleanJobs(printer);
-
-  _cupsMutexUnlock(&printer_mutex);
-}
-
-
 /*
  * 'serverDNSSDInit()' - Initialize DNS-SD registrations.
  */
@@ -124,6 +105,7 @@ serverFinalizeConfiguration(void)
   */
 
   cupsSetServerCredentials(KeychainPath, ServerName, 1);
+  _httpTLSSetSessionCache(TLSSessionCache, TLSSessionLifetime);
 #endif /* HAVE_SSL */
 
  /*
@@ -1085,6 +1067,8 @@ attr_cb(_ipp_file_t    *f,		/* I - IPP file */
     "device-service-count",
     "device-uuid",
     "document-format-varying-attributes",
+    "ippserver-queued-transform-count",
+    "ippserver-transform-count",
     "job-settable-attributes-supported",
     "printer-alert",
     "printer-alert-description",
@@ -1253,7 +1237,36 @@ free_lang(server_lang_t *a)		/* I - Localization */
 
 
 /*
- * 'load_system()' - Load the system configuration file.
+ * 'get_size()' - Get a size value with an optional "k", "m", or "g" suffix.
+ */
+
+static off_t				/* O - Size in bytes or -1 on error */
+get_size(const char *value)		/* I - Size string */
+{
+  char	*ptr;				/* Pointer to suffix */
+  long	size;				/* Size value */
+
+
+  if (!isdigit(*value & 255))
+    return (-1);
+
+  size = strtol(value, &ptr, 10);
+
+  if (!_cups_strcasecmp(ptr, "k"))
+    return ((off_t)size * 1024);
+  else if (!_cups_strcasecmp(ptr, "m"))
+    return ((off_t)size * 1024 * 1024);
+  else if (!_cups_strcasecmp(ptr, "g"))
+    return ((off_t)size * 1024 * 1024 * 1024);
+  else if (*ptr)
+    return (-1);
+  else
+    return ((off_t)size);
+}
+
+
+/*
+ * 'load_system() - Load the system configuration file.
  */
 
 static int				/* O - 1 on success, 0 on failure */
@@ -1265,6 +1278,7 @@ load_system(const char *conf)		/* I - Configuration file */
   char		line[1024],		/* Line from file */
 		*value;			/* Pointer to value on line */
   struct group	*group;			/* Group information */
+  cups_array_t	*listens = NULL;	/* Listen addresses */
 
 
   if ((fp = cupsFileOpen(conf, "r")) == NULL)
@@ -1279,7 +1293,27 @@ load_system(const char *conf)		/* I - Configuration file */
       break;
     }
 
-    if (!_cups_strcasecmp(line, "Authentication"))
+    if (!_cups_strcasecmp(line, "AcceptThreads"))
+    {
+      if (!isdigit(*value & 255) || atoi(value) < 1)
+      {
+        fprintf(stderr, "ippserver: Bad AcceptThreads value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+#ifndef SO_REUSEPORT
+      if (atoi(value) > 1)
+      {
+        fprintf(stderr, "ippserver: AcceptThreads \"%s\" on line %d of \"%s\" is not supported on this platform.\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+#endif /* !SO_REUSEPORT */
+
+      AcceptThreads = atoi(value);
+    }
+    else if (!_cups_strcasecmp(line, "Authentication"))
     {
       if (!_cups_strcasecmp(value, "on") || !_cups_strcasecmp(value, "yes"))
       {
@@ -1334,6 +1368,40 @@ load_system(const char *conf)		/* I - Configuration file */
     {
       AuthType = strdup(value);
     }
+    else if (!_cups_strcasecmp(line, "BufferSize"))
+    {
+      if (!isdigit(*value & 255) || atoi(value) < HTTP_MAX_BUFFER || atoi(value) > _HTTP_MAX_BUFSIZE)
+      {
+        fprintf(stderr, "ippserver: Bad BufferSize value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      BufferSize = atoi(value);
+    }
+    else if (!_cups_strcasecmp(line, "ConnectionMode"))
+    {
+      if (!_cups_strcasecmp(value, "threads"))
+      {
+        ConnectionMode = SERVER_CONNMODE_THREADS;
+      }
+      else if (!_cups_strcasecmp(value, "events"))
+      {
+#ifdef HAVE_EPOLL
+        ConnectionMode = SERVER_CONNMODE_EVENTS;
+#else
+        fprintf(stderr, "ippserver: ConnectionMode \"%s\" on line %d of \"%s\" is not supported on this platform.\n", value, linenum, conf);
+        status = 0;
+        break;
+#endif /* HAVE_EPOLL */
+      }
+      else
+      {
+        fprintf(stderr, "ippserver: Bad ConnectionMode value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+    }
     else if (!_cups_strcasecmp(line, "DataDirectory"))
     {
       if (access(value, R_OK))
@@ -1395,6 +1463,25 @@ load_system(const char *conf)		/* I - Configuration file */
         break;
       }
     }
+    else if (!_cups_strcasecmp(line, "JobArchive"))
+    {
+      JobArchive = !strcasecmp(value, "yes") || !strcasecmp(value, "true") || !strcasecmp(value, "on");
+    }
+    else if (!_cups_strcasecmp(line, "JobJournal"))
+    {
+      JobJournal = !strcasecmp(value, "yes") || !strcasecmp(value, "true") || !strcasecmp(value, "on");
+    }
+    else if (!_cups_strcasecmp(line, "JobPriorityAging"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad JobPriorityAging value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      JobPriorityAging = atoi(value);
+    }
     else if (!_cups_strcasecmp(line, "JobPrivacyAttributes"))
     {
       if (JobPrivacyAttributes)
@@ -1424,7 +1511,6 @@ load_system(const char *conf)		/* I - Configuration file */
     else if (!_cups_strcasecmp(line, "Listen"))
     {
       char	*ptr;			/* Pointer into host value */
-      int	port;			/* Port number */
 
       if ((ptr = strrchr(value, ':')) != NULL && !isdigit(ptr[1] & 255))
       {
@@ -1433,19 +1519,10 @@ load_system(const char *conf)		/* I - Configuration file */
         break;
       }
 
-      if (ptr)
-      {
-        *ptr++ = '\0';
-        port   = atoi(ptr);
-      }
-      else
-        port = 8000 + ((int)getuid() % 1000);
+      if (!listens)
+        listens = cupsArrayNew3(NULL, NULL, NULL, 0, (cups_acopy_func_t)strdup, (cups_afree_func_t)free);
 
-      if (!serverCreateListeners(value, port))
-      {
-        status = 0;
-        break;
-      }
+      cupsArrayAdd(listens, value);
     }
     else if (!_cups_strcasecmp(line, "LogFile"))
     {
@@ -1469,6 +1546,17 @@ load_system(const char *conf)		/* I - Configuration file */
         break;
       }
     }
+    else if (!_cups_strcasecmp(line, "MaxClients"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad MaxClients value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      MaxClients = atoi(value);
+    }
     else if (!_cups_strcasecmp(line, "MaxCompletedJobs"))
     {
       if (!isdigit(*value & 255))
@@ -1491,6 +1579,37 @@ load_system(const char *conf)		/* I - Configuration file */
 
       MaxJobs = atoi(value);
     }
+    else if (!_cups_strcasecmp(line, "MaxQueuedRequests"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad MaxQueuedRequests value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      MaxQueuedRequests = atoi(value);
+    }
+    else if (!_cups_strcasecmp(line, "MaxSpoolSize"))
+    {
+      if ((MaxSpoolSize = get_size(value)) < 0)
+      {
+        fprintf(stderr, "ippserver: Bad MaxSpoolSize value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+    }
+    else if (!_cups_strcasecmp(line, "MaxTransforms"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad MaxTransforms value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      MaxTransforms = atoi(value);
+    }
     else if (!_cups_strcasecmp(line, "SpoolDirectory"))
     {
       if (access(value, R_OK))
@@ -1524,6 +1643,61 @@ load_system(const char *conf)		/* I - Configuration file */
 
       SubscriptionPrivacyScope = strdup(value);
     }
+#ifdef HAVE_SSL
+    else if (!_cups_strcasecmp(line, "TLSSessionCache"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad TLSSessionCache value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      TLSSessionCache = atoi(value);
+    }
+    else if (!_cups_strcasecmp(line, "TLSSessionLifetime"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad TLSSessionLifetime value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      TLSSessionLifetime = atoi(value);
+    }
+#endif /* HAVE_SSL */
+    else if (!_cups_strcasecmp(line, "TransformCacheSize"))
+    {
+      if ((TransformCacheSize = get_size(value)) < 0)
+      {
+        fprintf(stderr, "ippserver: Bad TransformCacheSize value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+    }
+    else if (!_cups_strcasecmp(line, "TransformWorkers"))
+    {
+      if (!isdigit(*value & 255))
+      {
+        fprintf(stderr, "ippserver: Bad TransformWorkers value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      TransformWorkers = atoi(value);
+    }
+    else if (!_cups_strcasecmp(line, "WorkerThreads"))
+    {
+      if (!isdigit(*value & 255) || atoi(value) < 1)
+      {
+        fprintf(stderr, "ippserver: Bad WorkerThreads value \"%s\" on line %d of \"%s\".\n", value, linenum, conf);
+        status = 0;
+        break;
+      }
+
+      WorkerThreads = atoi(value);
+    }
     else
     {
       fprintf(stderr, "ippserver: Unknown directive \"%s\" on line %d.\n", line, linenum);
@@ -1532,6 +1706,30 @@ load_system(const char *conf)		/* I - Configuration file */
 
   cupsFileClose(fp);
 
+ /*
+  * Create the listeners once the whole file has been read so that the
+  * AcceptThreads value applies to every Listen line...
+  */
+
+  for (value = (char *)cupsArrayFirst(listens); status && value; value = (char *)cupsArrayNext(listens))
+  {
+    char	*ptr;			/* Pointer into host value */
+    int		port;			/* Port number */
+
+    if ((ptr = strrchr(value, ':')) != NULL)
+    {
+      *ptr++ = '\0';
+      port   = atoi(ptr);
+    }
+    else
+      port = 8000 + ((int)getuid() % 1000);
+
+    if (!serverCreateListeners(value, port))
+      status = 0;
+  }
+
+  cupsArrayDelete(listens);
+
   return (status);
 }
 
@@ -1649,6 +1847,40 @@ token_cb(_ipp_file_t    *f,		/* I - IPP file data */
 
     pinfo->make = strdup(value);
   }
+  else if (!_cups_strcasecmp(token, "MaxActiveJobs"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing MaxActiveJobs value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if (!isdigit(value[0] & 255) || atoi(value) < 1)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Bad MaxActiveJobs value \"%s\" on line %d of \"%s\".", value, f->linenum, f->filename);
+      return (0);
+    }
+
+    pinfo->max_active_jobs = atoi(value);
+  }
+  else if (!_cups_strcasecmp(token, "MaxSpoolSize"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing MaxSpoolSize value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if ((pinfo->max_spool_size = get_size(value)) < 0)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Bad MaxSpoolSize value \"%s\" on line %d of \"%s\".", value, f->linenum, f->filename);
+      return (0);
+    }
+  }
   else if (!_cups_strcasecmp(token, "Model"))
   {
     if (!_ippFileReadToken(f, temp, sizeof(temp)))
@@ -1661,6 +1893,36 @@ token_cb(_ipp_file_t    *f,		/* I - IPP file data */
 
     pinfo->model = strdup(value);
   }
+  else if (!_cups_strcasecmp(token, "SpoolDirectory"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing SpoolDirectory value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if (access(value, R_OK | W_OK | X_OK))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to access SpoolDirectory \"%s\" on line %d of \"%s\": %s", value, f->linenum, f->filename, strerror(errno));
+      return (0);
+    }
+
+    pinfo->spool_directory = strdup(value);
+  }
+  else if (!_cups_strcasecmp(token, "StreamJobs"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing StreamJobs value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    pinfo->stream_jobs = !_cups_strcasecmp(value, "yes") || !_cups_strcasecmp(value, "true") || !_cups_strcasecmp(value, "on");
+  }
   else if (!_cups_strcasecmp(token, "Strings"))
   {
     server_lang_t	lang;			/* New localization */
@@ -1692,6 +1954,84 @@ token_cb(_ipp_file_t    *f,		/* I - IPP file data */
 
     serverLog(SERVER_LOGLEVEL_DEBUG, "Added strings file \"%s\" for language \"%s\".", stringsfile, value);
   }
+  else if (!_cups_strcasecmp(token, "TransformCPULimit"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing TransformCPULimit value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if (!isdigit(value[0] & 255))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Bad TransformCPULimit value \"%s\" on line %d of \"%s\".", value, f->linenum, f->filename);
+      return (0);
+    }
+
+    pinfo->transform_cpu = atoi(value);
+  }
+  else if (!_cups_strcasecmp(token, "TransformIOPriority"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing TransformIOPriority value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if (!_cups_strcasecmp(value, "idle"))
+    {
+      pinfo->transform_ioclass = 3;	/* IOPRIO_CLASS_IDLE */
+      pinfo->transform_iolevel = 0;
+    }
+    else if (value[0] >= '0' && value[0] <= '7' && !value[1])
+    {
+      pinfo->transform_ioclass = 2;	/* IOPRIO_CLASS_BE */
+      pinfo->transform_iolevel = value[0] - '0';
+    }
+    else
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Bad TransformIOPriority value \"%s\" on line %d of \"%s\".", value, f->linenum, f->filename);
+      return (0);
+    }
+  }
+  else if (!_cups_strcasecmp(token, "TransformMemoryLimit"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing TransformMemoryLimit value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if ((pinfo->transform_memory = get_size(value)) < 0)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Bad TransformMemoryLimit value \"%s\" on line %d of \"%s\".", value, f->linenum, f->filename);
+      return (0);
+    }
+  }
+  else if (!_cups_strcasecmp(token, "TransformNice"))
+  {
+    if (!_ippFileReadToken(f, temp, sizeof(temp)))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Missing TransformNice value on line %d of \"%s\".", f->linenum, f->filename);
+      return (0);
+    }
+
+    _ippVarsExpand(vars, value, temp, sizeof(value));
+
+    if ((!isdigit(value[0] & 255) && value[0] != '-') || atoi(value) < -20 || atoi(value) > 19)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Bad TransformNice value \"%s\" on line %d of \"%s\".", value, f->linenum, f->filename);
+      return (0);
+    }
+
+    pinfo->transform_nice = atoi(value);
+  }
   else
   {
     serverLog(SERVER_LOGLEVEL_ERROR, "Unknown directive \"%s\" on line %d of \"%s\".", token, f->linenum, f->filename);
@@ -9,6 +9,7 @@
  */
 
 #include "ippserver.h"
+#include <cups/http-private.h>
 
 
 /*
@@ -19,6 +20,7 @@ static inline int	check_attribute(const char *name, cups_array_t *ra, cups_array
 {
   return ((!pa || !cupsArrayFind(pa, (void *)name)) && (!ra || cupsArrayFind(ra, (void *)name)));
 }
+static void		allocate_job_file(server_job_t *job);
 static void		copy_doc_attributes(server_client_t *client, server_job_t *job, cups_array_t *ra, cups_array_t *pa);
 static void		copy_job_attributes(server_client_t *client, server_job_t *job, cups_array_t *ra, cups_array_t *pa);
 static void		copy_subscription_attributes(server_client_t *client, server_subscription_t *sub, cups_array_t *ra, cups_array_t *pa);
@@ -85,6 +87,30 @@ serverCopyAttributes(
 }
 
 
+/*
+ * 'allocate_job_file()' - Preallocate space for the document data.
+ *
+ * When the client sent a Content-Length, the space reserved against the spool
+ * quota is allocated up front so the file system can keep the file
+ * contiguous.  The file size itself is not changed.
+ */
+
+static void
+allocate_job_file(server_job_t *job)	/* I - Job */
+{
+#ifdef HAVE_FALLOCATE
+  if (job->spool_size <= 0)
+    return;
+
+  if (fallocate(job->fd, FALLOC_FL_KEEP_SIZE, 0, job->spool_size) && errno != EOPNOTSUPP)
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Unable to preallocate %ld bytes for print file: %s", (long)job->spool_size, strerror(errno));
+
+#else
+  (void)job;
+#endif /* HAVE_FALLOCATE */
+}
+
+
 /*
  * 'copy_doc_attrs()' - Copy document attributes to the response.
  */
@@ -206,13 +232,13 @@ copy_doc_attributes(
     ippAddBoolean(client->response, IPP_TAG_DOCUMENT, "last-document", 1);
 
   if (check_attribute("time-at-completed", ra, pa))
-    ippAddInteger(client->response, IPP_TAG_DOCUMENT, job->completed ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-completed", (int)(job->completed - client->printer->start_time));
+    ippAddInteger(client->response, IPP_TAG_DOCUMENT, job->completed ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-completed", serverGetJobTime(job, job->completed));
 
   if (check_attribute("time-at-created", ra, pa))
-    ippAddInteger(client->response, IPP_TAG_DOCUMENT, IPP_TAG_INTEGER, "time-at-created", (int)(job->created - client->printer->start_time));
+    ippAddInteger(client->response, IPP_TAG_DOCUMENT, IPP_TAG_INTEGER, "time-at-created", serverGetJobTime(job, job->created));
 
   if (check_attribute("time-at-processing", ra, pa))
-    ippAddInteger(client->response, IPP_TAG_DOCUMENT, job->processing ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-processing", (int)(job->processing - client->printer->start_time));
+    ippAddInteger(client->response, IPP_TAG_DOCUMENT, job->processing ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-processing", serverGetJobTime(job, job->processing));
 }
 
 
@@ -319,10 +345,10 @@ copy_job_attributes(
     serverCopyJobStateReasons(client->response, IPP_TAG_JOB, job);
 
   if (check_attribute("time-at-completed", ra, pa))
-    ippAddInteger(client->response, IPP_TAG_JOB, job->completed ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-completed", (int)(job->completed - client->printer->start_time));
+    ippAddInteger(client->response, IPP_TAG_JOB, job->completed ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-completed", serverGetJobTime(job, job->completed));
 
   if (check_attribute("time-at-processing", ra, pa))
-    ippAddInteger(client->response, IPP_TAG_JOB, job->processing ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-processing", (int)(job->processing - client->printer->start_time));
+    ippAddInteger(client->response, IPP_TAG_JOB, job->processing ? IPP_TAG_INTEGER : IPP_TAG_NOVALUE, "time-at-processing", serverGetJobTime(job, job->processing));
 }
 
 
@@ -339,7 +365,7 @@ copy_subscription_attributes(
 {
   serverCopyAttributes(client->response, sub->attrs, ra, pa, IPP_TAG_SUBSCRIPTION, 0);
 
-  if (check_attribute("notify-lease-expiration-time", ra, pa))
+  if (!sub->job && check_attribute("notify-lease-expiration-time", ra, pa))
     ippAddInteger(client->response, IPP_TAG_SUBSCRIPTION, IPP_TAG_INTEGER, "notify-lease-expiration-time", (int)(sub->expire - client->printer->start_time));
 
   if (check_attribute("notify-printer-up-time", ra, pa))
@@ -527,13 +553,25 @@ ipp_acknowledge_job(
     return;
   }
 
+  _cupsRWLockWrite(&(client->printer->rwlock));
+
   if (!job->dev_uuid)
     job->dev_uuid = strdup(device->uuid);
 
   job->state_reasons &= (server_jreason_t)~SERVER_JREASON_JOB_FETCHABLE;
 
+  serverJournalJob(job, 0);
+
+  _cupsRWUnlock(&(client->printer->rwlock));
+
   serverAddEvent(client->printer, job, SERVER_EVENT_JOB_STATE_CHANGED, "Job acknowledged.");
 
+ /*
+  * Make sure the job stays assigned to the device after a restart...
+  */
+
+  serverSyncJournal();
+
   serverRespondIPP(client, IPP_STATUS_OK, NULL);
 }
 
@@ -603,18 +641,22 @@ ipp_cancel_job(server_client_t *client)	/* I - Client */
 
 	_cupsRWLockWrite(&(client->printer->rwlock));
 
-	if (job->state == IPP_JSTATE_PROCESSING ||
-	    (job->state == IPP_JSTATE_HELD && job->fd >= 0))
+	if (job->state == IPP_JSTATE_PROCESSING || job->fd >= 0)
           job->cancel = 1;
 	else
 	{
 	  job->state     = IPP_JSTATE_CANCELED;
 	  job->completed = time(NULL);
+
+	  serverFinishJob(job);
 	}
 
 	_cupsRWUnlock(&(client->printer->rwlock));
 
+        serverSignalJobData(job);
+        serverSignalPrinterStateReasons(client->printer);
         serverAddEvent(client->printer, job, SERVER_EVENT_JOB_COMPLETED, NULL);
+        serverSyncJournal();
 
 	serverRespondIPP(client, IPP_STATUS_OK, NULL);
         break;
@@ -636,7 +678,8 @@ ipp_cancel_my_jobs(
 					/* List of bad job-id values */
   const char		*username;	/* Username */
   server_job_t		*job;		/* Current job pointer */
-  cups_array_t		*to_cancel;	/* Jobs to cancel */
+  cups_array_t		*to_cancel,	/* Jobs to cancel */
+			*to_finish;	/* Canceled jobs to move to history */
 
 
  /*
@@ -687,9 +730,10 @@ ipp_cancel_my_jobs(
   * OK, cancel jobs on this printer...
   */
 
-  _cupsRWLockRead(&(client->printer->rwlock));
+  _cupsRWLockWrite(&(client->printer->rwlock));
 
   to_cancel = cupsArrayNew(NULL, NULL);
+  to_finish = cupsArrayNew(NULL, NULL);
 
   if (job_ids)
   {
@@ -698,14 +742,14 @@ ipp_cancel_my_jobs(
     */
 
     int			i,		/* Looping var */
-			count;		/* Number of job-ids values */
-    server_job_t	key;		/* Search key for jobs */
+			count,		/* Number of job-ids values */
+			job_id;		/* Current job-id value */
 
     for (i = 0, count = ippGetCount(job_ids); i < count; i ++)
     {
-      key.id = ippGetInteger(job_ids, i);
+      job_id = ippGetInteger(job_ids, i);
 
-      if ((job = (server_job_t *)cupsArrayFind(client->printer->jobs, &key)) != NULL)
+      if ((job = serverLookupJob(client->printer, job_id)) != NULL)
       {
        /*
 	* Validate this job...
@@ -738,12 +782,12 @@ ipp_cancel_my_jobs(
       }
       else if (!bad_job_ids)
       {
-	serverRespondIPP(client, IPP_STATUS_ERROR_NOT_POSSIBLE, "Job #%d does not exist.", key.id);
+	serverRespondIPP(client, IPP_STATUS_ERROR_NOT_POSSIBLE, "Job #%d does not exist.", job_id);
 
-	bad_job_ids = ippAddInteger(client->response, IPP_TAG_UNSUPPORTED_GROUP, IPP_TAG_INTEGER, "job-ids", key.id);
+	bad_job_ids = ippAddInteger(client->response, IPP_TAG_UNSUPPORTED_GROUP, IPP_TAG_INTEGER, "job-ids", job_id);
       }
       else
-	ippSetInteger(client->response, &bad_job_ids, ippGetCount(bad_job_ids), key.id);
+	ippSetInteger(client->response, &bad_job_ids, ippGetCount(bad_job_ids), job_id);
     }
   }
   else
@@ -752,9 +796,12 @@ ipp_cancel_my_jobs(
     * Look for jobs belonging to the requesting user...
     */
 
-    for (job = (server_job_t *)cupsArrayFirst(client->printer->jobs); job; job = (server_job_t *)cupsArrayNext(client->printer->jobs))
+    cups_array_t *user_jobs = serverFindUserJobs(client->printer, username);
+					/* Jobs for user */
+
+    for (job = (server_job_t *)cupsArrayFirst(user_jobs); job; job = (server_job_t *)cupsArrayNext(user_jobs))
     {
-      if (!_cups_strcasecmp(username, job->username) && job->state < IPP_JSTATE_CANCELED)
+      if (job->state < IPP_JSTATE_CANCELED)
         cupsArrayAdd(to_cancel, job);
     }
   }
@@ -767,7 +814,7 @@ ipp_cancel_my_jobs(
 
     for (job = (server_job_t *)cupsArrayFirst(to_cancel); job; job = (server_job_t *)cupsArrayNext(to_cancel))
     {
-      if (job->state == IPP_JSTATE_PROCESSING || (job->state == IPP_JSTATE_HELD && job->fd >= 0))
+      if (job->state == IPP_JSTATE_PROCESSING || job->fd >= 0)
       {
 	job->cancel = 1;
       }
@@ -775,17 +822,42 @@ ipp_cancel_my_jobs(
       {
 	job->state     = IPP_JSTATE_CANCELED;
 	job->completed = time(NULL);
+
+	cupsArrayAdd(to_finish, job);
       }
+    }
+
+    serverRespondIPP(client, IPP_STATUS_OK, NULL);
+  }
+
+  _cupsRWUnlock(&(client->printer->rwlock));
 
+  if (!bad_job_ids)
+  {
+   /*
+    * Send the events (which lock the printer) before moving the canceled jobs
+    * to the job history, where they can be removed at any time...
+    */
+
+    for (job = (server_job_t *)cupsArrayFirst(to_cancel); job; job = (server_job_t *)cupsArrayNext(to_cancel))
+    {
+      serverSignalJobData(job);
       serverAddEvent(client->printer, job, SERVER_EVENT_JOB_COMPLETED, NULL);
     }
 
-    serverRespondIPP(client, IPP_STATUS_OK, NULL);
+    _cupsRWLockWrite(&(client->printer->rwlock));
+
+    for (job = (server_job_t *)cupsArrayFirst(to_finish); job; job = (server_job_t *)cupsArrayNext(to_finish))
+      serverFinishJob(job);
+
+    _cupsRWUnlock(&(client->printer->rwlock));
   }
 
   cupsArrayDelete(to_cancel);
+  cupsArrayDelete(to_finish);
 
-  _cupsRWUnlock(&(client->printer->rwlock));
+  serverSignalPrinterStateReasons(client->printer);
+  serverSyncJournal();
 }
 
 
@@ -956,6 +1028,12 @@ ipp_create_job(server_client_t *client)	/* I - Client */
     return;
   }
 
+ /*
+  * Make sure the job is in the journal before responding...
+  */
+
+  serverSyncJournal();
+
  /*
   * Return the job info...
   */
@@ -1263,6 +1341,8 @@ ipp_deregister_output_device(
 
   _cupsRWUnlock(&client->printer->rwlock);
 
+  serverSignalPrinterStateReasons(client->printer);
+
  /*
   * Delete the device...
   */
@@ -1385,6 +1465,8 @@ ipp_fetch_document(
 	  httpSetField(client->http, HTTP_FIELD_CONTENT_ENCODING, "gzip");
 
         httpSetLength(client->http, 0);
+	httpSetBufferSize(client->http, (size_t)BufferSize);
+
 	if (httpWriteResponse(client->http, HTTP_STATUS_OK) < 0)
 	  return;
 
@@ -1657,6 +1739,11 @@ ipp_get_jobs(server_client_t *client)	/* I - Client */
 			count;		/* Number of jobs that match */
   const char		*username;	/* Username */
   server_job_t		*job;		/* Current job pointer */
+  server_job_t		archived;	/* Current archived job */
+  int			archive_id,	/* Current archived job-id */
+			archive_scan;	/* Archived jobs left to skip */
+  cups_array_t		*jobs;		/* Jobs to look at */
+  int			reverse;	/* Walk jobs in reverse order? */
   cups_array_t		*ra;		/* Requested attributes array */
 
 
@@ -1804,29 +1891,100 @@ ipp_get_jobs(server_client_t *client)	/* I - Client */
 
   _cupsRWLockRead(&(client->printer->rwlock));
 
-  for (count = 0, job = (server_job_t *)cupsArrayFirst(client->printer->jobs);
-       (limit <= 0 || count < limit) && job;
-       job = (server_job_t *)cupsArrayNext(client->printer->jobs))
+ /*
+  * Only look at the jobs that can match - the user's jobs for "my-jobs", the
+  * active or completed jobs for the corresponding "which-jobs" values, or
+  * all jobs.  All of these are walked in descending job-id order...
+  */
+
+  if (username)
+  {
+    jobs    = serverFindUserJobs(client->printer, username);
+    reverse = 1;
+  }
+  else if (job_comparison < 0 || (job_comparison == 0 && job_state < IPP_JSTATE_CANCELED))
+  {
+    jobs    = client->printer->active_jobs;
+    reverse = 1;
+  }
+  else if (job_state >= IPP_JSTATE_CANCELED)
+  {
+    jobs    = client->printer->completed_jobs;
+    reverse = 1;
+  }
+  else
+  {
+    jobs    = client->printer->jobs;
+    reverse = 0;
+  }
+
+ /*
+  * Jobs that have left the job history are read from the job archive and
+  * merged in job-id order with the jobs in memory...
+  */
+
+  archive_scan = SERVER_ARCHIVE_SCAN;
+
+  if (job_comparison > 0 || (job_comparison == 0 && job_state >= IPP_JSTATE_CANCELED))
+    archive_id = serverReadArchivedJob(client->printer, INT_MAX, first_job_id, job_state, job_comparison, username, &archive_scan, &archived);
+  else
+    archive_id = 0;
+
+  for (count = 0, job = (server_job_t *)(reverse ? cupsArrayLast(jobs) : cupsArrayFirst(jobs));
+       (limit <= 0 || count < limit) && (job || archive_id);)
   {
+    if (job && job->id < first_job_id)
+    {
+     /*
+      * No more jobs in memory...
+      */
+
+      job = NULL;
+      continue;
+    }
+
+    if (archive_id && (!job || archive_id >= job->id))
+    {
+     /*
+      * Copy the next archived job, unless the job is also in memory...
+      */
+
+      if (!job || archive_id > job->id)
+      {
+	if (count > 0)
+	  ippAddSeparator(client->response);
+
+	count ++;
+	copy_job_attributes(client, &archived, ra, serverAuthorizeUser(client, archived.username, SERVER_GROUP_NONE, JobPrivacyScope) ? NULL : JobPrivacyArray);
+      }
+
+      ippDelete(archived.attrs);
+
+      archive_id = serverReadArchivedJob(client->printer, archive_id, first_job_id, job_state, job_comparison, username, &archive_scan, &archived);
+      continue;
+    }
+
    /*
     * Filter out jobs that don't match...
     */
 
-    if ((job_comparison < 0 && job->state > job_state) ||
-	(job_comparison == 0 && job->state != job_state) ||
-	(job_comparison > 0 && job->state < job_state) ||
-	job->id < first_job_id ||
-	(username && job->username &&
-	 strcasecmp(username, job->username)))
-      continue;
+    if ((job_comparison < 0 && job->state <= job_state) ||
+	(job_comparison == 0 && job->state == job_state) ||
+	(job_comparison > 0 && job->state >= job_state))
+    {
+      if (count > 0)
+	ippAddSeparator(client->response);
 
-    if (count > 0)
-      ippAddSeparator(client->response);
+      count ++;
+      copy_job_attributes(client, job, ra, serverAuthorizeUser(client, job->username, SERVER_GROUP_NONE, JobPrivacyScope) ? NULL : JobPrivacyArray);
+    }
 
-    count ++;
-    copy_job_attributes(client, job, ra, serverAuthorizeUser(client, job->username, SERVER_GROUP_NONE, JobPrivacyScope) ? NULL : JobPrivacyArray);
+    job = (server_job_t *)(reverse ? cupsArrayPrev(jobs) : cupsArrayNext(jobs));
   }
 
+  if (archive_id)
+    ippDelete(archived.attrs);
+
   cupsArrayDelete(ra);
 
   _cupsRWUnlock(&(client->printer->rwlock));
@@ -2011,6 +2169,12 @@ ipp_get_printer_attributes(
   serverCopyAttributes(client->response, printer->dev_attrs, ra, NULL, IPP_TAG_ZERO, IPP_TAG_ZERO);
   serverCopyAttributes(client->response, PrivacyAttributes, ra, NULL, IPP_TAG_ZERO, IPP_TAG_CUPS_CONST);
 
+  if (!ra || cupsArrayFind(ra, "ippserver-queued-transform-count"))
+    ippAddInteger(client->response, IPP_TAG_PRINTER, IPP_TAG_INTEGER, "ippserver-queued-transform-count", printer->num_queued_transforms);
+
+  if (!ra || cupsArrayFind(ra, "ippserver-transform-count"))
+    ippAddInteger(client->response, IPP_TAG_PRINTER, IPP_TAG_INTEGER, "ippserver-transform-count", printer->num_transforms);
+
   if (!ra || cupsArrayFind(ra, "printer-config-change-date-time"))
     ippAddDate(client->response, IPP_TAG_PRINTER, "printer-config-change-date-time", ippTimeToDate(printer->config_time));
 
@@ -2214,6 +2378,7 @@ ipp_get_subscriptions(
 
     copy_subscription_attributes(client, sub, ra, serverAuthorizeUser(client, sub->username, SERVER_GROUP_NONE, SubscriptionPrivacyScope) ? NULL : SubscriptionPrivacyArray);
   }
+  _cupsRWUnlock(&client->printer->rwlock);
 
   cupsArrayDelete(ra);
 }
@@ -2268,8 +2433,10 @@ ipp_print_job(server_client_t *client)	/* I - Client */
 {
   server_job_t		*job;		/* New job */
   char			filename[1024],	/* Filename buffer */
-			buffer[4096];	/* Copy buffer */
+			*buffer;	/* Copy buffer */
   ssize_t		bytes;		/* Bytes read */
+  off_t			total = 0;	/* Total bytes read */
+  int			streaming;	/* Stream document data to command? */
   cups_array_t		*ra;		/* Attributes to send in response */
 
 
@@ -2316,6 +2483,18 @@ ipp_print_job(server_client_t *client)	/* I - Client */
     return;
   }
 
+ /*
+  * Make sure there is room in the spool for the document...
+  */
+
+  if (!serverUpdateJobSpool(job, httpIsChunked(client->http) ? 0 : (off_t)httpGetRemaining(client->http), 0))
+  {
+    serverAbortJob(job);
+
+    serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+    return;
+  }
+
  /*
   * Create a file for the request data...
   */
@@ -2326,31 +2505,104 @@ ipp_print_job(server_client_t *client)	/* I - Client */
 
   if ((job->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
   {
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
 
     serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
                 "Unable to create print file: %s", strerror(errno));
     return;
   }
 
-  while ((bytes = httpRead2(client->http, buffer, sizeof(buffer))) > 0)
+  allocate_job_file(job);
+
+  if ((streaming = client->printer->pinfo.stream_jobs && client->printer->pinfo.command != NULL) != 0)
   {
-    if (write(job->fd, buffer, (size_t)bytes) < bytes)
+   /*
+    * Queue the job now so that the command can start processing the document
+    * data while we are still receiving it...
+    */
+
+    _cupsRWLockWrite(&(client->printer->rwlock));
+
+    job->filename      = strdup(filename);
+    job->state_reasons |= SERVER_JREASON_JOB_INCOMING;
+
+    serverQueueJob(job);
+
+    _cupsRWUnlock(&(client->printer->rwlock));
+
+    serverCheckJobs(client->printer);
+  }
+
+  httpSetBufferSize(client->http, (size_t)BufferSize);
+
+  if (streaming || (bytes = _httpSpliceRead(client->http, job->fd)) == 0)
+  {
+   /*
+    * splice() can't be used for this request (TLS, chunking, or content
+    * coding) or we need to tell the command about each block of document
+    * data, so copy the document data through a buffer...
+    */
+
+    if ((buffer = malloc((size_t)BufferSize)) == NULL)
     {
-      int error = errno;		/* Write error */
+      int error = errno;		/* Allocation error */
 
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
 
       unlink(filename);
 
-      serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
-                  "Unable to write print file: %s", strerror(error));
+      serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL, "Unable to allocate copy buffer: %s", strerror(error));
       return;
     }
+
+    while ((bytes = httpRead2(client->http, buffer, (size_t)BufferSize)) > 0)
+    {
+      total += bytes;
+
+      if (total > job->spool_size && !serverUpdateJobSpool(job, total, 0))
+      {
+	free(buffer);
+
+	serverAbortJob(job);
+
+	close(job->fd);
+	job->fd = -1;
+
+	unlink(filename);
+
+	serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+	return;
+      }
+
+      if (write(job->fd, buffer, (size_t)bytes) < bytes)
+      {
+	int error = errno;		/* Write error */
+
+	free(buffer);
+
+	serverAbortJob(job);
+
+	close(job->fd);
+	job->fd = -1;
+
+	unlink(filename);
+
+	serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
+		    "Unable to write print file: %s", strerror(error));
+	return;
+      }
+
+      if (streaming)
+        serverSignalJobData(job);
+    }
+
+    free(buffer);
   }
+  else if (bytes > 0)
+    total = bytes;
 
   if (bytes < 0)
   {
@@ -2358,7 +2610,7 @@ ipp_print_job(server_client_t *client)	/* I - Client */
     * Got an error while reading the print data, so abort this job.
     */
 
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
 
     close(job->fd);
     job->fd = -1;
@@ -2374,7 +2626,7 @@ ipp_print_job(server_client_t *client)	/* I - Client */
   {
     int error = errno;		/* Write error */
 
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
     job->fd    = -1;
 
     unlink(filename);
@@ -2384,15 +2636,45 @@ ipp_print_job(server_client_t *client)	/* I - Client */
     return;
   }
 
-  job->fd       = -1;
-  job->filename = strdup(filename);
-  job->state    = IPP_JSTATE_PENDING;
+  serverUpdateJobSpool(job, total, 1);
+
+  _cupsRWLockWrite(&(client->printer->rwlock));
+
+  job->fd = -1;
+
+  if (streaming)
+  {
+   /*
+    * Let the command know it has all of the document data...
+    */
+
+    job->state_reasons &= (server_jreason_t)~SERVER_JREASON_JOB_INCOMING;
+
+    serverJournalJob(job, 0);
+  }
+  else
+  {
+    job->filename = strdup(filename);
+
+    serverQueueJob(job);
+  }
+
+  _cupsRWUnlock(&(client->printer->rwlock));
 
  /*
   * Process the job, if possible...
   */
 
-  serverCheckJobs(client->printer);
+  if (streaming)
+    serverSignalJobData(job);
+  else
+    serverCheckJobs(client->printer);
+
+ /*
+  * Make sure the job is in the journal before responding...
+  */
+
+  serverSyncJournal();
 
  /*
   * Return the job info...
@@ -2441,6 +2723,7 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
   char			filename[1024],	/* Filename buffer */
 			buffer[4096];	/* Copy buffer */
   ssize_t		bytes;		/* Bytes read */
+  off_t			total = 0;	/* Total bytes copied */
   cups_array_t		*ra;		/* Attributes to send in response */
   static const char * const uri_status_strings[] =
   {					/* URI decode errors */
@@ -2538,24 +2821,27 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
     return;
   }
 
+ /*
+  * Make sure there is room in the spool for the document...
+  */
+
+  if (!serverUpdateJobSpool(job, 0, 0))
+  {
+    serverAbortJob(job);
+
+    serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+    return;
+  }
+
  /*
   * Create a file for the request data...
   */
 
-  if (!strcasecmp(job->format, "image/jpeg"))
-    snprintf(filename, sizeof(filename), "%s/%d.jpg", SpoolDirectory, job->id);
-  else if (!strcasecmp(job->format, "image/png"))
-    snprintf(filename, sizeof(filename), "%s/%d.png", SpoolDirectory, job->id);
-  else if (!strcasecmp(job->format, "application/pdf"))
-    snprintf(filename, sizeof(filename), "%s/%d.pdf", SpoolDirectory, job->id);
-  else if (!strcasecmp(job->format, "application/postscript"))
-    snprintf(filename, sizeof(filename), "%s/%d.ps", SpoolDirectory, job->id);
-  else
-    snprintf(filename, sizeof(filename), "%s/%d.prn", SpoolDirectory, job->id);
+  serverCreateJobFilename(client->printer, job, NULL, filename, sizeof(filename));
 
   if ((job->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
   {
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
 
     serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL, "Unable to create print file: %s", strerror(errno));
     return;
@@ -2573,20 +2859,39 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
     {
       if ((bytes = read(infile, buffer, sizeof(buffer))) < 0 && (errno == EAGAIN || errno == EINTR))
         bytes = 1;
-      else if (bytes > 0 && write(job->fd, buffer, (size_t)bytes) < bytes)
+      else if (bytes > 0)
       {
-	int error = errno;		/* Write error */
+	total += bytes;
+
+	if (total > job->spool_size && !serverUpdateJobSpool(job, total, 0))
+	{
+	  serverAbortJob(job);
 
-	job->state = IPP_JSTATE_ABORTED;
+	  close(job->fd);
+	  job->fd = -1;
 
-	close(job->fd);
-	job->fd = -1;
+	  unlink(filename);
+	  close(infile);
 
-	unlink(filename);
-	close(infile);
+	  serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+	  return;
+	}
 
-	serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL, "Unable to write print file: %s", strerror(error));
-	return;
+	if (write(job->fd, buffer, (size_t)bytes) < bytes)
+	{
+	  int error = errno;		/* Write error */
+
+	  serverAbortJob(job);
+
+	  close(job->fd);
+	  job->fd = -1;
+
+	  unlink(filename);
+	  close(infile);
+
+	  serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL, "Unable to write print file: %s", strerror(error));
+	  return;
+	}
       }
     }
     while (bytes > 0);
@@ -2605,7 +2910,7 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
     if ((http = httpConnect2(hostname, port, NULL, AF_UNSPEC, encryption, 1, 30000, NULL)) == NULL)
     {
       serverRespondIPP(client, IPP_STATUS_ERROR_DOCUMENT_ACCESS, "Unable to connect to %s: %s", hostname, cupsLastErrorString());
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
@@ -2620,7 +2925,7 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
     {
       serverRespondIPP(client, IPP_STATUS_ERROR_DOCUMENT_ACCESS, "Unable to GET URI: %s", strerror(errno));
 
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
@@ -2636,7 +2941,7 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
     {
       serverRespondIPP(client, IPP_STATUS_ERROR_DOCUMENT_ACCESS, "Unable to GET URI: %s", httpStatus(status));
 
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
@@ -2648,11 +2953,27 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
 
     while ((bytes = httpRead2(http, buffer, sizeof(buffer))) > 0)
     {
+      total += bytes;
+
+      if (total > job->spool_size && !serverUpdateJobSpool(job, total, 0))
+      {
+	serverAbortJob(job);
+
+	close(job->fd);
+	job->fd = -1;
+
+	unlink(filename);
+	httpClose(http);
+
+	serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+	return;
+      }
+
       if (write(job->fd, buffer, (size_t)bytes) < bytes)
       {
 	int error = errno;		/* Write error */
 
-	job->state = IPP_JSTATE_ABORTED;
+	serverAbortJob(job);
 
 	close(job->fd);
 	job->fd = -1;
@@ -2672,7 +2993,7 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
   {
     int error = errno;		/* Write error */
 
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
     job->fd    = -1;
 
     unlink(filename);
@@ -2681,9 +3002,16 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
     return;
   }
 
+  serverUpdateJobSpool(job, total, 1);
+
+  _cupsRWLockWrite(&(client->printer->rwlock));
+
   job->fd       = -1;
   job->filename = strdup(filename);
-  job->state    = IPP_JSTATE_PENDING;
+
+  serverQueueJob(job);
+
+  _cupsRWUnlock(&(client->printer->rwlock));
 
  /*
   * Process the job...
@@ -2691,6 +3019,12 @@ ipp_print_uri(server_client_t *client)	/* I - Client */
 
   serverCheckJobs(client->printer);
 
+ /*
+  * Make sure the job is in the journal before responding...
+  */
+
+  serverSyncJournal();
+
  /*
   * Return the job info...
   */
@@ -2769,12 +3103,7 @@ ipp_renew_subscription(
   else
     lease = SERVER_NOTIFY_LEASE_DURATION_DEFAULT;
 
-  sub->lease = lease;
-
-  if (lease)
-    sub->expire = time(NULL) + sub->lease;
-  else
-    sub->expire = INT_MAX;
+  serverRenewSubscription(sub, lease);
 
   serverRespondIPP(client, IPP_STATUS_OK, NULL);
 }
@@ -2790,8 +3119,9 @@ ipp_send_document(server_client_t *client)/* I - Client */
 {
   server_job_t		*job;		/* Job information */
   char			filename[1024],	/* Filename buffer */
-			buffer[4096];	/* Copy buffer */
+			*buffer;	/* Copy buffer */
   ssize_t		bytes;		/* Bytes read */
+  off_t			total = 0;	/* Total bytes read */
   ipp_attribute_t	*attr;		/* Current attribute */
   cups_array_t		*ra;		/* Attributes to send in response */
 
@@ -2871,6 +3201,18 @@ ipp_send_document(server_client_t *client)/* I - Client */
 
   serverCopyAttributes(job->attrs, client->request, NULL, NULL, IPP_TAG_JOB, 0);
 
+ /*
+  * Make sure there is room in the spool for the document...
+  */
+
+  if (!serverUpdateJobSpool(job, httpIsChunked(client->http) ? 0 : (off_t)httpGetRemaining(client->http), 0))
+  {
+    serverAbortJob(job);
+
+    serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+    return;
+  }
+
  /*
   * Get the document format for the job...
   */
@@ -2898,31 +3240,81 @@ ipp_send_document(server_client_t *client)/* I - Client */
 
   if (job->fd < 0)
   {
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
 
     serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
                 "Unable to create print file: %s", strerror(errno));
     return;
   }
 
-  while ((bytes = httpRead2(client->http, buffer, sizeof(buffer))) > 0)
+  allocate_job_file(job);
+
+  httpSetBufferSize(client->http, (size_t)BufferSize);
+
+  if ((bytes = _httpSpliceRead(client->http, job->fd)) == 0)
   {
-    if (write(job->fd, buffer, (size_t)bytes) < bytes)
+   /*
+    * splice() can't be used for this request (TLS, chunking, or content
+    * coding), so copy the document data through a buffer...
+    */
+
+    if ((buffer = malloc((size_t)BufferSize)) == NULL)
     {
-      int error = errno;		/* Write error */
+      int error = errno;		/* Allocation error */
 
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
 
       unlink(filename);
 
-      serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
-                  "Unable to write print file: %s", strerror(error));
+      serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL, "Unable to allocate copy buffer: %s", strerror(error));
       return;
     }
+
+    while ((bytes = httpRead2(client->http, buffer, (size_t)BufferSize)) > 0)
+    {
+      total += bytes;
+
+      if (total > job->spool_size && !serverUpdateJobSpool(job, total, 0))
+      {
+	free(buffer);
+
+	serverAbortJob(job);
+
+	close(job->fd);
+	job->fd = -1;
+
+	unlink(filename);
+
+	serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+	return;
+      }
+
+      if (write(job->fd, buffer, (size_t)bytes) < bytes)
+      {
+	int error = errno;		/* Write error */
+
+	free(buffer);
+
+	serverAbortJob(job);
+
+	close(job->fd);
+	job->fd = -1;
+
+	unlink(filename);
+
+	serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
+		    "Unable to write print file: %s", strerror(error));
+	return;
+      }
+    }
+
+    free(buffer);
   }
+  else if (bytes > 0)
+    total = bytes;
 
   if (bytes < 0)
   {
@@ -2930,7 +3322,7 @@ ipp_send_document(server_client_t *client)/* I - Client */
     * Got an error while reading the print data, so abort this job.
     */
 
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
 
     close(job->fd);
     job->fd = -1;
@@ -2946,7 +3338,7 @@ ipp_send_document(server_client_t *client)/* I - Client */
   {
     int error = errno;			/* Write error */
 
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
     job->fd    = -1;
 
     unlink(filename);
@@ -2956,11 +3348,14 @@ ipp_send_document(server_client_t *client)/* I - Client */
     return;
   }
 
+  serverUpdateJobSpool(job, total, 1);
+
   _cupsRWLockWrite(&(client->printer->rwlock));
 
   job->fd       = -1;
   job->filename = strdup(filename);
-  job->state    = IPP_JSTATE_PENDING;
+
+  serverQueueJob(job);
 
   _cupsRWUnlock(&(client->printer->rwlock));
 
@@ -2970,6 +3365,12 @@ ipp_send_document(server_client_t *client)/* I - Client */
 
   serverCheckJobs(client->printer);
 
+ /*
+  * Make sure the job is in the journal before responding...
+  */
+
+  serverSyncJournal();
+
  /*
   * Return the job info...
   */
@@ -3010,6 +3411,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
   char			filename[1024],	/* Filename buffer */
 			buffer[4096];	/* Copy buffer */
   ssize_t		bytes;		/* Bytes read */
+  off_t			total = 0;	/* Total bytes copied */
   ipp_attribute_t	*attr;		/* Current attribute */
   cups_array_t		*ra;		/* Attributes to send in response */
   static const char * const uri_status_strings[] =
@@ -3154,6 +3556,18 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
     return;
   }
 
+ /*
+  * Make sure there is room in the spool for the document...
+  */
+
+  if (!serverUpdateJobSpool(job, 0, 0))
+  {
+    serverAbortJob(job);
+
+    serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+    return;
+  }
+
  /*
   * Get the document format for the job...
   */
@@ -3170,16 +3584,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
   * Create a file for the request data...
   */
 
-  if (!strcasecmp(job->format, "image/jpeg"))
-    snprintf(filename, sizeof(filename), "%s/%d.jpg", SpoolDirectory, job->id);
-  else if (!strcasecmp(job->format, "image/png"))
-    snprintf(filename, sizeof(filename), "%s/%d.png", SpoolDirectory, job->id);
-  else if (!strcasecmp(job->format, "application/pdf"))
-    snprintf(filename, sizeof(filename), "%s/%d.pdf", SpoolDirectory, job->id);
-  else if (!strcasecmp(job->format, "application/postscript"))
-    snprintf(filename, sizeof(filename), "%s/%d.ps", SpoolDirectory, job->id);
-  else
-    snprintf(filename, sizeof(filename), "%s/%d.prn", SpoolDirectory, job->id);
+  serverCreateJobFilename(client->printer, job, NULL, filename, sizeof(filename));
 
   job->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
 
@@ -3187,7 +3592,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
 
   if (job->fd < 0)
   {
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
 
     serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
                 "Unable to create print file: %s", strerror(errno));
@@ -3208,21 +3613,40 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
       if ((bytes = read(infile, buffer, sizeof(buffer))) < 0 &&
           (errno == EAGAIN || errno == EINTR))
         bytes = 1;
-      else if (bytes > 0 && write(job->fd, buffer, (size_t)bytes) < bytes)
+      else if (bytes > 0)
       {
-	int error = errno;		/* Write error */
+	total += bytes;
 
-	job->state = IPP_JSTATE_ABORTED;
+	if (total > job->spool_size && !serverUpdateJobSpool(job, total, 0))
+	{
+	  serverAbortJob(job);
 
-	close(job->fd);
-	job->fd = -1;
+	  close(job->fd);
+	  job->fd = -1;
 
-	unlink(filename);
-	close(infile);
+	  unlink(filename);
+	  close(infile);
 
-	serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
-		    "Unable to write print file: %s", strerror(error));
-	return;
+	  serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+	  return;
+	}
+
+	if (write(job->fd, buffer, (size_t)bytes) < bytes)
+	{
+	  int error = errno;		/* Write error */
+
+	  serverAbortJob(job);
+
+	  close(job->fd);
+	  job->fd = -1;
+
+	  unlink(filename);
+	  close(infile);
+
+	  serverRespondIPP(client, IPP_STATUS_ERROR_INTERNAL,
+		      "Unable to write print file: %s", strerror(error));
+	  return;
+	}
       }
     }
     while (bytes > 0);
@@ -3244,7 +3668,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
       serverRespondIPP(client, IPP_STATUS_ERROR_DOCUMENT_ACCESS,
                   "Unable to connect to %s: %s", hostname,
 		  cupsLastErrorString());
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
@@ -3260,7 +3684,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
       serverRespondIPP(client, IPP_STATUS_ERROR_DOCUMENT_ACCESS,
                   "Unable to GET URI: %s", strerror(errno));
 
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
@@ -3277,7 +3701,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
       serverRespondIPP(client, IPP_STATUS_ERROR_DOCUMENT_ACCESS,
                   "Unable to GET URI: %s", httpStatus(status));
 
-      job->state = IPP_JSTATE_ABORTED;
+      serverAbortJob(job);
 
       close(job->fd);
       job->fd = -1;
@@ -3289,11 +3713,27 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
 
     while ((bytes = httpRead2(http, buffer, sizeof(buffer))) > 0)
     {
+      total += bytes;
+
+      if (total > job->spool_size && !serverUpdateJobSpool(job, total, 0))
+      {
+	serverAbortJob(job);
+
+	close(job->fd);
+	job->fd = -1;
+
+	unlink(filename);
+	httpClose(http);
+
+	serverRespondIPP(client, IPP_STATUS_ERROR_NOT_ACCEPTING_JOBS, "Spool area is full.");
+	return;
+      }
+
       if (write(job->fd, buffer, (size_t)bytes) < bytes)
       {
 	int error = errno;		/* Write error */
 
-	job->state = IPP_JSTATE_ABORTED;
+	serverAbortJob(job);
 
 	close(job->fd);
 	job->fd = -1;
@@ -3314,7 +3754,7 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
   {
     int error = errno;		/* Write error */
 
-    job->state = IPP_JSTATE_ABORTED;
+    serverAbortJob(job);
     job->fd    = -1;
 
     unlink(filename);
@@ -3324,11 +3764,14 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
     return;
   }
 
+  serverUpdateJobSpool(job, total, 1);
+
   _cupsRWLockWrite(&(client->printer->rwlock));
 
   job->fd       = -1;
   job->filename = strdup(filename);
-  job->state    = IPP_JSTATE_PENDING;
+
+  serverQueueJob(job);
 
   _cupsRWUnlock(&(client->printer->rwlock));
 
@@ -3338,6 +3781,12 @@ ipp_send_uri(server_client_t *client)	/* I - Client */
 
   serverCheckJobs(client->printer);
 
+ /*
+  * Make sure the job is in the journal before responding...
+  */
+
+  serverSyncJournal();
+
  /*
   * Return the job info...
   */
@@ -3754,6 +4203,9 @@ ipp_update_output_device_attributes(
       serverUpdateDeviceStateNoLock(client->printer);
     _cupsRWUnlock(&client->printer->rwlock);
 
+    if (events & SERVER_EVENT_PRINTER_STATE_CHANGED)
+      serverSignalPrinterStateReasons(client->printer);
+
     serverAddEvent(client->printer, NULL, events, NULL);
   }
 }
@@ -4180,12 +4632,30 @@ serverProcessIPP(
 
   if (httpGetState(client->http) != HTTP_STATE_WAITING)
   {
+    size_t	length;			/* Length of response */
+    struct stat	fileinfo;		/* Fetched file information */
+
     if (httpGetState(client->http) != HTTP_STATE_POST_SEND)
       httpFlush(client->http);		/* Flush trailing (junk) data */
 
+    length = ippLength(client->response);
+
     serverLogAttributes(client, "Response:", client->response, 2);
 
-    return (serverRespondHTTP(client, HTTP_STATUS_OK, NULL, "application/ipp", client->fetch_file >= 0 ? 0 : ippLength(client->response)));
+    if (client->fetch_file >= 0)
+    {
+     /*
+      * Send the fetched document with a Content-Length when possible so that it
+      * can be sent using sendfile(), otherwise use chunking...
+      */
+
+      if (!client->fetch_compression && !fstat(client->fetch_file, &fileinfo))
+        length += (size_t)fileinfo.st_size;
+      else
+        length = 0;
+    }
+
+    return (serverRespondHTTP(client, HTTP_STATUS_OK, NULL, "application/ipp", length));
   }
   else
     return (1);
@@ -101,6 +101,17 @@ extern char **environ;
 /* Default duration is 1 day */
 #  define SERVER_NOTIFY_LEASE_DURATION_DEFAULT		86400
 
+/* Idle client connections are closed after 30 seconds */
+#  define SERVER_CLIENT_TIMEOUT				30
+/* Overloaded clients are asked to retry after 5 seconds */
+#  define SERVER_CLIENT_RETRY_AFTER			5
+
+/* Job files are spread over 256 subdirectories of the spool directory */
+#  define SERVER_SPOOL_SHARDS				256
+
+/* Get-Jobs skips at most 65536 archived jobs that don't match */
+#  define SERVER_ARCHIVE_SCAN				65536
+
 
 /* URL schemes and DNS-SD types for IPP and web resources... */
 #  define SERVER_IPP_SCHEME "ipp"
@@ -296,6 +307,8 @@ enum server_preason_e			/* printer-state-reasons bit values */
   SERVER_PREASON_TONER_LOW = 0x8000	/* toner-low */
 };
 typedef unsigned int server_preason_t;	/* Bitfield for printer-state-reasons */
+#define SERVER_PREASON_BLOCKING (SERVER_PREASON_COVER_OPEN | SERVER_PREASON_INPUT_TRAY_MISSING | SERVER_PREASON_MARKER_SUPPLY_EMPTY | SERVER_PREASON_MARKER_WASTE_FULL | SERVER_PREASON_MEDIA_EMPTY | SERVER_PREASON_MEDIA_JAM | SERVER_PREASON_TONER_EMPTY)
+					/* Reasons that stop job processing */
 VAR const char * const server_preasons[16]
 VALUE({					/* Strings for bits */
   /* "none" is implied for no bits set */
@@ -317,6 +330,12 @@ VALUE({					/* Strings for bits */
   "toner-low"
 });
 
+typedef enum server_connmode_e		/* Client connection modes */
+{
+  SERVER_CONNMODE_THREADS,		/* One thread per client connection */
+  SERVER_CONNMODE_EVENTS		/* Event loop with pool of worker threads */
+} server_connmode_t;
+
 typedef enum server_transform_e		/* Transform modes for server */
 {
   SERVER_TRANSFORM_COMMAND,		/* Run command for print job processing */
@@ -357,6 +376,19 @@ typedef struct server_filter_s		/**** Attribute filter ****/
   ipp_tag_t		group_tag;	/* Group to copy */
 } server_filter_t;
 
+typedef void (*server_timer_cb_t)(void *data, int id);
+					/**** Timer callback ****/
+
+typedef struct server_timer_s		/**** Timer data ****/
+{
+  struct server_timer_s	*next,		/* Next timer in wheel slot */
+			**prev;		/* Pointer to this timer, NULL if not scheduled */
+  time_t		deadline;	/* Time to fire */
+  server_timer_cb_t	cb;		/* Callback function */
+  void			*data;		/* Callback data (long-lived object) */
+  int			id;		/* Callback object ID */
+} server_timer_t;
+
 typedef struct server_job_s server_job_t;
 
 typedef struct server_device_s		/**** Output Device data ****/
@@ -369,6 +401,22 @@ typedef struct server_device_s		/**** Output Device data ****/
   server_preason_t	reasons;	/* printer-state-reasons values */
 } server_device_t;
 
+typedef struct server_env_s		/**** Environment for commands ****/
+{
+  time_t	config_time;		/* printer-config-change-time for variables */
+  int		num_vars;		/* Number of variables */
+  size_t	vars[200];		/* Offsets of variables in data */
+  char		*data;			/* "NAME=value" strings */
+  size_t	datalen,		/* Bytes used in data */
+		datasize;		/* Bytes allocated for data */
+} server_env_t;
+
+typedef struct server_juser_s		/**** Jobs for a user ****/
+{
+  char			*name;		/* job-originating-user-name */
+  cups_array_t		*jobs;		/* Jobs in job-id order */
+} server_juser_t;
+
 typedef struct server_lang_s		/**** Localization data ****/
 {
   char			*lang,		/* Language code */
@@ -384,13 +432,22 @@ typedef struct server_pinfo_s		/**** Printer information ****/
 		*document_formats,	/* Supported input formats */
 		*command,		/* Command to run with job files */
 		*device_uri,		/* Device URI */
-		*output_format;		/* Output format */
+		*output_format,		/* Output format */
+		*spool_directory;	/* Spool directory */
   gid_t		print_group,		/* Print group, if any */
 		proxy_group;		/* Proxy group, if any */
   int		duplex,			/* Duplex mode */
+		max_active_jobs,	/* Maximum number of processing jobs */
 		pin,			/* PIN printing mode? */
 		ppm,			/* Pages per minute for mono */
-		ppm_color;		/* Pages per minute for color */
+		ppm_color,		/* Pages per minute for color */
+		stream_jobs,		/* Stream documents to command? */
+		transform_cpu,		/* CPU time limit for commands in seconds */
+		transform_ioclass,	/* I/O scheduling class for commands */
+		transform_iolevel,	/* I/O priority level for commands */
+		transform_nice;		/* Nice value for commands */
+  off_t		max_spool_size,		/* Maximum size of job files */
+		transform_memory;	/* Memory limit for commands */
   ipp_t		*attrs;			/* Printer attributes */
   cups_array_t	*strings;		/* Strings files */
 } server_pinfo_t;
@@ -424,7 +481,33 @@ typedef struct server_printer_s		/**** Printer data ****/
 			*active_jobs,	/* Active jobs */
 			*completed_jobs;/* Completed jobs */
   server_job_t		*processing_job;/* Current processing job */
+  int			num_processing,	/* Number of processing jobs */
+			num_slots,	/* Number of processing slot threads */
+			num_transforms,	/* Number of running commands */
+			num_queued_transforms;
+					/* Number of commands waiting to run */
+  unsigned		last_transform;	/* Sequence number of last command run */
+  _cups_mutex_t		slot_mutex;	/* Mutex for processing slots */
+  _cups_cond_t		slot_cond;	/* Condition for pending jobs */
+  _cups_mutex_t		state_mutex;	/* Mutex for printer-state-reasons waits */
+  _cups_cond_t		state_cond;	/* Condition for printer-state-reasons changes */
+  _cups_mutex_t		stream_mutex;	/* Mutex for streamed document data */
+  _cups_cond_t		stream_cond;	/* Condition for streamed document data */
+  server_job_t		**pending_jobs;	/* Heap of pending jobs */
+  int			num_pending,	/* Number of pending jobs in heap */
+			alloc_pending;	/* Allocated pending job slots */
+  server_job_t		**job_index;	/* Hash index of jobs by job-id */
+  int			job_index_size,	/* Size of job-id index */
+			job_index_count;/* Number of jobs in job-id index */
+  cups_array_t		*users;		/* Jobs by user name */
   int			next_job_id;	/* Next job-id value */
+  int			archive_fd,	/* Job archive records */
+			archive_data_fd;/* Job archive attributes */
+  cups_array_t		*archive_users;	/* Newest archived job for each user */
+  off_t			spool_used;	/* Size of job files */
+  server_preason_t	spool_reasons;	/* Spool printer-state-reasons values */
+  server_timer_t	spool_timer;	/* Spool state change event timer */
+  server_env_t		*transform_env;	/* Cached environment for commands */
   cups_array_t		*subscriptions;	/* Subscriptions */
   int			next_sub_id;	/* Next notify-subscription-id value */
 } server_printer_t;
@@ -446,6 +529,7 @@ struct server_job_s			/**** Job data ****/
   char			*dev_state_message;
 					/* output-device-job-state-message value */
   time_t		created,	/* time-at-creation value */
+			queued,		/* Time job was queued for processing */
 			processing,	/* time-at-processing value */
 			completed;	/* time-at-completed value */
   int			impressions,	/* job-impressions value */
@@ -453,8 +537,12 @@ struct server_job_s			/**** Job data ****/
   ipp_t			*attrs;		/* Attributes */
   int			cancel;		/* Non-zero when job canceled */
   char			*filename;	/* Print file name */
+  char			digest[65];	/* SHA-256 digest of print file or "" */
   int			fd;		/* Print file descriptor */
+  off_t			spool_size;	/* Size charged for job files */
   server_printer_t	*printer;	/* Printer */
+  int			queue_index;	/* Index in pending job heap or -1 */
+  server_timer_t	timer;		/* Job history cleanup timer */
 };
 
 typedef struct server_subscription_s	/**** Subscription data ****/
@@ -474,6 +562,7 @@ typedef struct server_subscription_s	/**** Subscription data ****/
 			last_sequence;	/* Last notify-sequence-number used */
   cups_array_t		*events;	/* Events (ipp_t *'s) */
   int			pending_delete;	/* Non-zero when the subscription is about to be deleted/canceled */
+  server_timer_t	timer;		/* Lease expiration timer */
 } server_subscription_t;
 
 typedef struct server_client_s		/**** Client data ****/
@@ -495,6 +584,11 @@ typedef struct server_client_s		/**** Client data ****/
   int			fetch_compression,
 					/* Compress file? */
 			fetch_file;	/* File to fetch */
+  int			tls_checked,	/* Non-zero once HTTPS detection is done */
+			busy,		/* Non-zero while owned by a worker thread */
+			corked;		/* Non-zero while the socket is corked */
+  time_t		activity;	/* Time of last activity */
+  struct server_client_s *next;		/* Next client in worker queue */
 } server_client_t;
 
 typedef struct server_listener_s	/**** Listener data ****/
@@ -502,13 +596,33 @@ typedef struct server_listener_s	/**** Listener data ****/
   int	fd;				/* Listener socket */
   char	host[256];			/* Hostname, if any */
   int	port;				/* Port number */
+  int	acceptor;			/* Acceptor thread number */
 } server_listener_t;
 
+typedef struct server_stats_s		/**** Server statistics ****/
+{
+  int			clients,	/* Current number of client connections */
+			queued,		/* Current number of queued clients */
+			queued_max,	/* Maximum number of queued clients */
+			transforms,	/* Current number of running commands */
+			transforms_queued;
+					/* Current number of commands waiting to run */
+  unsigned		accepted,	/* Number of accepted connections */
+			deferred,	/* Number of times accepting was paused */
+			rejected,	/* Number of requests rejected as busy */
+			tls_full,	/* Number of full TLS handshakes */
+			tls_resumed,	/* Number of resumed TLS sessions */
+			cache_hits,	/* Number of transform cache hits */
+			cache_misses;	/* Number of transform cache misses */
+  off_t			cache_size;	/* Size of transform cache */
+} server_stats_t;
+
 
 /*
  * Globals...
  */
 
+VAR int			AcceptThreads	VALUE(1);
 VAR int			Authentication	VALUE(0);
 VAR gid_t		AuthAdminGroup	VALUE((gid_t)-1),
 			AuthOperatorGroup VALUE((gid_t)-1);
@@ -531,11 +645,16 @@ VAR cups_array_t	*SubscriptionPrivacyArray VALUE(NULL);
 
 VAR ipp_t		*PrivacyAttributes VALUE(NULL);
 
+VAR int			BufferSize	VALUE(65536);
 VAR char		*ConfigDirectory VALUE(NULL);
+VAR server_connmode_t	ConnectionMode	VALUE(SERVER_CONNMODE_THREADS);
 VAR char		*DataDirectory	VALUE(NULL);
 VAR int			DefaultPort	VALUE(0);
 VAR char		*DefaultPrinter	VALUE(NULL);
 VAR http_encryption_t	Encryption	VALUE(HTTP_ENCRYPTION_IF_REQUESTED);
+VAR int			JobArchive	VALUE(0);
+VAR int			JobJournal	VALUE(1);
+VAR int			JobPriorityAging VALUE(0);
 VAR int			KeepFiles	VALUE(0);
 #ifdef HAVE_SSL
 VAR char		*KeychainPath	VALUE(NULL);
@@ -543,12 +662,23 @@ VAR char		*KeychainPath	VALUE(NULL);
 VAR cups_array_t	*Listeners	VALUE(NULL);
 VAR char		*LogFile	VALUE(NULL);
 VAR server_loglevel_t	LogLevel	VALUE(SERVER_LOGLEVEL_ERROR);
+VAR int			MaxClients	VALUE(0);
 VAR int			MaxJobs		VALUE(100),
                         MaxCompletedJobs VALUE(100);
+VAR int			MaxQueuedRequests VALUE(100);
+VAR off_t		MaxSpoolSize	VALUE(0);
+VAR int			MaxTransforms	VALUE(0);
 VAR cups_array_t	*Printers	VALUE(NULL);
 VAR int			RelaxedConformance VALUE(0);
 VAR char		*ServerName	VALUE(NULL);
 VAR char		*SpoolDirectory	VALUE(NULL);
+#ifdef HAVE_SSL
+VAR int			TLSSessionCache	VALUE(1000),
+			TLSSessionLifetime VALUE(3600);
+#endif /* HAVE_SSL */
+VAR off_t		TransformCacheSize VALUE(64 * 1024 * 1024);
+VAR int			TransformWorkers VALUE(2);
+VAR int			WorkerThreads	VALUE(10);
 
 #ifdef HAVE_DNSSD
 VAR DNSServiceRef	DNSSDMaster	VALUE(NULL);
@@ -561,20 +691,30 @@ VAR char		*DNSSDSubType	VALUE(NULL);
 VAR _cups_mutex_t	SubscriptionMutex VALUE(_CUPS_MUTEX_INITIALIZER);
 VAR _cups_cond_t	SubscriptionCondition VALUE(_CUPS_COND_INITIALIZER);
 
+VAR server_stats_t	Stats;
+VAR _cups_mutex_t	StatsMutex	VALUE(_CUPS_MUTEX_INITIALIZER);
+VAR _cups_cond_t	StatsCondition	VALUE(_CUPS_COND_INITIALIZER);
+
 
 /*
  * Functions...
  */
 
+extern void		serverAbortJob(server_job_t *job);
+extern void		serverAddCachedTransform(const char *key, const char *tempfile, const char *attrs);
 extern void		serverAddEvent(server_printer_t *printer, server_job_t *job, server_event_t event, const char *message, ...) __attribute__((__format__(__printf__, 4, 5)));
+extern int		serverAddJob(server_job_t *job);
+extern void		serverAddTimer(server_timer_t *timer, time_t deadline, server_timer_cb_t cb, void *data, int id);
+extern void		serverArchiveJob(server_job_t *job);
 extern http_status_t	serverAuthenticateClient(server_client_t *client);
 extern int		serverAuthorizeUser(server_client_t *client, const char *owner, gid_t group, const char *scope);
+extern void		serverCancelTimer(server_timer_t *timer);
 extern void		serverCheckJobs(server_printer_t *printer);
-extern void             serverCleanAllJobs(void);
-extern void		serverCleanJobs(server_printer_t *printer);
+extern void		serverCloseArchive(server_printer_t *printer);
 extern void		serverCopyAttributes(ipp_t *to, ipp_t *from, cups_array_t *ra, cups_array_t *pa, ipp_tag_t group_tag, int quickcopy);
 extern void		serverCopyJobStateReasons(ipp_t *ipp, ipp_tag_t group_tag, server_job_t *job);
 extern void		serverCopyPrinterStateReasons(ipp_t *ipp, ipp_tag_t group_tag, server_printer_t *printer);
+extern int		serverCreateCachedTransform(const char *key, char *tempfile, size_t tempsize);
 extern server_client_t	*serverCreateClient(int sock);
 extern server_device_t	*serverCreateDevice(server_client_t *client);
 extern server_job_t	*serverCreateJob(server_client_t *client);
@@ -589,14 +729,19 @@ extern void		serverDeletePrinter(server_printer_t *printer);
 extern void		serverDeleteSubscription(server_subscription_t *sub);
 extern void		serverDNSSDInit(void);
 extern int		serverFinalizeConfiguration(void);
+extern int		serverFindCachedTransform(server_job_t *job, const char *command, const char *format, char *key, size_t keysize, char *attrs, size_t attrsize);
 extern server_device_t	*serverFindDevice(server_client_t *client);
 extern server_job_t	*serverFindJob(server_client_t *client, int job_id);
 extern server_printer_t	*serverFindPrinter(const char *resource);
 extern server_subscription_t *serverFindSubscription(server_client_t *client, int sub_id);
+extern cups_array_t	*serverFindUserJobs(server_printer_t *printer, const char *username);
+extern void		serverFinishJob(server_job_t *job);
 extern server_jreason_t	serverGetJobStateReasonsBits(ipp_attribute_t *attr);
+extern int		serverGetJobTime(server_job_t *job, time_t t);
 extern server_event_t	serverGetNotifyEventsBits(ipp_attribute_t *attr);
 extern const char	*serverGetNotifySubscribedEvent(server_event_t event);
 extern server_preason_t	serverGetPrinterStateReasonsBits(ipp_attribute_t *attr);
+extern void		serverJournalJob(server_job_t *job, int full);
 extern int		serverLoadAttributes(const char *filename, server_pinfo_t *pinfo);
 extern int		serverLoadConfiguration(const char *directory);
 extern void		serverLog(server_loglevel_t level, const char *format, ...) __attribute__((__format__(__printf__, 2, 3)));
@@ -604,15 +749,37 @@ extern void		serverLogAttributes(server_client_t *client, const char *title, ipp
 extern void		serverLogClient(server_loglevel_t level, server_client_t *client, const char *format, ...) __attribute__((__format__(__printf__, 3, 4)));
 extern void		serverLogJob(server_loglevel_t level, server_job_t *job, const char *format, ...) __attribute__((__format__(__printf__, 3, 4)));
 extern void		serverLogPrinter(server_loglevel_t level, server_printer_t *printer, const char *format, ...) __attribute__((__format__(__printf__, 3, 4)));
+extern server_job_t	*serverLookupJob(server_printer_t *printer, int id);
+extern void		serverOpenArchive(server_printer_t *printer);
+extern int		serverOpenJournal(void);
+extern int		serverOpenTransformCache(void);
 extern void		*serverProcessClient(server_client_t *client);
+extern int		serverProcessClientInput(server_client_t *client);
 extern int		serverProcessHTTP(server_client_t *client);
 extern int		serverProcessIPP(server_client_t *client);
 extern void		*serverProcessJob(server_job_t *job);
+extern void		serverQueueJob(server_job_t *job);
+extern int		serverReadArchivedJob(server_printer_t *printer, int before, int first_job_id, ipp_jstate_t state, int comparison, const char *username, int *scan, server_job_t *job);
+extern void		serverRenewSubscription(server_subscription_t *sub, int lease);
 extern int		serverRespondHTTP(server_client_t *client, http_status_t code, const char *content_coding, const char *type, size_t length);
 extern void		serverRespondIPP(server_client_t *client, ipp_status_t status, const char *message, ...) __attribute__ ((__format__ (__printf__, 3, 4)));
 extern void		serverRespondUnsupported(server_client_t *client, ipp_attribute_t *attr);
 extern void		serverRun(void);
+#ifdef HAVE_EPOLL
+extern void		serverRunEvents(void);
+#endif /* HAVE_EPOLL */
+extern void		serverRunTimers(void);
+extern void		serverSignalJobData(server_job_t *job);
+extern void		serverSignalPrinterStateReasons(server_printer_t *printer);
+extern int		serverStartAcceptors(void);
+extern int		serverStartClient(server_client_t *client);
+extern void		serverSyncJournal(void);
 extern char		*serverTimeString(time_t tv, char *buffer, size_t bufsize);
 extern int		serverTransformJob(server_client_t *client, server_job_t *job, const char *command, const char *format, server_transform_t mode);
 extern void		serverUpdateDeviceAttributesNoLock(server_printer_t *printer);
 extern void		serverUpdateDeviceStateNoLock(server_printer_t *printer);
+extern int		serverUpdateJobSpool(server_job_t *job, off_t bytes, int force);
+extern int		serverWaitPrinterStateReasons(server_printer_t *printer, server_job_t *job, server_preason_t reasons);
+#ifdef HAVE_EPOLL
+extern void		serverWatchClient(server_client_t *client);
+#endif /* HAVE_EPOLL */
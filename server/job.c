@@ -12,80 +12,179 @@
 
 
 /*
- * 'serverCheckJobs()' - Check for new jobs to process.
+ * Local globals...
+ */
+
+static _cups_mutex_t	spool_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for spool usage */
+static off_t		spool_used = 0;	/* Size of all job files */
+static int		spool_full = 0;	/* Was "MaxSpoolSize" reached? */
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_queued_jobs(server_job_t *a, server_job_t *b);
+static int	compare_user_jobs(server_job_t *a, server_job_t *b);
+static int	compare_users(server_juser_t *a, server_juser_t *b);
+static server_job_t *dequeue_job(server_printer_t *printer);
+static void	expire_job(server_printer_t *printer, int id);
+static int	index_job(server_printer_t *printer, server_job_t *job);
+static void	move_queued_job(server_printer_t *printer, int current);
+static void	*run_slot(server_printer_t *printer);
+static void	set_spool_reasons(server_printer_t *printer, server_preason_t reasons);
+static void	spool_event(server_printer_t *printer, int id);
+
+
+/*
+ * 'serverAbortJob()' - Abort a job that could not be queued.
+ *
+ * Streamed jobs that are already processing are finished by the processing
+ * thread, and are flagged so that the command is stopped rather than given
+ * the incomplete document data.  The value of "errno" is preserved so the
+ * caller can report the error.
  */
 
 void
-serverCheckJobs(server_printer_t *printer)	/* I - Printer */
+serverAbortJob(server_job_t *job)	/* I - Job */
 {
-  server_job_t	*job;			/* Current job */
+  int	error = errno;			/* Current error */
 
 
-  if (printer->processing_job)
-    return;
+  _cupsRWLockWrite(&job->printer->rwlock);
 
-  _cupsRWLockWrite(&(printer->rwlock));
-  for (job = (server_job_t *)cupsArrayFirst(printer->active_jobs);
-       job;
-       job = (server_job_t *)cupsArrayNext(printer->active_jobs))
+  job->state_reasons &= (server_jreason_t)~SERVER_JREASON_JOB_INCOMING;
+
+  if (job->state == IPP_JSTATE_PROCESSING)
   {
-    if (job->state == IPP_JSTATE_PENDING)
+    job->state  = IPP_JSTATE_ABORTED;
+    job->cancel = 1;
+  }
+  else if (job->state < IPP_JSTATE_PROCESSING)
+  {
+    job->state     = IPP_JSTATE_ABORTED;
+    job->completed = time(NULL);
+
+    serverFinishJob(job);
+  }
+
+  _cupsRWUnlock(&job->printer->rwlock);
+
+  serverSignalJobData(job);
+
+  errno = error;
+}
+
+
+/*
+ * 'serverAddJob()' - Add a job to the printer's jobs array and indexes.
+ *
+ * The job's "username" must be set.  The printer must be locked for writing
+ * by the caller.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+serverAddJob(server_job_t *job)		/* I - Job */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+  server_juser_t	key,		/* Search key */
+			*user = NULL;	/* User's jobs */
+
+
+  if (job->username)
+  {
+   /*
+    * Find or create the user's job list...
+    */
+
+    if (!printer->users)
+      printer->users = cupsArrayNew((cups_array_func_t)compare_users, NULL);
+
+    key.name = (char *)job->username;
+
+    if ((user = (server_juser_t *)cupsArrayFind(printer->users, &key)) == NULL)
     {
-      _cups_thread_t t = _cupsThreadCreate((_cups_thread_func_t)serverProcessJob, job);
+      if ((user = calloc(1, sizeof(server_juser_t))) == NULL)
+        return (0);
 
-      if (t)
-      {
-        _cupsThreadDetach(t);
-      }
-      else
-      {
-        job->state     = IPP_JSTATE_ABORTED;
-	job->completed = time(NULL);
+      user->name = strdup(job->username);
+      user->jobs = cupsArrayNew((cups_array_func_t)compare_user_jobs, NULL);
 
-        serverAddEvent(printer, job, SERVER_EVENT_JOB_COMPLETED, "Job aborted because creation of processing thread failed.");
-      }
-      break;
+      cupsArrayAdd(printer->users, user);
     }
   }
-  _cupsRWUnlock(&(printer->rwlock));
+
+  if (!index_job(printer, job))
+    return (0);
+
+  cupsArrayAdd(printer->jobs, job);
+
+  if (user)
+    cupsArrayAdd(user->jobs, job);
+
+  return (1);
 }
 
 
 /*
- * 'serverCleanJobs()' - Clean out old (completed) jobs.
+ * 'serverCheckJobs()' - Check for new jobs to process.
+ *
+ * Each printer has up to "MaxActiveJobs" long-lived processing slot threads
+ * that wait for pending jobs.  This function starts any missing slots and
+ * wakes them up.
  */
 
 void
-serverCleanJobs(server_printer_t *printer)	/* I - Printer */
+serverCheckJobs(server_printer_t *printer)	/* I - Printer */
 {
   server_job_t	*job;			/* Current job */
-  time_t	cleantime;		/* Clean time */
 
 
-  serverLogPrinter(SERVER_LOGLEVEL_DEBUG, printer, "Cleaning jobs, %d completed jobs in memory...", cupsArrayCount(printer->completed_jobs));
+  _cupsMutexLock(&printer->slot_mutex);
 
-  if (cupsArrayCount(printer->completed_jobs) == 0)
-    return;
+  while (printer->num_slots < printer->pinfo.max_active_jobs)
+  {
+    _cups_thread_t t = _cupsThreadCreate((_cups_thread_func_t)run_slot, printer);
 
-  cleantime = time(NULL) - 60;
+    if (!t)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create processing thread for printer \"%s\": %s", printer->name, strerror(errno));
+      break;
+    }
 
-  serverLogPrinter(SERVER_LOGLEVEL_DEBUG, printer, "Clean time is %ld.", (long)cleantime);
+    _cupsThreadDetach(t);
+    printer->num_slots ++;
+  }
 
-  _cupsRWLockWrite(&(printer->rwlock));
-  for (job = (server_job_t *)cupsArrayFirst(printer->completed_jobs);
-       job;
-       job = (server_job_t *)cupsArrayNext(printer->completed_jobs))
-    if (job->completed && job->completed < cleantime)
+  if (printer->num_slots == 0)
+  {
+   /*
+    * No way to process jobs...
+    */
+
+    for (;;)
     {
-      serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Cleaning job #%d.", job->id);
-      cupsArrayRemove(printer->completed_jobs, job);
-      cupsArrayRemove(printer->jobs, job); /* Last since removing a job from here calls serverDeleteJob() */
+      _cupsRWLockWrite(&(printer->rwlock));
+      if ((job = dequeue_job(printer)) != NULL)
+      {
+	job->state     = IPP_JSTATE_ABORTED;
+	job->completed = time(NULL);
+
+	serverFinishJob(job);
+      }
+      _cupsRWUnlock(&(printer->rwlock));
+
+      if (!job)
+        break;
+
+      serverAddEvent(printer, job, SERVER_EVENT_JOB_COMPLETED, "Job aborted because creation of processing thread failed.");
     }
-    else if (job->completed)
-      serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Not cleaning job #%d - completed on %ld.", job->id, (long)job->completed);
-    else
-      break;
-  _cupsRWUnlock(&(printer->rwlock));
+  }
+
+  _cupsCondBroadcast(&printer->slot_cond);
+  _cupsMutexUnlock(&printer->slot_mutex);
 }
 
 
@@ -168,8 +267,9 @@ serverCreateJob(server_client_t *client)	/* I - Client */
 
   job->printer    = client->printer;
   job->attrs      = ippNew();
-  job->state      = IPP_JSTATE_HELD;
-  job->fd         = -1;
+  job->state       = IPP_JSTATE_HELD;
+  job->fd          = -1;
+  job->queue_index = -1;
 
  /*
   * Copy all of the job attributes...
@@ -193,7 +293,8 @@ serverCreateJob(server_client_t *client)	/* I - Client */
   else
     job->username = "anonymous";
 
-  ippAddString(job->attrs, IPP_TAG_JOB, IPP_TAG_NAME, "job-originating-user-name", NULL, job->username);
+  attr          = ippAddString(job->attrs, IPP_TAG_JOB, IPP_TAG_NAME, "job-originating-user-name", NULL, job->username);
+  job->username = ippGetString(attr, 0, NULL);
 
   if (ippGetOperation(client->request) != IPP_OP_CREATE_JOB)
   {
@@ -228,11 +329,21 @@ serverCreateJob(server_client_t *client)	/* I - Client */
     ippAddString(job->attrs, IPP_TAG_JOB, IPP_TAG_URI, "job-printer-uri", NULL, ippGetString(attr, 0, NULL));
   else
     ippAddString(job->attrs, IPP_TAG_JOB, IPP_TAG_URI, "job-printer-uri", NULL, client->printer->default_uri);
-  ippAddInteger(job->attrs, IPP_TAG_JOB, IPP_TAG_INTEGER, "time-at-creation", (int)(job->created - client->printer->start_time));
+  ippAddInteger(job->attrs, IPP_TAG_JOB, IPP_TAG_INTEGER, "time-at-creation", serverGetJobTime(job, job->created));
+
+  if (!serverAddJob(job))
+  {
+    _cupsRWUnlock(&(client->printer->rwlock));
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to allocate memory for job index.");
+    ippDelete(job->attrs);
+    free(job);
+    return (NULL);
+  }
 
-  cupsArrayAdd(client->printer->jobs, job);
   cupsArrayAdd(client->printer->active_jobs, job);
 
+  serverJournalJob(job, 1);
+
   _cupsRWUnlock(&(client->printer->rwlock));
 
   return (job);
@@ -241,6 +352,9 @@ serverCreateJob(server_client_t *client)	/* I - Client */
 
 /*
  * 'serverCreateJobFilename()' - Create the filename for a document in a job.
+ *
+ * Job files are spread over SERVER_SPOOL_SHARDS subdirectories of the
+ * printer's spool directory by job-id to keep each directory small.
  */
 
 void serverCreateJobFilename(
@@ -306,13 +420,16 @@ void serverCreateJobFilename(
   * Create a filename with the job-id, job-name, and document-format (extension)...
   */
 
-  snprintf(fname, fnamesize, "%s/%s/%d-%s.%s", SpoolDirectory, printer->name, job->id, name, ext);
+  snprintf(fname, fnamesize, "%s/%02x/%d-%s.%s", printer->pinfo.spool_directory, job->id % SERVER_SPOOL_SHARDS, job->id, name, ext);
 }
 
 
 /*
  * 'serverDeleteJob()' - Remove from the printer and free all memory used by a job
  *                  object.
+ *
+ * Any subscriptions for the job are deleted as well.  The printer must be
+ * locked for writing by the caller.
  */
 
 void
@@ -320,11 +437,120 @@ serverDeleteJob(server_job_t *job)		/* I - Job */
 {
   serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Removing job #%d from history.", job->id);
 
+  serverCancelTimer(&job->timer);
+
+  if (job->printer->job_index)
+  {
+   /*
+    * Remove from the job-id index, moving any following jobs in the same
+    * probe sequence back so that lookups don't need tombstones...
+    */
+
+    server_printer_t *printer = job->printer;
+					/* Printer */
+    server_job_t **jobs = printer->job_index;
+					/* Index */
+    int		mask = printer->job_index_size - 1,
+					/* Mask for index */
+		current,		/* Current (empty) slot */
+		next,			/* Next slot */
+		home;			/* Home slot of next job */
+
+    for (current = job->id & mask; jobs[current] && jobs[current] != job; current = (current + 1) & mask);
+
+    if (jobs[current] == job)
+    {
+      for (next = (current + 1) & mask; jobs[next]; next = (next + 1) & mask)
+      {
+        home = jobs[next]->id & mask;
+
+        if (((next - home) & mask) >= ((next - current) & mask))
+        {
+          jobs[current] = jobs[next];
+          current       = next;
+        }
+      }
+
+      jobs[current] = NULL;
+      printer->job_index_count --;
+    }
+  }
+
+  if (job->username && job->printer->users)
+  {
+   /*
+    * Remove from the user's job list...
+    */
+
+    server_juser_t	key,		/* Search key */
+			*user;		/* User's jobs */
+
+    key.name = (char *)job->username;
+
+    if ((user = (server_juser_t *)cupsArrayFind(job->printer->users, &key)) != NULL)
+    {
+      cupsArrayRemove(user->jobs, job);
+
+      if (cupsArrayCount(user->jobs) == 0)
+      {
+        cupsArrayRemove(job->printer->users, user);
+        cupsArrayDelete(user->jobs);
+        free(user->name);
+        free(user);
+      }
+    }
+  }
+
+  if (job->printer->subscriptions)
+  {
+   /*
+    * Per-job subscriptions end when the job leaves the job history...
+    */
+
+    server_subscription_t *sub;		/* Current subscription */
+
+    for (sub = (server_subscription_t *)cupsArrayFirst(job->printer->subscriptions); sub; sub = (server_subscription_t *)cupsArrayNext(job->printer->subscriptions))
+    {
+      if (sub->job == job)
+      {
+        serverLog(SERVER_LOGLEVEL_DEBUG, "Subscription #%d has expired.", sub->id);
+
+        cupsArrayRemove(job->printer->subscriptions, sub);
+        serverDeleteSubscription(sub);
+      }
+    }
+  }
+
+  if (job->queue_index >= 0)
+  {
+   /*
+    * Remove from the pending job heap...
+    */
+
+    server_printer_t *printer = job->printer;
+					/* Printer */
+    int		current = job->queue_index;
+					/* Index in heap */
+
+    job->queue_index = -1;
+
+    if (current < -- printer->num_pending)
+    {
+      printer->pending_jobs[current] = printer->pending_jobs[printer->num_pending];
+      printer->pending_jobs[current]->queue_index = current;
+
+      move_queued_job(printer, current);
+    }
+  }
+
   _cupsRWLockWrite(&job->rwlock);
 
   ippDelete(job->attrs);
   job->attrs = NULL;
 
+  if (job->spool_size)
+    serverUpdateJobSpool(job, 0, 1);
+
   if (job->filename)
   {
     if (!KeepFiles)
@@ -350,13 +576,13 @@ serverFindJob(
     int             job_id)		/* I - Job ID to find or 0 to lookup */
 {
   ipp_attribute_t	*attr;		/* job-id or job-uri attribute */
-  server_job_t		key,		/* Job search key */
-			*job;		/* Matching job, if any */
+  int			id;		/* Job ID */
+  server_job_t		*job;		/* Matching job, if any */
 
 
   if (job_id > 0)
   {
-    key.id = job_id;
+    id = job_id;
   }
   else if ((attr = ippFindAttribute(client->request, "job-uri", IPP_TAG_URI)) != NULL)
   {
@@ -371,23 +597,100 @@ serverFindJob(
     if (httpSeparateURI(HTTP_URI_CODING_ALL, uri, scheme, sizeof(scheme), userpass, sizeof(userpass), host, sizeof(host), &port, resource, sizeof(resource)) >= HTTP_URI_STATUS_OK &&
         !strncmp(resource, client->printer->resource, client->printer->resourcelen) &&
         resource[client->printer->resourcelen] == '/')
-      key.id = atoi(resource + client->printer->resourcelen + 1);
+      id = atoi(resource + client->printer->resourcelen + 1);
     else
       return (NULL);
   }
   else if ((attr = ippFindAttribute(client->request, "job-id", IPP_TAG_INTEGER)) != NULL)
   {
-    key.id = ippGetInteger(attr, 0);
+    id = ippGetInteger(attr, 0);
   }
 
   _cupsRWLockRead(&(client->printer->rwlock));
-  job = (server_job_t *)cupsArrayFind(client->printer->jobs, &key);
+  job = serverLookupJob(client->printer, id);
   _cupsRWUnlock(&(client->printer->rwlock));
 
   return (job);
 }
 
 
+/*
+ * 'serverFindUserJobs()' - Find the jobs for a user.
+ *
+ * User names are compared without regard to case.  The printer must be locked
+ * by the caller.
+ */
+
+cups_array_t *				/* O - Jobs in job-id order or `NULL` */
+serverFindUserJobs(
+    server_printer_t *printer,		/* I - Printer */
+    const char       *username)		/* I - User name */
+{
+  server_juser_t	key,		/* Search key */
+			*user;		/* User's jobs */
+
+
+  if (!printer->users)
+    return (NULL);
+
+  key.name = (char *)username;
+
+  if ((user = (server_juser_t *)cupsArrayFind(printer->users, &key)) != NULL)
+    return (user->jobs);
+  else
+    return (NULL);
+}
+
+
+/*
+ * 'serverFinishJob()' - Move a completed job to the job history.
+ *
+ * The printer must be locked for writing by the caller.
+ */
+
+void
+serverFinishJob(server_job_t *job)	/* I - Job */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+
+
+  cupsArrayAdd(printer->completed_jobs, job);
+  cupsArrayRemove(printer->active_jobs, job);
+
+  serverJournalJob(job, 0);
+
+ /*
+  * Remove the job from the history after 60 seconds...
+  */
+
+  serverAddTimer(&job->timer, job->completed + 60, (server_timer_cb_t)expire_job, printer, job->id);
+
+  if (MaxCompletedJobs > 0)
+  {
+   /*
+    * Make sure the job history doesn't go over the limit...
+    */
+
+    while (cupsArrayCount(printer->completed_jobs) > MaxCompletedJobs)
+    {
+      server_job_t *tjob = (server_job_t *)cupsArrayFirst(printer->completed_jobs);
+
+      while (tjob && (tjob == job || tjob->fd >= 0))
+	tjob = (server_job_t *)cupsArrayNext(printer->completed_jobs);
+
+      if (!tjob)
+        break;
+
+      serverArchiveJob(tjob);
+
+      cupsArrayRemove(printer->completed_jobs, tjob);
+      cupsArrayRemove(printer->jobs, tjob); /* Removing here calls serverDeleteJob */
+    }
+  }
+}
+
+
 /*
  * 'serverGetJobStateReasonsBits()' - Get the bits associates with "job-state-reasons" values.
  */
@@ -422,6 +725,56 @@ serverGetJobStateReasonsBits(
 }
 
 
+/*
+ * 'serverGetJobTime()' - Get a "time-at-xxx" value for a job.
+ *
+ * Jobs that were archived or recovered from the job journal can have times
+ * from before the server was started, which are reported as 0 since
+ * "printer-up-time" starts over when the server starts.
+ */
+
+int					/* O - Seconds since printer start */
+serverGetJobTime(server_job_t *job,	/* I - Job */
+                 time_t       t)	/* I - Time */
+{
+  if (t > job->printer->start_time)
+    return ((int)(t - job->printer->start_time));
+  else
+    return (0);
+}
+
+
+/*
+ * 'serverLookupJob()' - Find a job by job-id.
+ *
+ * The printer must be locked by the caller.
+ */
+
+server_job_t *				/* O - Job or `NULL` */
+serverLookupJob(
+    server_printer_t *printer,		/* I - Printer */
+    int              id)		/* I - job-id */
+{
+  server_job_t	**jobs = printer->job_index;
+					/* Index */
+  int		mask = printer->job_index_size - 1,
+					/* Mask for index */
+		current;		/* Current slot */
+
+
+  if (!jobs)
+    return (NULL);
+
+  for (current = id & mask; jobs[current]; current = (current + 1) & mask)
+  {
+    if (jobs[current]->id == id)
+      return (jobs[current]);
+  }
+
+  return (NULL);
+}
+
+
 /*
  * 'serverProcessJob()' - Process a print job.
  */
@@ -429,23 +782,40 @@ serverGetJobStateReasonsBits(
 void *					/* O - Thread exit status */
 serverProcessJob(server_job_t *job)	/* I - Job */
 {
+  _cupsMutexLock(&job->printer->slot_mutex);
+  job->printer->num_processing ++;
+  job->printer->processing_job = job;
+  _cupsMutexUnlock(&job->printer->slot_mutex);
+
   job->state                   = IPP_JSTATE_PROCESSING;
   job->printer->state          = IPP_PSTATE_PROCESSING;
   job->processing              = time(NULL);
-  job->printer->processing_job = job;
 
   serverAddEvent(job->printer, job, SERVER_EVENT_JOB_STATE_CHANGED, "Job processing.");
 
-  while (job->printer->state_reasons & SERVER_PREASON_MEDIA_EMPTY)
+  if ((job->printer->state_reasons | job->printer->dev_reasons) & SERVER_PREASON_BLOCKING)
   {
-    job->printer->state_reasons |= SERVER_PREASON_MEDIA_NEEDED;
+   /*
+    * Park the job until the printer can print again...
+    */
 
-    sleep(1);
+    if ((job->printer->state_reasons | job->printer->dev_reasons) & SERVER_PREASON_MEDIA_EMPTY)
+      job->printer->state_reasons |= SERVER_PREASON_MEDIA_NEEDED;
+
+    serverWaitPrinterStateReasons(job->printer, job, SERVER_PREASON_BLOCKING);
+
+    job->printer->state_reasons &= (server_preason_t)~SERVER_PREASON_MEDIA_NEEDED;
   }
 
-  job->printer->state_reasons &= (server_preason_t)~SERVER_PREASON_MEDIA_NEEDED;
+  if (job->cancel)
+  {
+   /*
+    * Canceled while waiting for the printer...
+    */
 
-  if (job->printer->pinfo.command)
+    serverLogJob(SERVER_LOGLEVEL_INFO, job, "Canceled while waiting for printer.");
+  }
+  else if (job->printer->pinfo.command)
   {
    /*
     * Execute a command with the job spool file and wait for it to complete...
@@ -459,8 +829,11 @@ serverProcessJob(server_job_t *job)	/* I - Job */
     * Prepare the job for the proxy...
     */
 
+    _cupsRWLockWrite(&job->printer->rwlock);
     job->state         = IPP_JSTATE_STOPPED;
     job->state_reasons |= SERVER_JREASON_JOB_FETCHABLE;
+    serverJournalJob(job, 0);
+    _cupsRWUnlock(&job->printer->rwlock);
 
     serverAddEvent(job->printer, job, SERVER_EVENT_JOB_STATE_CHANGED | SERVER_EVENT_JOB_FETCHABLE, "Job fetchable.");
   }
@@ -473,42 +846,538 @@ serverProcessJob(server_job_t *job)	/* I - Job */
     sleep((unsigned)(1 + (CUPS_RAND() % 4)));
   }
 
-  if (job->cancel)
+  if (job->cancel && job->state != IPP_JSTATE_ABORTED)
     job->state = IPP_JSTATE_CANCELED;
   else if (job->state == IPP_JSTATE_PROCESSING)
     job->state = IPP_JSTATE_COMPLETED;
 
-  job->printer->state          = IPP_PSTATE_IDLE;
-  job->printer->processing_job = NULL;
+  _cupsMutexLock(&job->printer->slot_mutex);
+
+  if (-- job->printer->num_processing == 0)
+  {
+    job->printer->state          = IPP_PSTATE_IDLE;
+    job->printer->processing_job = NULL;
+  }
+  else if (job->printer->processing_job == job)
+  {
+   /*
+    * Report another job that is still processing...
+    */
+
+    server_job_t *pjob;			/* Processing job */
+
+    _cupsRWLockRead(&job->printer->rwlock);
+    for (pjob = (server_job_t *)cupsArrayFirst(job->printer->active_jobs); pjob; pjob = (server_job_t *)cupsArrayNext(job->printer->active_jobs))
+    {
+      if (pjob != job && pjob->state == IPP_JSTATE_PROCESSING)
+        break;
+    }
+    _cupsRWUnlock(&job->printer->rwlock);
+
+    job->printer->processing_job = pjob;
+  }
+
+  _cupsMutexUnlock(&job->printer->slot_mutex);
 
   if (job->state >= IPP_JSTATE_CANCELED)
   {
     job->completed = time(NULL);
 
     _cupsRWLockWrite(&job->printer->rwlock);
-    cupsArrayAdd(job->printer->completed_jobs, job);
-    cupsArrayRemove(job->printer->active_jobs, job);
+    serverFinishJob(job);
+    _cupsRWUnlock(&job->printer->rwlock);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'serverQueueJob()' - Queue a job for processing.
+ *
+ * The job is added to the printer's pending job heap, which is ordered by
+ * "job-priority" and then by the time the job was queued.  When
+ * "JobPriorityAging" is set, a job's effective priority goes up by one for
+ * every "JobPriorityAging" seconds it has been waiting.  Since all queued jobs
+ * age at the same rate this does not change the relative order of jobs that
+ * are already in the heap.
+ *
+ * The job is also added to the job journal; callers that respond to the
+ * client should call serverSyncJournal() after unlocking the printer.
+ *
+ * The printer must be locked for writing by the caller.
+ */
+
+void
+serverQueueJob(server_job_t *job)	/* I - Job */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+
+
+  job->state  = IPP_JSTATE_PENDING;
+  job->queued = time(NULL);
+
+  if (job->queue_index >= 0)
+  {
+    move_queued_job(printer, job->queue_index);
+    serverJournalJob(job, 0);
+    return;
+  }
+
+  if (printer->num_pending >= printer->alloc_pending)
+  {
+    server_job_t	**temp;		/* New heap array */
+    int			alloc;		/* New allocation */
+
+    alloc = printer->alloc_pending ? 2 * printer->alloc_pending : 64;
+
+    if ((temp = realloc(printer->pending_jobs, (size_t)alloc * sizeof(server_job_t *))) == NULL)
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to allocate memory for pending job queue.");
+
+      job->state     = IPP_JSTATE_ABORTED;
+      job->completed = time(NULL);
+
+      serverFinishJob(job);
+      return;
+    }
+
+    printer->pending_jobs  = temp;
+    printer->alloc_pending = alloc;
+  }
 
-    if (MaxCompletedJobs > 0)
+  job->queue_index = printer->num_pending;
+  printer->pending_jobs[printer->num_pending ++] = job;
+
+  move_queued_job(printer, job->queue_index);
+
+  serverJournalJob(job, 1);
+}
+
+
+/*
+ * 'serverSignalJobData()' - Wake up threads waiting for streamed document data.
+ *
+ * Called after more document data has been written to the job's spool file
+ * and after the "job-incoming" reason has been cleared.
+ */
+
+void
+serverSignalJobData(server_job_t *job)	/* I - Job */
+{
+  _cupsMutexLock(&job->printer->stream_mutex);
+  _cupsCondBroadcast(&job->printer->stream_cond);
+  _cupsMutexUnlock(&job->printer->stream_mutex);
+}
+
+
+/*
+ * 'serverUpdateJobSpool()' - Update the spool space charged to a job.
+ *
+ * The job's files are charged "bytes" bytes against the printer's and the
+ * server's "MaxSpoolSize".  Unless "force" is non-zero, the update fails when
+ * it would go over either limit, and the printer (or every printer, for the
+ * server limit) reports the "spool-area-full" reason until space is
+ * reclaimed.  Use "force" to account for data that is already on disk and to
+ * release space.
+ *
+ * The "spool-area-full" reason is kept in the printer's "spool_reasons",
+ * which is protected by the spool mutex rather than the printer lock since
+ * callers may already hold the printer lock.
+ */
+
+int					/* O - 1 on success, 0 if spool is full */
+serverUpdateJobSpool(
+    server_job_t *job,			/* I - Job */
+    off_t        bytes,			/* I - New size of job files */
+    int          force)			/* I - Ignore spool limits? */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+  off_t			delta;		/* Change in size */
+  int			global_full,	/* Over "MaxSpoolSize" in system.conf? */
+			printer_full;	/* Over "MaxSpoolSize" for printer? */
+  cups_array_t		*printers;	/* Copy of printers array */
+  int			i,		/* Looping var */
+			count;		/* Number of printers */
+  server_printer_t	*p;		/* Current printer */
+
+
+  _cupsMutexLock(&spool_mutex);
+
+  delta        = bytes - job->spool_size;
+  global_full  = MaxSpoolSize > 0 && spool_used + delta > MaxSpoolSize;
+  printer_full = printer->pinfo.max_spool_size > 0 && printer->spool_used + delta > printer->pinfo.max_spool_size;
+
+  if (!force && delta >= 0 && (global_full || printer_full))
+  {
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Spool area is full (%ld bytes used by printer, %ld bytes total).", (long)printer->spool_used, (long)spool_used);
+
+    set_spool_reasons(printer, SERVER_PREASON_SPOOL_AREA_FULL);
+
+    if (global_full && !spool_full)
     {
      /*
-      * Make sure the job history doesn't go over the limit...
+      * The whole spool is full, report "spool-area-full" for every printer.
+      * The printers are walked using a copy of the printers array since other
+      * threads use the array's current element...
       */
 
-      while (cupsArrayCount(job->printer->completed_jobs) > MaxCompletedJobs)
+      spool_full = 1;
+
+      if ((printers = cupsArrayDup(Printers)) != NULL)
       {
-	server_job_t *tjob = (server_job_t *)cupsArrayFirst(job->printer->completed_jobs);
+        for (i = 0, count = cupsArrayCount(printers); i < count; i ++)
+          set_spool_reasons((server_printer_t *)cupsArrayIndex(printers, i), SERVER_PREASON_SPOOL_AREA_FULL);
 
-	if (tjob == job)
-	  tjob = (server_job_t *)cupsArrayNext(job->printer->completed_jobs);
+        cupsArrayDelete(printers);
+      }
+    }
 
-	cupsArrayRemove(job->printer->completed_jobs, tjob);
-	cupsArrayRemove(job->printer->jobs, tjob); /* Removing here calls serverDeleteJob */
+    _cupsMutexUnlock(&spool_mutex);
+
+    return (0);
+  }
+
+  job->spool_size     = bytes;
+  printer->spool_used += delta;
+  spool_used          += delta;
+
+  if (spool_full && spool_used < MaxSpoolSize)
+  {
+   /*
+    * Space was reclaimed, clear "spool-area-full" from the other printers...
+    */
+
+    spool_full = 0;
+
+    if ((printers = cupsArrayDup(Printers)) != NULL)
+    {
+      for (i = 0, count = cupsArrayCount(printers); i < count; i ++)
+      {
+        p = (server_printer_t *)cupsArrayIndex(printers, i);
+
+        if (p != printer && (p->pinfo.max_spool_size <= 0 || p->spool_used < p->pinfo.max_spool_size))
+          set_spool_reasons(p, SERVER_PREASON_NONE);
       }
+
+      cupsArrayDelete(printers);
     }
+  }
 
-    _cupsRWUnlock(&job->printer->rwlock);
+  if (!spool_full && (printer->pinfo.max_spool_size <= 0 || printer->spool_used < printer->pinfo.max_spool_size))
+    set_spool_reasons(printer, SERVER_PREASON_NONE);
+
+  _cupsMutexUnlock(&spool_mutex);
+
+  return (1);
+}
+
+
+/*
+ * 'compare_queued_jobs()' - Compare two queued jobs.
+ *
+ * Returns a negative value when job "a" should be processed before job "b".
+ */
+
+static int				/* O - Result of comparison */
+compare_queued_jobs(server_job_t *a,	/* I - First job */
+                    server_job_t *b)	/* I - Second job */
+{
+  long	diff;				/* Difference */
+
+
+  if (JobPriorityAging > 0)
+    diff = (long)(b->priority - a->priority) * JobPriorityAging + (long)(a->queued - b->queued);
+  else
+    diff = b->priority - a->priority;
+
+  if (diff == 0)
+    diff = a->id - b->id;
+
+  return (diff < 0 ? -1 : diff > 0);
+}
+
+
+/*
+ * 'compare_user_jobs()' - Compare two jobs for a user.
+ */
+
+static int				/* O - Result of comparison */
+compare_user_jobs(server_job_t *a,	/* I - First job */
+                  server_job_t *b)	/* I - Second job */
+{
+  return (a->id - b->id);
+}
+
+
+/*
+ * 'compare_users()' - Compare two user names.
+ */
+
+static int				/* O - Result of comparison */
+compare_users(server_juser_t *a,	/* I - First user */
+              server_juser_t *b)	/* I - Second user */
+{
+  return (_cups_strcasecmp(a->name, b->name));
+}
+
+
+/*
+ * 'dequeue_job()' - Remove the next pending job from the heap.
+ *
+ * Jobs that were canceled while queued are dropped.  The printer must be
+ * locked for writing by the caller.
+ */
+
+static server_job_t *			/* O - Next pending job or `NULL` */
+dequeue_job(server_printer_t *printer)	/* I - Printer */
+{
+  server_job_t	*job;			/* Next job */
+
+
+  while (printer->num_pending > 0)
+  {
+    job              = printer->pending_jobs[0];
+    job->queue_index = -1;
+
+    if (-- printer->num_pending > 0)
+    {
+      printer->pending_jobs[0] = printer->pending_jobs[printer->num_pending];
+      printer->pending_jobs[0]->queue_index = 0;
+
+      move_queued_job(printer, 0);
+    }
+
+    if (job->state == IPP_JSTATE_PENDING)
+      return (job);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'expire_job()' - Remove a completed job from the job history.
+ */
+
+static void
+expire_job(server_printer_t *printer,	/* I - Printer */
+           int              id)		/* I - Job ID */
+{
+  server_job_t	*job;			/* Matching job */
+
+
+  _cupsRWLockWrite(&(printer->rwlock));
+  if ((job = serverLookupJob(printer, id)) != NULL && job->completed && job->fd >= 0)
+  {
+   /*
+    * Still receiving document data for a streamed job, try again later...
+    */
+
+    serverAddTimer(&job->timer, time(NULL) + 60, (server_timer_cb_t)expire_job, printer, job->id);
+  }
+  else if (job && job->completed)
+  {
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Cleaning job #%d.", job->id);
+    serverArchiveJob(job);
+    cupsArrayRemove(printer->completed_jobs, job);
+    cupsArrayRemove(printer->jobs, job); /* Last since removing a job from here calls serverDeleteJob() */
+  }
+  _cupsRWUnlock(&(printer->rwlock));
+}
+
+
+/*
+ * 'index_job()' - Add a job to the job-id index.
+ *
+ * The index is an open-addressed hash table with linear probing.  Job IDs are
+ * assigned sequentially, so the job-id itself is used as the hash and
+ * consecutive jobs land in consecutive slots.  The table is kept at most half
+ * full.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+index_job(server_printer_t *printer,	/* I - Printer */
+          server_job_t     *job)	/* I - Job */
+{
+  int	mask,				/* Mask for index */
+	current;			/* Current slot */
+
+
+  if ((printer->job_index_count + 1) * 2 > printer->job_index_size)
+  {
+   /*
+    * Grow the index...
+    */
+
+    server_job_t	**temp,		/* New index */
+			**old = printer->job_index;
+					/* Old index */
+    int			i,		/* Looping var */
+			size = printer->job_index_size ? 2 * printer->job_index_size : 256;
+					/* New size */
+
+    if ((temp = calloc((size_t)size, sizeof(server_job_t *))) == NULL)
+      return (0);
+
+    mask = size - 1;
+
+    for (i = 0; i < printer->job_index_size; i ++)
+    {
+      if (!old[i])
+        continue;
+
+      for (current = old[i]->id & mask; temp[current]; current = (current + 1) & mask);
+
+      temp[current] = old[i];
+    }
+
+    free(old);
+
+    printer->job_index      = temp;
+    printer->job_index_size = size;
+  }
+
+  mask = printer->job_index_size - 1;
+
+  for (current = job->id & mask; printer->job_index[current]; current = (current + 1) & mask);
+
+  printer->job_index[current] = job;
+  printer->job_index_count ++;
+
+  return (1);
+}
+
+
+/*
+ * 'move_queued_job()' - Move a job up or down to its place in the heap.
+ */
+
+static void
+move_queued_job(
+    server_printer_t *printer,		/* I - Printer */
+    int              current)		/* I - Current index of job */
+{
+  server_job_t	**heap = printer->pending_jobs,
+					/* Heap array */
+		*job = heap[current];	/* Job to move */
+  int		parent,			/* Parent index */
+		child;			/* Child index */
+
+
+  while (current > 0)
+  {
+    parent = (current - 1) / 2;
+
+    if (compare_queued_jobs(job, heap[parent]) >= 0)
+      break;
+
+    heap[current]              = heap[parent];
+    heap[current]->queue_index = current;
+    current                    = parent;
+  }
+
+  while ((child = 2 * current + 1) < printer->num_pending)
+  {
+    if (child + 1 < printer->num_pending && compare_queued_jobs(heap[child + 1], heap[child]) < 0)
+      child ++;
+
+    if (compare_queued_jobs(heap[child], job) >= 0)
+      break;
+
+    heap[current]              = heap[child];
+    heap[current]->queue_index = current;
+    current                    = child;
+  }
+
+  heap[current]    = job;
+  job->queue_index = current;
+}
+
+
+/*
+ * 'run_slot()' - Process pending jobs for a printer.
+ */
+
+static void *				/* O - Thread exit status */
+run_slot(server_printer_t *printer)	/* I - Printer */
+{
+  server_job_t	*job;			/* Job to process */
+
+
+  _cupsMutexLock(&printer->slot_mutex);
+
+  for (;;)
+  {
+   /*
+    * Claim the next pending job, if any...
+    */
+
+    _cupsRWLockWrite(&printer->rwlock);
+    if ((job = dequeue_job(printer)) != NULL)
+      job->state = IPP_JSTATE_PROCESSING;
+    _cupsRWUnlock(&printer->rwlock);
+
+    if (!job)
+    {
+      _cupsCondWait(&printer->slot_cond, &printer->slot_mutex, 0.0);
+      continue;
+    }
+
+    _cupsMutexUnlock(&printer->slot_mutex);
+
+    serverProcessJob(job);
+
+    _cupsMutexLock(&printer->slot_mutex);
   }
 
   return (NULL);
 }
+
+
+/*
+ * 'set_spool_reasons()' - Set the spool "printer-state-reasons" values.
+ *
+ * A "printer-state-changed" event is sent from the main loop when the
+ * values change.  The spool mutex must be locked by the caller.
+ */
+
+static void
+set_spool_reasons(
+    server_printer_t *printer,		/* I - Printer */
+    server_preason_t reasons)		/* I - New reasons */
+{
+  if (printer->spool_reasons == reasons)
+    return;
+
+  printer->spool_reasons = reasons;
+
+  serverAddTimer(&printer->spool_timer, time(NULL), (server_timer_cb_t)spool_event, printer, 0);
+}
+
+
+/*
+ * 'spool_event()' - Send a "printer-state-changed" event for the spool.
+ */
+
+static void
+spool_event(server_printer_t *printer,	/* I - Printer */
+            int              id)	/* I - Timer ID (unused) */
+{
+  server_preason_t	reasons;	/* Spool reasons */
+
+
+  (void)id;
+
+  _cupsMutexLock(&spool_mutex);
+  reasons = printer->spool_reasons;
+  _cupsMutexUnlock(&spool_mutex);
+
+  _cupsRWLockWrite(&printer->rwlock);
+  printer->state_time = time(NULL);
+  _cupsRWUnlock(&printer->rwlock);
+
+  serverAddEvent(printer, NULL, SERVER_EVENT_PRINTER_STATE_CHANGED, (reasons & SERVER_PREASON_SPOOL_AREA_FULL) ? "Spool area is full." : "Spool area is no longer full.");
+}
@@ -0,0 +1,835 @@
+/*
+ * Job journal support for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#include "ippserver.h"
+
+
+/*
+ * The job journal is an append-only file ("jobs.journal" in the spool
+ * directory) that records the state of every queued job so that the job
+ * queues can be rebuilt after a restart.  Each record is an IPP message whose
+ * request-id holds the record type, whose operation group holds the job's
+ * printer, ID, state, times, and assigned output device, and (for job
+ * records) whose job group holds a copy of the job attributes.  Records
+ * contain absolute values, so replaying a record more than once does no harm.  Jobs are recorded when
+ * they are created, so that their job-id values are never reused, and
+ * snapshots start each printer with a record of its next job-id.
+ *
+ * Records are appended to an in-memory buffer while the printer is locked,
+ * and a journal thread writes and syncs the buffer to disk.  Requests that
+ * need a job to be durable wait in serverSyncJournal() after unlocking the
+ * printer, so all of the records added while the previous batch was being
+ * synced share a single fsync.
+ *
+ * Every SERVER_JOURNAL_SNAPSHOT records the journal thread writes the
+ * current state of all jobs to a new file and renames it over the journal,
+ * which bounds the time needed to replay the journal at startup.
+ */
+
+#define SERVER_JOURNAL_JOB	1	/* Job record with attributes */
+#define SERVER_JOURNAL_STATE	2	/* Job state record */
+#define SERVER_JOURNAL_PRINTER	3	/* Printer record */
+#define SERVER_JOURNAL_SNAPSHOT	10000	/* Records between snapshots */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct server_jbuffer_s		/**** Journal buffer ****/
+{
+  ipp_uchar_t	*data;			/* Buffered data */
+  size_t	used,			/* Bytes used */
+		alloc;			/* Bytes allocated */
+} server_jbuffer_t;
+
+
+/*
+ * Local globals...
+ */
+
+static _cups_mutex_t	journal_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for journal */
+static _cups_cond_t	journal_cond = _CUPS_COND_INITIALIZER,
+					/* Condition for journal thread */
+			journal_sync_cond = _CUPS_COND_INITIALIZER;
+					/* Condition for synced records */
+static server_jbuffer_t	journal_buffer = { NULL, 0, 0 };
+					/* Records waiting to be written */
+static int		journal_fd = -1;/* Journal file */
+static char		journal_filename[1024] = "";
+					/* Journal filename */
+static int		journal_running = 0;
+					/* Is the journal thread running? */
+static int		journal_seq = 0,/* Number of records added */
+			journal_snapshot_seq = 0,
+					/* Record number at last snapshot */
+			journal_synced = 0;
+					/* Number of records synced */
+
+
+/*
+ * Local functions...
+ */
+
+static int	add_printer_record(server_jbuffer_t *buffer, server_printer_t *printer);
+static int	add_record(server_jbuffer_t *buffer, server_job_t *job, int type);
+static void	apply_record(ipp_t *record);
+static void	recover_jobs(void);
+static void	*run_journal(void *data);
+static ssize_t	write_buffer(server_jbuffer_t *buffer, ipp_uchar_t *data, size_t length);
+static int	write_data(int fd, server_jbuffer_t *buffer);
+static int	write_snapshot(void);
+
+
+/*
+ * 'serverJournalJob()' - Add a job record to the journal.
+ *
+ * When "full" is non-zero the job's attributes and spool file are recorded
+ * along with its state.  The printer must be locked by the caller.
+ */
+
+void
+serverJournalJob(server_job_t *job,	/* I - Job */
+                 int          full)	/* I - Record job attributes? */
+{
+  server_jbuffer_t	record = { NULL, 0, 0 };
+					/* Encoded record */
+
+
+  if (!journal_running)
+    return;
+
+  if (!add_record(&record, job, full ? SERVER_JOURNAL_JOB : SERVER_JOURNAL_STATE))
+  {
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to add job to journal.");
+    free(record.data);
+    return;
+  }
+
+  _cupsMutexLock(&journal_mutex);
+
+  if (write_buffer(&journal_buffer, record.data, record.used) > 0)
+  {
+    journal_seq ++;
+    _cupsCondBroadcast(&journal_cond);
+  }
+  else
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to add job to journal.");
+
+  _cupsMutexUnlock(&journal_mutex);
+
+  free(record.data);
+}
+
+
+/*
+ * 'serverOpenJournal()' - Replay the job journal and start journaling.
+ *
+ * This function is called once after the printers have been created.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+serverOpenJournal(void)
+{
+  cups_file_t	*fp;			/* Journal file */
+  ipp_t		*record;		/* Current record */
+  ipp_state_t	state;			/* Read state */
+  int		num_records = 0;	/* Number of records */
+  off_t		pos;			/* Offset of current record */
+  _cups_thread_t tid;			/* Journal thread */
+
+
+  if (!JobJournal)
+    return (1);
+
+  snprintf(journal_filename, sizeof(journal_filename), "%s/jobs.journal", SpoolDirectory);
+
+ /*
+  * Replay any existing journal...
+  */
+
+  if ((fp = cupsFileOpen(journal_filename, "r")) != NULL)
+  {
+    for (;;)
+    {
+      pos    = cupsFileTell(fp);
+      record = ippNew();
+
+      while ((state = ippReadIO(fp, (ipp_iocb_t)cupsFileRead, 1, NULL, record)) != IPP_STATE_DATA)
+      {
+        if (state == IPP_STATE_ERROR)
+	  break;
+      }
+
+      if (state != IPP_STATE_DATA)
+      {
+        if (cupsFileTell(fp) > pos)
+	  serverLog(SERVER_LOGLEVEL_ERROR, "Ignoring incomplete record at end of job journal \"%s\".", journal_filename);
+
+        ippDelete(record);
+        break;
+      }
+
+      apply_record(record);
+      ippDelete(record);
+
+      num_records ++;
+    }
+
+    cupsFileClose(fp);
+
+    serverLog(SERVER_LOGLEVEL_INFO, "Replayed %d records from job journal \"%s\".", num_records, journal_filename);
+
+    recover_jobs();
+  }
+  else if (errno != ENOENT)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to open job journal \"%s\": %s", journal_filename, strerror(errno));
+    return (0);
+  }
+
+ /*
+  * Start with a fresh snapshot of the recovered jobs...
+  */
+
+  if (!write_snapshot())
+    return (0);
+
+  journal_running = 1;
+
+  if ((tid = _cupsThreadCreate((_cups_thread_func_t)run_journal, NULL)) == 0)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create job journal thread: %s", strerror(errno));
+    journal_running = 0;
+    return (0);
+  }
+
+  _cupsThreadDetach(tid);
+
+  return (1);
+}
+
+
+/*
+ * 'serverSyncJournal()' - Wait for all journal records to be synced to disk.
+ *
+ * The caller must not hold any printer locks.
+ */
+
+void
+serverSyncJournal(void)
+{
+  int	seq;				/* Record number to wait for */
+
+
+  if (!journal_running)
+    return;
+
+  _cupsMutexLock(&journal_mutex);
+
+  seq = journal_seq;
+
+  while (journal_synced < seq)
+    _cupsCondWait(&journal_sync_cond, &journal_mutex, 0.0);
+
+  _cupsMutexUnlock(&journal_mutex);
+}
+
+
+/*
+ * 'add_printer_record()' - Encode a printer record.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+add_printer_record(
+    server_jbuffer_t *buffer,		/* I - Buffer */
+    server_printer_t *printer)		/* I - Printer */
+{
+  ipp_t		*record;		/* Journal record */
+  ipp_state_t	state;			/* Write state */
+
+
+  record = ippNew();
+
+  ippSetRequestId(record, SERVER_JOURNAL_PRINTER);
+
+  ippAddString(record, IPP_TAG_OPERATION, IPP_TAG_NAME, "printer-name", NULL, printer->name);
+  ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "next-job-id", printer->next_job_id);
+
+  while ((state = ippWriteIO(buffer, (ipp_iocb_t)write_buffer, 1, NULL, record)) != IPP_STATE_DATA)
+  {
+    if (state == IPP_STATE_ERROR)
+      break;
+  }
+
+  ippDelete(record);
+
+  return (state == IPP_STATE_DATA);
+}
+
+
+/*
+ * 'add_record()' - Encode a job record.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+add_record(server_jbuffer_t *buffer,	/* I - Buffer */
+           server_job_t     *job,	/* I - Job */
+           int              type)	/* I - Record type */
+{
+  ipp_t		*record;		/* Journal record */
+  ipp_state_t	state;			/* Write state */
+
+
+  record = ippNew();
+
+  ippSetRequestId(record, type);
+
+  ippAddString(record, IPP_TAG_OPERATION, IPP_TAG_NAME, "printer-name", NULL, job->printer->name);
+  ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "job-id", job->id);
+  ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_ENUM, "job-state", (int)job->state);
+  serverCopyJobStateReasons(record, IPP_TAG_OPERATION, job);
+  ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "job-impressions-completed", job->impcompleted);
+  ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "time-at-processing", (int)job->processing);
+  ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "time-at-completed", (int)job->completed);
+  if (job->dev_uuid)
+    ippAddString(record, IPP_TAG_OPERATION, IPP_TAG_URI, "output-device-uuid-assigned", NULL, job->dev_uuid);
+
+  if (type == SERVER_JOURNAL_JOB)
+  {
+    ippAddInteger(record, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "time-at-creation", (int)job->created);
+    if (job->filename)
+      ippAddString(record, IPP_TAG_OPERATION, IPP_TAG_TEXT, "job-filename", NULL, job->filename);
+
+    serverCopyAttributes(record, job->attrs, NULL, NULL, IPP_TAG_JOB, 0);
+  }
+
+  while ((state = ippWriteIO(buffer, (ipp_iocb_t)write_buffer, 1, NULL, record)) != IPP_STATE_DATA)
+  {
+    if (state == IPP_STATE_ERROR)
+      break;
+  }
+
+  ippDelete(record);
+
+  return (state == IPP_STATE_DATA);
+}
+
+
+/*
+ * 'apply_record()' - Apply a journal record to the jobs.
+ */
+
+static void
+apply_record(ipp_t *record)		/* I - Journal record */
+{
+  ipp_attribute_t	*attr;		/* Current attribute */
+  const char		*name;		/* Printer name */
+  server_printer_t	*printer;	/* Printer */
+  int			id,		/* job-id */
+			new_job = 0;	/* New job? */
+  server_job_t		*job;		/* Job */
+
+
+ /*
+  * Find the printer and job...
+  */
+
+  if ((name = ippGetString(ippFindAttribute(record, "printer-name", IPP_TAG_NAME), 0, NULL)) == NULL)
+    return;
+
+  for (printer = (server_printer_t *)cupsArrayFirst(Printers); printer; printer = (server_printer_t *)cupsArrayNext(Printers))
+  {
+    if (!strcmp(printer->name, name))
+      break;
+  }
+
+  if (!printer)
+    return;
+
+  if (ippGetRequestId(record) == SERVER_JOURNAL_PRINTER)
+  {
+    if ((id = ippGetInteger(ippFindAttribute(record, "next-job-id", IPP_TAG_INTEGER), 0)) > printer->next_job_id)
+      printer->next_job_id = id;
+
+    return;
+  }
+
+  if ((id = ippGetInteger(ippFindAttribute(record, "job-id", IPP_TAG_INTEGER), 0)) <= 0)
+    return;
+
+ /*
+  * Never reuse a job-id, even if the job is no longer in the journal...
+  */
+
+  if (id >= printer->next_job_id)
+    printer->next_job_id = id + 1;
+
+  if ((job = serverLookupJob(printer, id)) == NULL)
+  {
+    if (ippGetRequestId(record) != SERVER_JOURNAL_JOB)
+      return;
+
+    if ((job = calloc(1, sizeof(server_job_t))) == NULL)
+      return;
+
+    job->id          = id;
+    job->printer     = printer;
+    job->fd          = -1;
+    job->queue_index = -1;
+
+    new_job = 1;
+  }
+
+  if (ippGetRequestId(record) == SERVER_JOURNAL_JOB)
+  {
+   /*
+    * Copy the job attributes...
+    */
+
+    ippDelete(job->attrs);
+    job->attrs = ippNew();
+
+    serverCopyAttributes(job->attrs, record, NULL, NULL, IPP_TAG_JOB, 0);
+
+    free(job->filename);
+    if ((attr = ippFindAttribute(record, "job-filename", IPP_TAG_TEXT)) != NULL)
+      job->filename = strdup(ippGetString(attr, 0, NULL));
+    else
+      job->filename = NULL;
+
+    job->created = (time_t)ippGetInteger(ippFindAttribute(record, "time-at-creation", IPP_TAG_INTEGER), 0);
+
+    if ((attr = ippFindAttribute(job->attrs, "time-at-creation", IPP_TAG_INTEGER)) != NULL)
+      ippSetInteger(job->attrs, &attr, 0, serverGetJobTime(job, job->created));
+
+    if ((attr = ippFindAttribute(job->attrs, "job-priority", IPP_TAG_INTEGER)) != NULL)
+      job->priority = ippGetInteger(attr, 0);
+    else
+      job->priority = 50;
+
+    if ((attr = ippFindAttribute(job->attrs, "job-originating-user-name", IPP_TAG_NAME)) != NULL)
+      job->username = ippGetString(attr, 0, NULL);
+    else
+      job->username = "anonymous";
+
+    if ((attr = ippFindAttribute(job->attrs, "document-format-detected", IPP_TAG_MIMETYPE)) != NULL)
+      job->format = ippGetString(attr, 0, NULL);
+    else if ((attr = ippFindAttribute(job->attrs, "document-format-supplied", IPP_TAG_MIMETYPE)) != NULL)
+      job->format = ippGetString(attr, 0, NULL);
+    else if ((attr = ippFindAttribute(job->attrs, "document-format", IPP_TAG_MIMETYPE)) != NULL)
+      job->format = ippGetString(attr, 0, NULL);
+    else
+      job->format = "application/octet-stream";
+
+    if ((attr = ippFindAttribute(job->attrs, "job-impressions", IPP_TAG_INTEGER)) != NULL)
+      job->impressions = ippGetInteger(attr, 0);
+
+    if ((attr = ippFindAttribute(job->attrs, "job-name", IPP_TAG_NAME)) != NULL)
+      job->name = ippGetString(attr, 0, NULL);
+    else
+      job->name = NULL;
+  }
+
+  if (new_job && !serverAddJob(job))
+  {
+    ippDelete(job->attrs);
+    free(job->filename);
+    free(job);
+    return;
+  }
+
+ /*
+  * Update the job state...
+  */
+
+  job->state         = (ipp_jstate_t)ippGetInteger(ippFindAttribute(record, "job-state", IPP_TAG_ENUM), 0);
+  job->state_reasons = serverGetJobStateReasonsBits(ippFindAttribute(record, "job-state-reasons", IPP_TAG_KEYWORD));
+  job->impcompleted  = ippGetInteger(ippFindAttribute(record, "job-impressions-completed", IPP_TAG_INTEGER), 0);
+  job->processing    = (time_t)ippGetInteger(ippFindAttribute(record, "time-at-processing", IPP_TAG_INTEGER), 0);
+  job->completed     = (time_t)ippGetInteger(ippFindAttribute(record, "time-at-completed", IPP_TAG_INTEGER), 0);
+
+  if ((attr = ippFindAttribute(record, "output-device-uuid-assigned", IPP_TAG_URI)) != NULL && (!job->dev_uuid || strcmp(job->dev_uuid, ippGetString(attr, 0, NULL))))
+  {
+    free(job->dev_uuid);
+    job->dev_uuid = strdup(ippGetString(attr, 0, NULL));
+  }
+}
+
+
+/*
+ * 'recover_jobs()' - Rebuild the job queues after replaying the journal.
+ *
+ * Jobs that were pending or processing are queued again if their spool file
+ * still exists and aborted otherwise.  Completed jobs are kept in the job
+ * history for the rest of their 60 seconds.  Spool files that are still on
+ * disk are charged against the spool quotas.
+ *
+ * Jobs are recovered oldest first so that the oldest completed jobs are the
+ * ones removed when the job history is full.
+ */
+
+static void
+recover_jobs(void)
+{
+  server_printer_t	*printer;	/* Current printer */
+  server_job_t		*job;		/* Current job */
+  time_t		curtime = time(NULL);
+					/* Current time */
+  int			num_jobs;	/* Number of queued jobs */
+  struct stat		fileinfo;	/* Print file information */
+
+
+  for (printer = (server_printer_t *)cupsArrayFirst(Printers); printer; printer = (server_printer_t *)cupsArrayNext(Printers))
+  {
+    num_jobs = 0;
+
+    _cupsRWLockWrite(&printer->rwlock);
+
+    for (job = (server_job_t *)cupsArrayLast(printer->jobs); job; job = (server_job_t *)cupsArrayPrev(printer->jobs))
+    {
+      if (job->filename && !stat(job->filename, &fileinfo))
+        serverUpdateJobSpool(job, fileinfo.st_size, 1);
+
+      if (job->state == IPP_JSTATE_STOPPED)
+      {
+       /*
+        * Fetchable jobs wait for a proxy...
+	*/
+
+        cupsArrayAdd(printer->active_jobs, job);
+        continue;
+      }
+      else if (job->state < IPP_JSTATE_STOPPED)
+      {
+        if (job->filename && !(job->state_reasons & SERVER_JREASON_JOB_INCOMING) && !access(job->filename, R_OK))
+	{
+	  cupsArrayAdd(printer->active_jobs, job);
+	  serverQueueJob(job);
+	  num_jobs ++;
+	  continue;
+	}
+
+        serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Aborting job because the print file is missing or incomplete.");
+
+        job->state         = IPP_JSTATE_ABORTED;
+        job->state_reasons &= (server_jreason_t)~SERVER_JREASON_JOB_INCOMING;
+	job->completed     = curtime;
+      }
+
+      if (job->completed + 60 <= curtime)
+      {
+        serverArchiveJob(job);
+        cupsArrayRemove(printer->jobs, job); /* Removing here calls serverDeleteJob */
+        continue;
+      }
+
+      serverFinishJob(job);
+    }
+
+    _cupsRWUnlock(&printer->rwlock);
+
+    if (num_jobs > 0)
+    {
+      serverLogPrinter(SERVER_LOGLEVEL_INFO, printer, "Recovered %d queued jobs.", num_jobs);
+      serverCheckJobs(printer);
+    }
+  }
+}
+
+
+/*
+ * 'run_journal()' - Write and sync journal records.
+ */
+
+static void *				/* O - Thread exit status */
+run_journal(void *data)			/* I - Thread data (unused) */
+{
+  server_jbuffer_t	batch = { NULL, 0, 0 },
+					/* Records being written */
+			temp;		/* Temporary buffer */
+  int			seq;		/* Last record in batch */
+  int			snapshot,	/* Write a snapshot? */
+			synced,		/* Is the batch on disk? */
+			failed = 0;	/* Did the last batch fail? */
+  int			fd;		/* Journal file before snapshot */
+
+
+  (void)data;
+
+  _cupsMutexLock(&journal_mutex);
+
+  for (;;)
+  {
+    while (!journal_buffer.used && !failed)
+      _cupsCondWait(&journal_cond, &journal_mutex, 0.0);
+
+   /*
+    * Take all of the buffered records...
+    */
+
+    temp           = batch;
+    batch          = journal_buffer;
+    journal_buffer = temp;
+
+    journal_buffer.used = 0;
+
+    seq      = journal_seq;
+    snapshot = failed || (seq - journal_snapshot_seq) >= SERVER_JOURNAL_SNAPSHOT;
+
+    _cupsMutexUnlock(&journal_mutex);
+
+   /*
+    * Write the batch and sync once for all of the records in it.  A failed
+    * write can leave a partial record at the end of the journal that would
+    * stop replay there, so after a failure nothing more is appended and a
+    * snapshot replaces the journal instead.  Snapshots include every change
+    * in the batch, so the old journal is only synced when the snapshot
+    * fails.
+    */
+
+    if ((synced = !failed) != 0 && !write_data(journal_fd, &batch))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to write job journal \"%s\": %s", journal_filename, strerror(errno));
+      synced = 0;
+    }
+
+    batch.used = 0;
+
+    if (snapshot || !synced)
+    {
+      fd = journal_fd;
+
+      if (write_snapshot())
+      {
+        journal_snapshot_seq = seq;
+        synced               = 1;
+      }
+      else if (journal_fd != fd)
+        synced = 0;			/* Replaced but directory not synced */
+      else if (synced && fsync(journal_fd))
+      {
+	serverLog(SERVER_LOGLEVEL_ERROR, "Unable to sync job journal \"%s\": %s", journal_filename, strerror(errno));
+        synced = 0;
+      }
+    }
+    else if (fsync(journal_fd))
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to sync job journal \"%s\": %s", journal_filename, strerror(errno));
+      synced = 0;
+    }
+
+    failed = !synced;
+
+    _cupsMutexLock(&journal_mutex);
+
+    if (synced)
+    {
+      journal_synced = seq;
+      _cupsCondBroadcast(&journal_sync_cond);
+    }
+    else
+    {
+     /*
+      * Retry with a new snapshot in a second...
+      */
+
+      _cupsCondWait(&journal_cond, &journal_mutex, 1.0);
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'write_buffer()' - Append data to a journal buffer.
+ */
+
+static ssize_t				/* O - Number of bytes written or -1 on error */
+write_buffer(server_jbuffer_t *buffer,	/* I - Buffer */
+             ipp_uchar_t      *data,	/* I - Data */
+             size_t           length)	/* I - Number of bytes */
+{
+  if (buffer->used + length > buffer->alloc)
+  {
+    ipp_uchar_t	*temp;			/* New buffer */
+    size_t	alloc;			/* New allocation */
+
+    for (alloc = buffer->alloc ? buffer->alloc : 4096; alloc < (buffer->used + length); alloc *= 2);
+
+    if ((temp = realloc(buffer->data, alloc)) == NULL)
+      return (-1);
+
+    buffer->data  = temp;
+    buffer->alloc = alloc;
+  }
+
+  memcpy(buffer->data + buffer->used, data, length);
+  buffer->used += length;
+
+  return ((ssize_t)length);
+}
+
+
+/*
+ * 'write_data()' - Write a journal buffer to a file.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+write_data(int              fd,		/* I - File descriptor */
+           server_jbuffer_t *buffer)	/* I - Buffer */
+{
+  ipp_uchar_t	*ptr = buffer->data;	/* Pointer into buffer */
+  size_t	remaining = buffer->used;
+					/* Bytes remaining */
+  ssize_t	bytes;			/* Bytes written */
+
+
+  while (remaining > 0)
+  {
+    if ((bytes = write(fd, ptr, remaining)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      return (0);
+    }
+
+    ptr       += bytes;
+    remaining -= (size_t)bytes;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'write_snapshot()' - Write the current jobs to a new journal file.
+ *
+ * Records added while the snapshot is being written are written to the new
+ * file by the journal thread.  If the spool directory can't be synced the
+ * new file is still used but 0 is returned, since the rename may be lost.  Arrays are walked by index since other
+ * threads move their current element, and the printers array (which is not
+ * locked) is copied first.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+write_snapshot(void)
+{
+  char			tempfile[1024];	/* Temporary filename */
+  int			fd,		/* Snapshot file */
+			dirfd;		/* Spool directory */
+  server_jbuffer_t	buffer = { NULL, 0, 0 };
+					/* Snapshot records */
+  cups_array_t		*printers;	/* Copy of printers array */
+  server_printer_t	*printer;	/* Current printer */
+  server_job_t		*job;		/* Current job */
+  int			i,		/* Looping var */
+			count,		/* Number of printers */
+			j,		/* Looping var */
+			jcount,		/* Number of jobs for printer */
+			num_jobs = 0,	/* Number of jobs */
+			status = 1;	/* Return status */
+
+
+  snprintf(tempfile, sizeof(tempfile), "%s.N", journal_filename);
+
+  if ((fd = open(tempfile, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600)) < 0)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create job journal \"%s\": %s", tempfile, strerror(errno));
+    return (0);
+  }
+
+  if ((printers = cupsArrayDup(Printers)) == NULL && Printers)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to copy printers for job journal: %s", strerror(errno));
+    close(fd);
+    unlink(tempfile);
+    return (0);
+  }
+
+  for (i = 0, count = cupsArrayCount(printers); i < count && status; i ++)
+  {
+    printer = (server_printer_t *)cupsArrayIndex(printers, i);
+
+    _cupsRWLockRead(&printer->rwlock);
+
+    if (!add_printer_record(&buffer, printer))
+      status = 0;
+
+    for (j = 0, jcount = cupsArrayCount(printer->jobs); j < jcount && status; j ++)
+    {
+      job = (server_job_t *)cupsArrayIndex(printer->jobs, j);
+
+      if (!add_record(&buffer, job, SERVER_JOURNAL_JOB))
+      {
+        status = 0;
+        break;
+      }
+
+      num_jobs ++;
+    }
+
+    _cupsRWUnlock(&printer->rwlock);
+
+    if (status && buffer.used > 65536)
+    {
+      status      = write_data(fd, &buffer);
+      buffer.used = 0;
+    }
+  }
+
+  cupsArrayDelete(printers);
+
+  if (status)
+    status = write_data(fd, &buffer);
+
+  free(buffer.data);
+
+  if (status)
+    status = !fsync(fd);
+
+  if (status)
+    status = !rename(tempfile, journal_filename);
+
+  if (!status)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to write job journal \"%s\": %s", tempfile, strerror(errno));
+    close(fd);
+    unlink(tempfile);
+    return (0);
+  }
+
+  if (journal_fd >= 0)
+    close(journal_fd);
+
+  journal_fd = fd;
+
+ /*
+  * Sync the spool directory so the rename is durable...
+  */
+
+  if ((dirfd = open(SpoolDirectory, O_RDONLY | O_DIRECTORY)) < 0 || fsync(dirfd))
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to sync spool directory \"%s\": %s", SpoolDirectory, strerror(errno));
+
+    if (dirfd >= 0)
+      close(dirfd);
+
+    return (0);
+  }
+
+  close(dirfd);
+
+  serverLog(SERVER_LOGLEVEL_DEBUG, "Wrote snapshot of %d jobs to job journal \"%s\".", num_jobs, journal_filename);
+
+  return (1);
+}
@@ -291,6 +291,16 @@ main(int  argc,				/* I - Number of command-line args */
     cupsArrayAdd(Printers, printer);
   }
 
+ /*
+  * Load the transform cache and recover any jobs from the job journal...
+  */
+
+  if (!serverOpenTransformCache())
+    return (1);
+
+  if (!serverOpenJournal())
+    return (1);
+
  /*
   * Enter the server main loop...
   */
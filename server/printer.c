@@ -42,7 +42,7 @@ serverCopyPrinterStateReasons(
     ipp_tag_t      group_tag,		/* I - Group */
     server_printer_t *printer)		/* I - Printer */
 {
-  server_preason_t	creasons = printer->state_reasons | printer->dev_reasons;
+  server_preason_t	creasons = printer->state_reasons | printer->dev_reasons | printer->spool_reasons;
 					/* Combined reasons */
 
 
@@ -460,7 +460,16 @@ serverCreatePrinter(
     serverLog(SERVER_LOGLEVEL_DEBUG, "Using duplex=%d", printer->pinfo.duplex);
   }
 
+  if (printer->pinfo.max_active_jobs < 1)
+    printer->pinfo.max_active_jobs = 1;
+
   _cupsRWInit(&(printer->rwlock));
+  _cupsMutexInit(&(printer->slot_mutex));
+  _cupsCondInit(&(printer->slot_cond));
+  _cupsMutexInit(&(printer->state_mutex));
+  _cupsCondInit(&(printer->state_cond));
+  _cupsMutexInit(&(printer->stream_mutex));
+  _cupsCondInit(&(printer->stream_cond));
 
  /*
   * Prepare values for the printer attributes...
@@ -510,10 +519,33 @@ serverCreatePrinter(
   * Create the printer's spool directory...
   */
 
-  snprintf(spooldir, sizeof(spooldir), "%s/%s", SpoolDirectory, printer->name);
+  if (printer->pinfo.spool_directory)
+  {
+    strlcpy(spooldir, printer->pinfo.spool_directory, sizeof(spooldir));
+  }
+  else
+  {
+    snprintf(spooldir, sizeof(spooldir), "%s/%s", SpoolDirectory, printer->name);
+    printer->pinfo.spool_directory = strdup(spooldir);
+  }
+
   if (mkdir(spooldir, 0755) && errno != EEXIST)
     serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create spool directory \"%s\": %s", spooldir, strerror(errno));
 
+  for (i = 0; i < SERVER_SPOOL_SHARDS; i ++)
+  {
+    char	sharddir[1024];		/* Spool subdirectory */
+
+    snprintf(sharddir, sizeof(sharddir), "%s/%02x", spooldir, i);
+    if (mkdir(sharddir, 0755) && errno != EEXIST)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create spool directory \"%s\": %s", sharddir, strerror(errno));
+      break;
+    }
+  }
+
+  serverOpenArchive(printer);
+
  /*
   * Get the maximum spool size based on the size of the filesystem used for
   * the spool directory.  If the host OS doesn't support the statfs call
@@ -1228,6 +1260,13 @@ serverDeletePrinter(server_printer_t *printer)	/* I - Printer */
     free(printer->pinfo.command);
   if (printer->pinfo.device_uri)
     free(printer->pinfo.device_uri);
+  if (printer->pinfo.spool_directory)
+    free(printer->pinfo.spool_directory);
+  if (printer->transform_env)
+  {
+    free(printer->transform_env->data);
+    free(printer->transform_env);
+  }
 
   cupsArrayDelete(printer->pinfo.strings);
 
@@ -1237,8 +1276,18 @@ serverDeletePrinter(server_printer_t *printer)	/* I - Printer */
   cupsArrayDelete(printer->active_jobs);
   cupsArrayDelete(printer->completed_jobs);
   cupsArrayDelete(printer->jobs);
+  cupsArrayDelete(printer->users);
   cupsArrayDelete(printer->subscriptions);
 
+  serverCloseArchive(printer);
+  serverCancelTimer(&printer->spool_timer);
+
+  if (printer->pending_jobs)
+    free(printer->pending_jobs);
+
+  if (printer->job_index)
+    free(printer->job_index);
+
   _cupsRWDeinit(&printer->rwlock);
 
   free(printer);
@@ -1279,39 +1328,84 @@ serverGetPrinterStateReasonsBits(
 }
 
 
+/*
+ * 'serverSignalPrinterStateReasons()' - Wake up jobs waiting for "printer-state-reasons" changes.
+ *
+ * Call this after changing the printer's "printer-state-reasons" values or
+ * canceling a job.
+ */
+
+void
+serverSignalPrinterStateReasons(
+    server_printer_t *printer)		/* I - Printer */
+{
+  _cupsMutexLock(&printer->state_mutex);
+  _cupsCondBroadcast(&printer->state_cond);
+  _cupsMutexUnlock(&printer->state_mutex);
+}
+
+
+/*
+ * 'serverWaitPrinterStateReasons()' - Wait for "printer-state-reasons" values to clear.
+ *
+ * The calling thread sleeps until none of the specified reasons are reported
+ * by the printer or its output device, or until the job is canceled.
+ */
+
+int					/* O - 1 if reasons cleared, 0 if canceled */
+serverWaitPrinterStateReasons(
+    server_printer_t *printer,		/* I - Printer */
+    server_job_t     *job,		/* I - Job */
+    server_preason_t reasons)		/* I - Reasons to wait for */
+{
+  int	ret;				/* Return value */
+
+
+  _cupsMutexLock(&printer->state_mutex);
+
+  while (((printer->state_reasons | printer->dev_reasons) & reasons) && !job->cancel)
+  {
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Waiting for printer-state-reasons 0x%x to clear.", (printer->state_reasons | printer->dev_reasons) & reasons);
+
+    _cupsCondWait(&printer->state_cond, &printer->state_mutex, 0.0);
+  }
+
+  ret = !job->cancel;
+
+  _cupsMutexUnlock(&printer->state_mutex);
+
+  return (ret);
+}
+
+
 /*
  * 'compare_active_jobs()' - Compare two active jobs.
+ *
+ * Active jobs are kept in job-id order so that new jobs are appended to the
+ * end of the array - processing order is managed by the pending job heap.
  */
 
 static int				/* O - Result of comparison */
 compare_active_jobs(server_job_t *a,	/* I - First job */
                     server_job_t *b)	/* I - Second job */
 {
-  int	diff;				/* Difference */
-
-
-  if ((diff = b->priority - a->priority) == 0)
-    diff = b->id - a->id;
-
-  return (diff);
+  return (a->id - b->id);
 }
 
 
 /*
  * 'compare_completed_jobs()' - Compare two completed jobs.
+ *
+ * Completed jobs are also kept in job-id order so that Get-Jobs can return
+ * them newest first without sorting, and the oldest job is the first one
+ * removed when the job history is full.
  */
 
 static int				/* O - Result of comparison */
 compare_completed_jobs(server_job_t *a,	/* I - First job */
                        server_job_t *b)	/* I - Second job */
 {
-  int	diff;				/* Difference */
-
-
-  if ((diff = (int)(a->completed - b->completed)) == 0)
-    diff = b->id - a->id;
-
-  return (diff);
+  return (a->id - b->id);
 }
 
 
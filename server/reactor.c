@@ -0,0 +1,483 @@
+/*
+ * Event-driven client connection support for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#include "ippserver.h"
+
+#ifdef HAVE_EPOLL
+#  include <sys/epoll.h>
+
+
+/*
+ * Local globals...
+ *
+ * Idle clients only cost a socket and a server_client_t - they sit in the
+ * epoll set (one-shot) until data arrives, at which point the main loop queues
+ * them for a worker thread.  When the worker is done with the client it re-arms
+ * the socket in the epoll set.
+ */
+
+static int		reactor_fd = -1;/* epoll file descriptor */
+static _cups_mutex_t	reactor_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for clients and worker queue */
+static _cups_cond_t	reactor_cond = _CUPS_COND_INITIALIZER;
+					/* Condition for worker queue */
+static server_client_t	**reactor_clients = NULL;
+					/* Clients indexed by file descriptor */
+static int		reactor_alloc = 0;
+					/* Allocated client slots */
+static server_client_t	*reactor_first = NULL,
+					/* First client in worker queue */
+			*reactor_last = NULL;
+					/* Last client in worker queue */
+
+
+/*
+ * Local functions...
+ */
+
+static void		arm_client(server_client_t *client, int op);
+static void		expire_clients(void);
+static void		queue_client(server_client_t *client);
+static void		reject_client(server_client_t *client);
+static void		*run_worker(void *data);
+static void		update_listeners(int can_accept);
+
+
+/*
+ * 'serverRunEvents()' - Run the server using an event loop and worker threads.
+ */
+
+void
+serverRunEvents(void)
+{
+  int			i,		/* Looping var */
+			nevents,	/* Number of events */
+			accepting = 1,	/* Accepting new clients? */
+			can_accept;	/* Accept new clients now? */
+  struct epoll_event	events[100];	/* Events from epoll_wait() */
+  server_listener_t	*lis;		/* Listener */
+  server_client_t	*client;	/* New client */
+  time_t		curtime,	/* Current time */
+			next_expire = 0;/* Next time to expire idle clients */
+#ifdef HAVE_DNSSD
+  struct epoll_event	event;		/* Event to add */
+  int			dnssd_fd = DNSServiceRefSockFD(DNSSDMaster);
+					/* DNS-SD file descriptor */
+#endif /* HAVE_DNSSD */
+
+
+  if ((reactor_fd = epoll_create(1024)) < 0)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create event loop: %s", strerror(errno));
+    return;
+  }
+
+  fcntl(reactor_fd, F_SETFD, FD_CLOEXEC);
+
+ /*
+  * Add the listeners and Bonjour service socket to the epoll set...
+  */
+
+  if (AcceptThreads > 1)
+  {
+    if (!serverStartAcceptors())
+      return;
+  }
+  else
+    update_listeners(1);
+
+#ifdef HAVE_DNSSD
+  memset(&event, 0, sizeof(event));
+  event.events  = EPOLLIN;
+  event.data.fd = dnssd_fd;
+
+  epoll_ctl(reactor_fd, EPOLL_CTL_ADD, dnssd_fd, &event);
+#endif /* HAVE_DNSSD */
+
+ /*
+  * Start the worker threads...
+  */
+
+  if (WorkerThreads < 1)
+    WorkerThreads = 1;
+
+  for (i = 0; i < WorkerThreads; i ++)
+  {
+    _cups_thread_t t = _cupsThreadCreate((_cups_thread_func_t)run_worker, NULL);
+
+    if (!t)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create worker thread (%s)", strerror(errno));
+      break;
+    }
+
+    _cupsThreadDetach(t);
+  }
+
+  if (i == 0)
+    return;
+
+  serverLog(SERVER_LOGLEVEL_DEBUG, "serverRunEvents: Started %d worker threads.", i);
+
+ /*
+  * Loop until we are killed or have a hard error...
+  */
+
+  for (;;)
+  {
+   /*
+    * Stop accepting connections while we are at the MaxClients limit - new
+    * connections wait in the listen backlog until a client is closed.  The
+    * acceptor threads do this themselves when AcceptThreads > 1...
+    */
+
+    if (AcceptThreads <= 1)
+    {
+      _cupsMutexLock(&StatsMutex);
+      can_accept = MaxClients <= 0 || Stats.clients < MaxClients;
+      if (accepting && !can_accept)
+      {
+	serverLog(SERVER_LOGLEVEL_INFO, "Too many clients (%d), deferring new connections.", Stats.clients);
+	Stats.deferred ++;
+      }
+      _cupsMutexUnlock(&StatsMutex);
+
+      if (can_accept != accepting)
+      {
+	update_listeners(can_accept);
+	accepting = can_accept;
+      }
+    }
+
+    if ((nevents = epoll_wait(reactor_fd, events, (int)(sizeof(events) / sizeof(events[0])), accepting ? 1000 : 100)) < 0 && errno != EINTR)
+    {
+      serverLog(SERVER_LOGLEVEL_ERROR, "Main loop failed (%s)", strerror(errno));
+      break;
+    }
+
+    for (i = 0; i < nevents; i ++)
+    {
+      int fd = events[i].data.fd;	/* File descriptor */
+
+#ifdef HAVE_DNSSD
+      if (fd == dnssd_fd)
+      {
+	serverLog(SERVER_LOGLEVEL_DEBUG, "serverRunEvents: Input on DNS-SD socket.");
+	DNSServiceProcessResult(DNSSDMaster);
+	continue;
+      }
+#endif /* HAVE_DNSSD */
+
+      _cupsMutexLock(&reactor_mutex);
+      client = fd < reactor_alloc ? reactor_clients[fd] : NULL;
+      _cupsMutexUnlock(&reactor_mutex);
+
+      if (client)
+      {
+       /*
+        * Data (or a hangup) is available for an idle client, hand it to a
+        * worker or reject the request if the workers are too far behind...
+        */
+
+        _cupsMutexLock(&StatsMutex);
+        can_accept = MaxQueuedRequests <= 0 || Stats.queued < MaxQueuedRequests;
+        _cupsMutexUnlock(&StatsMutex);
+
+        if (can_accept)
+          queue_client(client);
+        else
+          reject_client(client);
+        continue;
+      }
+
+      for (lis = (server_listener_t *)cupsArrayFirst(Listeners); lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
+      {
+        if (lis->fd == fd)
+        {
+	  serverLog(SERVER_LOGLEVEL_DEBUG, "serverRunEvents: Incoming connection on listener %s:%d.", lis->host, lis->port);
+
+	  if ((client = serverCreateClient(lis->fd)) != NULL)
+	    serverWatchClient(client);
+	  break;
+        }
+      }
+    }
+
+    curtime = time(NULL);
+
+    if (curtime >= next_expire)
+    {
+      expire_clients();
+
+      next_expire = curtime + 1;
+    }
+
+    serverRunTimers();
+  }
+}
+
+
+/*
+ * 'serverWatchClient()' - Add a new client to the event loop.
+ */
+
+void
+serverWatchClient(
+    server_client_t *client)		/* I - Client */
+{
+  int	fd = httpGetFd(client->http);	/* Client file descriptor */
+
+
+  _cupsMutexLock(&reactor_mutex);
+
+  if (fd >= reactor_alloc)
+  {
+    int			alloc = fd + 1024;
+					/* New number of slots */
+    server_client_t	**temp;		/* New client slots */
+
+    if ((temp = realloc(reactor_clients, (size_t)alloc * sizeof(server_client_t *))) == NULL)
+    {
+      _cupsMutexUnlock(&reactor_mutex);
+
+      serverLogClient(SERVER_LOGLEVEL_ERROR, client, "Unable to allocate memory for client.");
+      serverDeleteClient(client);
+      return;
+    }
+
+    memset(temp + reactor_alloc, 0, (size_t)(alloc - reactor_alloc) * sizeof(server_client_t *));
+
+    reactor_clients = temp;
+    reactor_alloc   = alloc;
+  }
+
+  reactor_clients[fd] = client;
+  client->busy        = 0;
+  client->activity    = time(NULL);
+
+  _cupsMutexUnlock(&reactor_mutex);
+
+  arm_client(client, EPOLL_CTL_ADD);
+}
+
+
+/*
+ * 'arm_client()' - Add or re-arm a client in the epoll set.
+ */
+
+static void
+arm_client(server_client_t *client,	/* I - Client */
+           int             op)		/* I - EPOLL_CTL_ADD or EPOLL_CTL_MOD */
+{
+  struct epoll_event	event;		/* Event */
+
+
+  memset(&event, 0, sizeof(event));
+  event.events  = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  event.data.fd = httpGetFd(client->http);
+
+  if (epoll_ctl(reactor_fd, op, event.data.fd, &event))
+    serverLogClient(SERVER_LOGLEVEL_ERROR, client, "Unable to add client to event loop: %s", strerror(errno));
+}
+
+
+/*
+ * 'expire_clients()' - Close idle client connections that have timed out.
+ */
+
+static void
+expire_clients(void)
+{
+  int			fd;		/* Looping var */
+  server_client_t	*client,	/* Current client */
+			*expired = NULL;/* Expired clients */
+  time_t		timeout = time(NULL) - SERVER_CLIENT_TIMEOUT;
+					/* Oldest allowed activity */
+
+
+  _cupsMutexLock(&reactor_mutex);
+
+  for (fd = 0; fd < reactor_alloc; fd ++)
+  {
+    if ((client = reactor_clients[fd]) != NULL && !client->busy && client->activity < timeout)
+    {
+      epoll_ctl(reactor_fd, EPOLL_CTL_DEL, fd, NULL);
+
+      reactor_clients[fd] = NULL;
+
+      client->next = expired;
+      expired      = client;
+    }
+  }
+
+  _cupsMutexUnlock(&reactor_mutex);
+
+  while ((client = expired) != NULL)
+  {
+    expired = client->next;
+
+    serverLogClient(SERVER_LOGLEVEL_INFO, client, "Closing idle connection.");
+    serverDeleteClient(client);
+  }
+}
+
+
+/*
+ * 'queue_client()' - Queue a client for processing by a worker thread.
+ */
+
+static void
+queue_client(server_client_t *client)	/* I - Client */
+{
+  _cupsMutexLock(&StatsMutex);
+  Stats.queued ++;
+  if (Stats.queued > Stats.queued_max)
+    Stats.queued_max = Stats.queued;
+  _cupsMutexUnlock(&StatsMutex);
+
+  _cupsMutexLock(&reactor_mutex);
+
+  client->busy = 1;
+  client->next = NULL;
+
+  if (reactor_last)
+    reactor_last->next = client;
+  else
+    reactor_first = client;
+
+  reactor_last = client;
+
+  _cupsCondBroadcast(&reactor_cond);
+  _cupsMutexUnlock(&reactor_mutex);
+}
+
+
+/*
+ * 'reject_client()' - Reject a request because the server is busy.
+ *
+ * The main loop cannot block reading the request, so whatever has arrived is
+ * discarded and a canned 503 response is sent before closing the connection.
+ */
+
+static void
+reject_client(server_client_t *client)	/* I - Client */
+{
+  int		fd = httpGetFd(client->http);
+					/* Client file descriptor */
+  char		buffer[8192];		/* Discard/response buffer */
+
+
+  _cupsMutexLock(&reactor_mutex);
+  reactor_clients[fd] = NULL;
+  _cupsMutexUnlock(&reactor_mutex);
+
+  epoll_ctl(reactor_fd, EPOLL_CTL_DEL, fd, NULL);
+
+  _cupsMutexLock(&StatsMutex);
+  Stats.rejected ++;
+  _cupsMutexUnlock(&StatsMutex);
+
+  serverLogClient(SERVER_LOGLEVEL_INFO, client, "Server busy, rejecting request.");
+
+  while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0);
+
+  if (!httpIsEncrypted(client->http))
+  {
+    snprintf(buffer, sizeof(buffer), "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\nRetry-After: %d\r\n\r\n", SERVER_CLIENT_RETRY_AFTER);
+
+    if (send(fd, buffer, strlen(buffer), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+      serverLogClient(SERVER_LOGLEVEL_DEBUG, client, "Unable to send busy response: %s", strerror(errno));
+  }
+
+  serverDeleteClient(client);
+}
+
+
+/*
+ * 'run_worker()' - Process queued clients.
+ */
+
+static void *				/* O - Thread exit status */
+run_worker(void *data)			/* I - Thread data (unused) */
+{
+  server_client_t	*client;	/* Current client */
+
+
+  (void)data;
+
+  for (;;)
+  {
+   /*
+    * Wait for a client with pending input...
+    */
+
+    _cupsMutexLock(&reactor_mutex);
+
+    while (!reactor_first)
+      _cupsCondWait(&reactor_cond, &reactor_mutex, 0.0);
+
+    client        = reactor_first;
+    reactor_first = client->next;
+
+    if (!reactor_first)
+      reactor_last = NULL;
+
+    _cupsMutexUnlock(&reactor_mutex);
+
+    _cupsMutexLock(&StatsMutex);
+    Stats.queued --;
+    _cupsMutexUnlock(&StatsMutex);
+
+   /*
+    * Process requests, then either re-arm or close the connection...
+    */
+
+    if (serverProcessClientInput(client))
+    {
+      _cupsMutexLock(&reactor_mutex);
+      client->busy = 0;
+      _cupsMutexUnlock(&reactor_mutex);
+
+      arm_client(client, EPOLL_CTL_MOD);
+    }
+    else
+    {
+      _cupsMutexLock(&reactor_mutex);
+      reactor_clients[httpGetFd(client->http)] = NULL;
+      _cupsMutexUnlock(&reactor_mutex);
+
+      serverDeleteClient(client);
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'update_listeners()' - Add or remove the listeners from the epoll set.
+ */
+
+static void
+update_listeners(int can_accept)	/* I - 1 to accept new clients, 0 to defer */
+{
+  server_listener_t	*lis;		/* Listener */
+  struct epoll_event	event;		/* Event */
+
+
+  for (lis = (server_listener_t *)cupsArrayFirst(Listeners); lis; lis = (server_listener_t *)cupsArrayNext(Listeners))
+  {
+    memset(&event, 0, sizeof(event));
+    event.events  = EPOLLIN;
+    event.data.fd = lis->fd;
+
+    epoll_ctl(reactor_fd, can_accept ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, lis->fd, &event);
+  }
+}
+#endif /* HAVE_EPOLL */
@@ -16,6 +16,7 @@
  */
 
 static int	compare_subscriptions(server_subscription_t *a, server_subscription_t *b);
+static void	expire_subscription(server_printer_t *printer, int id);
 
 
 /*
@@ -118,7 +119,7 @@ serverCreateSubcription(
     server_printer_t *printer,		/* I - Printer */
     server_job_t     *job,		/* I - Job, if any */
     int              interval,		/* I - Interval for progress events */
-    int              lease,		/* I - Lease duration */
+    int              lease,		/* I - Lease duration (printer subscriptions only) */
     const char       *username,		/* I - User creating the subscription */
     ipp_attribute_t  *notify_events,	/* I - Events to monitor */
     ipp_attribute_t  *notify_attributes,/* I - Attributes to report */
@@ -148,15 +149,20 @@ serverCreateSubcription(
   sub->printer  = printer;
   sub->job      = job;
   sub->interval = interval;
-  sub->lease    = lease;
   sub->attrs    = ippNew();
 
   serverLog(SERVER_LOGLEVEL_DEBUG, "serverCreateSubscription: notify-subscription-id=%d, printer=%p(%s)", sub->id, (void *)printer, printer ? printer->name : "(null)");
 
-  if (lease)
-    sub->expire = time(NULL) + sub->lease;
-  else
+  if (job)
+  {
+   /*
+    * Per-job subscriptions have no lease and are deleted along with the job...
+    */
+
     sub->expire = INT_MAX;
+  }
+  else
+    serverRenewSubscription(sub, lease);
 
   _cupsRWInit(&(sub->rwlock));
 
@@ -238,6 +244,8 @@ serverDeleteSubscription(
 {
   sub->pending_delete = 1;
 
+  serverCancelTimer(&sub->timer);
+
   serverLog(SERVER_LOGLEVEL_DEBUG, "Broadcasting deleted subscription.");
   _cupsCondBroadcast(&SubscriptionCondition);
 
@@ -340,6 +348,34 @@ serverGetNotifySubscribedEvent(
 }
 
 
+/*
+ * 'serverRenewSubscription()' - Set the lease duration of a subscription.
+ *
+ * A lease duration of 0 means the subscription never expires.
+ */
+
+void
+serverRenewSubscription(
+    server_subscription_t *sub,		/* I - Subscription */
+    int                   lease)	/* I - notify-lease-duration value */
+{
+  sub->lease = lease;
+
+  if (lease)
+  {
+    sub->expire = time(NULL) + lease;
+
+    serverAddTimer(&sub->timer, sub->expire, (server_timer_cb_t)expire_subscription, sub->printer, sub->id);
+  }
+  else
+  {
+    sub->expire = INT_MAX;
+
+    serverCancelTimer(&sub->timer);
+  }
+}
+
+
 /*
  * 'compare_subscriptions()' - Compare two subscriptions.
  */
@@ -351,3 +387,30 @@ compare_subscriptions(
 {
   return (b->id - a->id);
 }
+
+
+/*
+ * 'expire_subscription()' - Delete a subscription whose lease has expired.
+ */
+
+static void
+expire_subscription(
+    server_printer_t *printer,		/* I - Printer */
+    int              id)		/* I - Subscription ID */
+{
+  server_subscription_t	key,		/* Search key */
+			*sub;		/* Matching subscription */
+
+
+  key.id = id;
+
+  _cupsRWLockWrite(&printer->rwlock);
+  if ((sub = (server_subscription_t *)cupsArrayFind(printer->subscriptions, &key)) != NULL && sub->expire <= time(NULL))
+  {
+    serverLog(SERVER_LOGLEVEL_DEBUG, "Subscription #%d has expired.", sub->id);
+
+    cupsArrayRemove(printer->subscriptions, sub);
+    serverDeleteSubscription(sub);
+  }
+  _cupsRWUnlock(&printer->rwlock);
+}
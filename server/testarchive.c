@@ -0,0 +1,195 @@
+/*
+ * Job archive test program for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ *
+ * Usage:
+ *
+ *   ./testarchive
+ *
+ * Archives jobs for several users out of job-id order and then reads them
+ * back with the Get-Jobs filters, before and after reopening the archive.
+ */
+
+#define _MAIN_C_
+#include "testsupport.h"
+
+
+/*
+ * Local functions...
+ */
+
+static int	test_read(const char *title, server_printer_t *printer, ipp_jstate_t state, int comparison, const char *username, int scan, const char *expected);
+
+
+/*
+ * 'main()' - Main entry.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*jobs[7];	/* Jobs */
+  char			filename[1024];	/* Archive filename */
+  struct stat		before,		/* Archive information before */
+			after;		/* Archive information after */
+  int			status = 0;	/* Exit status */
+  static const int	order[] = { 3, 1, 5, 2, 4, 6 };
+					/* Order to archive jobs */
+  int			i;		/* Looping var */
+
+
+  if (!testCreateSpoolDirectory("testarchive"))
+    return (1);
+
+  JobArchive = 1;
+
+  fputs("    serverOpenArchive: ", stdout);
+  if ((printer = testCreatePrinter("test")) == NULL || printer->archive_fd < 0)
+  {
+    puts("FAIL");
+    testRemoveSpoolDirectory();
+    return (1);
+  }
+  puts("PASS");
+
+ /*
+  * Jobs 1, 3, and 5 belong to alice, 2 and 4 to bob, and 6 to carol...
+  */
+
+  _cupsRWLockWrite(&printer->rwlock);
+
+  jobs[1] = testCreateJob(printer, 1, IPP_JSTATE_COMPLETED, "alice");
+  jobs[2] = testCreateJob(printer, 2, IPP_JSTATE_COMPLETED, "bob");
+  jobs[3] = testCreateJob(printer, 3, IPP_JSTATE_COMPLETED, "alice");
+  jobs[4] = testCreateJob(printer, 4, IPP_JSTATE_ABORTED, "bob");
+  jobs[5] = testCreateJob(printer, 5, IPP_JSTATE_CANCELED, "alice");
+  jobs[6] = testCreateJob(printer, 6, IPP_JSTATE_COMPLETED, "carol");
+
+  fputs("    serverArchiveJob: ", stdout);
+
+  for (i = 0; i < (int)(sizeof(order) / sizeof(order[0])); i ++)
+    serverArchiveJob(jobs[order[i]]);
+
+  puts("PASS");
+
+  fputs("    Archive job again: ", stdout);
+
+  snprintf(filename, sizeof(filename), "%s/history.attrs", printer->pinfo.spool_directory);
+  stat(filename, &before);
+  serverArchiveJob(jobs[3]);
+  stat(filename, &after);
+
+  if (after.st_size != before.st_size)
+  {
+    printf("FAIL (%ld bytes added)\n", (long)(after.st_size - before.st_size));
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  _cupsRWUnlock(&printer->rwlock);
+
+  status |= test_read("All jobs", printer, IPP_JSTATE_CANCELED, 1, NULL, SERVER_ARCHIVE_SCAN, "6,5,4,3,2,1");
+  status |= test_read("Aborted jobs", printer, IPP_JSTATE_ABORTED, 0, NULL, SERVER_ARCHIVE_SCAN, "4");
+  status |= test_read("Aborted jobs, limited scan", printer, IPP_JSTATE_ABORTED, 0, NULL, 2, "");
+  status |= test_read("Jobs for alice", printer, IPP_JSTATE_CANCELED, 1, "alice", SERVER_ARCHIVE_SCAN, "5,3,1");
+  status |= test_read("Completed jobs for alice", printer, IPP_JSTATE_COMPLETED, 0, "ALICE", SERVER_ARCHIVE_SCAN, "3,1");
+  status |= test_read("Jobs for bob", printer, IPP_JSTATE_CANCELED, 1, "bob", SERVER_ARCHIVE_SCAN, "4,2");
+  status |= test_read("Jobs for dave", printer, IPP_JSTATE_CANCELED, 1, "dave", SERVER_ARCHIVE_SCAN, "");
+
+ /*
+  * Reopen the archive and check that the user index is rebuilt...
+  */
+
+  fputs("    Reopen archive: ", stdout);
+
+  serverCloseArchive(printer);
+  printer->next_job_id = 1;
+  serverOpenArchive(printer);
+
+  if (printer->archive_fd < 0)
+  {
+    puts("FAIL (not opened)");
+    status = 1;
+  }
+  else if (printer->next_job_id != 7)
+  {
+    printf("FAIL (next-job-id %d, expected 7)\n", printer->next_job_id);
+    status = 1;
+  }
+  else if (cupsArrayCount(printer->archive_users) != 3)
+  {
+    printf("FAIL (%d users, expected 3)\n", cupsArrayCount(printer->archive_users));
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  status |= test_read("Jobs for alice after reopen", printer, IPP_JSTATE_CANCELED, 1, "alice", SERVER_ARCHIVE_SCAN, "5,3,1");
+  status |= test_read("Jobs for carol after reopen", printer, IPP_JSTATE_CANCELED, 1, "carol", SERVER_ARCHIVE_SCAN, "6");
+
+  serverCloseArchive(printer);
+  testRemoveSpoolDirectory();
+
+  return (status);
+}
+
+
+/*
+ * 'test_read()' - Read archived jobs and compare the job-id values.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_read(const char       *title,	/* I - Test title */
+          server_printer_t *printer,	/* I - Printer */
+          ipp_jstate_t     state,	/* I - Job state to match */
+          int              comparison,	/* I - State comparison */
+          const char       *username,	/* I - User name or `NULL` */
+          int              scan,	/* I - Records that can be skipped */
+          const char       *expected)	/* I - Expected job-id values */
+{
+  server_job_t	job;			/* Archived job */
+  int		id;			/* Current job-id */
+  char		ids[256],		/* Actual job-id values */
+		*idsptr = ids;		/* Pointer into job-id values */
+
+
+  printf("    %s: ", title);
+
+  ids[0] = '\0';
+
+  _cupsRWLockRead(&printer->rwlock);
+
+  for (id = serverReadArchivedJob(printer, INT_MAX, 1, state, comparison, username, &scan, &job); id; id = serverReadArchivedJob(printer, id, 1, state, comparison, username, &scan, &job))
+  {
+    if (!job.attrs || !job.username || strcasecmp(job.username, username ? username : job.username))
+    {
+      printf("FAIL (job #%d not loaded)\n", id);
+      ippDelete(job.attrs);
+      _cupsRWUnlock(&printer->rwlock);
+      return (1);
+    }
+
+    snprintf(idsptr, sizeof(ids) - (size_t)(idsptr - ids), "%s%d", idsptr > ids ? "," : "", id);
+    idsptr += strlen(idsptr);
+
+    ippDelete(job.attrs);
+  }
+
+  _cupsRWUnlock(&printer->rwlock);
+
+  if (strcmp(ids, expected))
+  {
+    printf("FAIL (got \"%s\", expected \"%s\")\n", ids, expected);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
@@ -0,0 +1,272 @@
+/*
+ * Transform cache test program for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ *
+ * Usage:
+ *
+ *   ./testcache
+ *
+ * Caches transform output for several jobs in a temporary spool directory,
+ * checking which jobs share cached output, that the "ATTR:" messages are
+ * replayed, and that the least-recently used output is removed first.
+ */
+
+#define _MAIN_C_
+#include "testsupport.h"
+
+
+/*
+ * Local functions...
+ */
+
+static server_job_t	*create_job(server_printer_t *printer, int id, const char *document);
+static int		test_add(const char *title, server_job_t *job, const char *format, const char *output, const char *attrs);
+static int		test_find(const char *title, server_job_t *job, const char *format, const char *output, const char *attrs);
+
+
+/*
+ * 'main()' - Main entry.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*jobs[9];	/* Jobs */
+  int			status = 0;	/* Exit status */
+  static const char	*output40 = "0123456789012345678901234567890123456789";
+					/* 40 bytes of output */
+
+
+  if (!testCreateSpoolDirectory("testcache"))
+    return (1);
+
+  TransformCacheSize = 100;
+
+  fputs("    serverOpenTransformCache: ", stdout);
+  if (!serverOpenTransformCache() || (printer = testCreatePrinter("test")) == NULL)
+  {
+    puts("FAIL");
+    testRemoveSpoolDirectory();
+    return (1);
+  }
+  puts("PASS");
+
+ /*
+  * Jobs 1 to 3 print the same document, job 3 with different options...
+  */
+
+  _cupsRWLockWrite(&printer->rwlock);
+
+  jobs[1] = create_job(printer, 1, "Document A");
+  jobs[2] = create_job(printer, 2, "Document A");
+  jobs[3] = create_job(printer, 3, "Document A");
+  jobs[4] = create_job(printer, 4, "Document B");
+  jobs[5] = create_job(printer, 5, "Document C");
+  jobs[6] = create_job(printer, 6, "Document D");
+  jobs[7] = create_job(printer, 7, "Document E");
+  jobs[8] = create_job(printer, 8, "Document F");
+
+  ippAddString(jobs[3]->attrs, IPP_TAG_JOB, IPP_TAG_KEYWORD, "sides", NULL, "two-sided-long-edge");
+
+  _cupsRWUnlock(&printer->rwlock);
+
+  status |= test_add("Cache miss", jobs[1], "image/pwg-raster", "Raster A", "ATTR: job-impressions=1\n");
+  status |= test_find("Cache hit", jobs[1], "image/pwg-raster", "Raster A", "ATTR: job-impressions=1\n");
+  status |= test_find("Same document in another job", jobs[2], "image/pwg-raster", "Raster A", "ATTR: job-impressions=1\n");
+  status |= test_find("Different format", jobs[1], "image/urf", NULL, NULL);
+  status |= test_find("Different job attributes", jobs[3], "image/pwg-raster", NULL, NULL);
+
+  status |= test_add("Empty output", jobs[4], "image/pwg-raster", "", NULL);
+  status |= test_find("Empty output not cached", jobs[4], "image/pwg-raster", NULL, NULL);
+
+ /*
+  * Fill the cache and check that the least-recently used output is removed
+  * first...
+  */
+
+  status |= test_add("Cache job 5", jobs[5], "image/pwg-raster", output40, NULL);
+  status |= test_add("Cache job 6", jobs[6], "image/pwg-raster", output40, NULL);
+  status |= test_find("Use job 1", jobs[1], "image/pwg-raster", "Raster A", "ATTR: job-impressions=1\n");
+  status |= test_add("Cache job 7", jobs[7], "image/pwg-raster", output40, NULL);
+
+  status |= test_find("Least-recently used removed", jobs[5], "image/pwg-raster", NULL, NULL);
+  status |= test_find("Recently used kept", jobs[1], "image/pwg-raster", "Raster A", "ATTR: job-impressions=1\n");
+  status |= test_find("Newer output kept", jobs[6], "image/pwg-raster", output40, NULL);
+  status |= test_find("Newest output kept", jobs[7], "image/pwg-raster", output40, NULL);
+
+ /*
+  * Output larger than the whole cache is not kept...
+  */
+
+  status |= test_add("Oversized output", jobs[8], "image/pwg-raster", "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789+", NULL);
+  status |= test_find("Oversized output not cached", jobs[8], "image/pwg-raster", NULL, NULL);
+  status |= test_find("Cache not flushed", jobs[7], "image/pwg-raster", output40, NULL);
+
+  testRemoveSpoolDirectory();
+
+  return (status);
+}
+
+
+/*
+ * 'create_job()' - Create a job with a document.
+ *
+ * The printer must be locked for writing by the caller.
+ */
+
+static server_job_t *			/* O - Job */
+create_job(server_printer_t *printer,	/* I - Printer */
+           int              id,		/* I - job-id */
+           const char       *document)	/* I - Document data */
+{
+  server_job_t	*job;			/* Job */
+  char		filename[1024];		/* Document file */
+  int		fd;			/* Document file descriptor */
+
+
+  if ((job = testCreateJob(printer, id, IPP_JSTATE_PENDING, "test")) == NULL)
+    return (NULL);
+
+  snprintf(filename, sizeof(filename), "%s/%d.txt", SpoolDirectory, id);
+
+  if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0)
+  {
+    if (write(fd, document, strlen(document)) < 0)
+      perror(filename);
+
+    close(fd);
+  }
+  else
+    perror(filename);
+
+  job->filename = strdup(filename);
+
+  return (job);
+}
+
+
+/*
+ * 'test_add()' - Check for a cache miss and add output for a job.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_add(const char   *title,		/* I - Test title */
+         server_job_t *job,		/* I - Job */
+         const char   *format,		/* I - Output format */
+         const char   *output,		/* I - Output data */
+         const char   *attrs)		/* I - "ATTR:" messages */
+{
+  int		fd;			/* Output file descriptor */
+  char		key[256],		/* Cache key */
+		cattrs[1024],		/* Cached "ATTR:" messages */
+		tempfile[1024];		/* Temporary file */
+  size_t	length = strlen(output);/* Length of output */
+
+
+  printf("    %s: ", title);
+
+  if ((fd = serverFindCachedTransform(job, "ipptransform", format, key, sizeof(key), cattrs, sizeof(cattrs))) >= 0)
+  {
+    puts("FAIL (cache hit)");
+    close(fd);
+    return (1);
+  }
+  else if (!key[0])
+  {
+    puts("FAIL (no cache key)");
+    return (1);
+  }
+
+  if ((fd = serverCreateCachedTransform(key, tempfile, sizeof(tempfile))) < 0)
+  {
+    printf("FAIL (%s)\n", strerror(errno));
+    return (1);
+  }
+
+  if (length > 0 && write(fd, output, length) != (ssize_t)length)
+  {
+    printf("FAIL (%s)\n", strerror(errno));
+    close(fd);
+    unlink(tempfile);
+    return (1);
+  }
+
+  close(fd);
+
+  serverAddCachedTransform(key, tempfile, attrs);
+
+  if (!access(tempfile, 0))
+  {
+    puts("FAIL (temporary file not removed)");
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
+
+
+/*
+ * 'test_find()' - Look up cached output for a job and compare it.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_find(const char   *title,		/* I - Test title */
+          server_job_t *job,		/* I - Job */
+          const char   *format,		/* I - Output format */
+          const char   *output,		/* I - Expected output or `NULL` for a miss */
+          const char   *attrs)		/* I - Expected "ATTR:" messages */
+{
+  int		fd;			/* Output file descriptor */
+  char		key[256],		/* Cache key */
+		cattrs[1024],		/* Cached "ATTR:" messages */
+		buffer[1024];		/* Cached output */
+  ssize_t	bytes;			/* Bytes read */
+
+
+  printf("    %s: ", title);
+
+  fd = serverFindCachedTransform(job, "ipptransform", format, key, sizeof(key), cattrs, sizeof(cattrs));
+
+  if (!output)
+  {
+    if (fd >= 0)
+    {
+      puts("FAIL (cache hit)");
+      close(fd);
+      return (1);
+    }
+
+    puts("PASS");
+    return (0);
+  }
+  else if (fd < 0)
+  {
+    puts("FAIL (cache miss)");
+    return (1);
+  }
+
+  bytes = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+
+  if (bytes < 0 || (size_t)bytes != strlen(output) || memcmp(buffer, output, (size_t)bytes))
+  {
+    puts("FAIL (wrong output)");
+    return (1);
+  }
+  else if (strcmp(cattrs, attrs ? attrs : ""))
+  {
+    printf("FAIL (got \"%s\" for attributes)\n", cattrs);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
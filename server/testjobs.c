@@ -0,0 +1,511 @@
+/*
+ * Job index test program for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ *
+ * Usage:
+ *
+ *   ./testjobs [num-jobs ...]
+ *
+ * Checks the job-id index against the printer's jobs array and compares the
+ * cost of looking up a job with each of them, by default for 10000 and
+ * 100000 jobs.  Also checks the order of the pending job queue and the
+ * per-user job lists.
+ */
+
+#define _MAIN_C_
+#include "testsupport.h"
+#include <sys/time.h>
+
+
+/*
+ * Local functions...
+ */
+
+static void	delete_job(server_job_t *job);
+static double	get_seconds(void);
+static int	test_jobs(int num_jobs);
+static int	test_queue(int num_jobs);
+static int	test_users(void);
+
+
+/*
+ * 'main()' - Main entry.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int	i,				/* Looping var */
+	status = 0;			/* Exit status */
+
+
+  if (!testCreateSpoolDirectory("testjobs"))
+    return (1);
+
+  if (argc > 1)
+  {
+    for (i = 1; i < argc; i ++)
+      status |= test_jobs(atoi(argv[i]));
+  }
+  else
+  {
+    status |= test_jobs(10000);
+    status |= test_jobs(100000);
+    status |= test_queue(1000);
+    status |= test_users();
+  }
+
+  testRemoveSpoolDirectory();
+
+  return (status);
+}
+
+
+/*
+ * 'delete_job()' - Remove a job from the printer and delete it.
+ *
+ * The printer must be locked for writing by the caller.
+ */
+
+static void
+delete_job(server_job_t *job)		/* I - Job */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+
+
+  cupsArrayRemove(printer->active_jobs, job);
+  cupsArrayRemove(printer->completed_jobs, job);
+  cupsArrayRemove(printer->jobs, job);
+}
+
+
+/*
+ * 'get_seconds()' - Get the current time in seconds...
+ */
+
+static double				/* O - Current time in seconds */
+get_seconds(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'test_jobs()' - Test and time job lookups with the given number of jobs.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_jobs(int num_jobs)			/* I - Number of jobs */
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*job,		/* Current job */
+			key;		/* Search key */
+  char			name[256],	/* Printer name */
+			username[256];	/* Job owner */
+  int			i,		/* Looping var */
+			id,		/* Current job-id */
+			lookups,	/* Number of lookups */
+			found,		/* Number of jobs found */
+			status = 0,	/* Return status */
+			*ids;		/* job-id values to look up */
+  double		start,		/* Start time */
+			array_secs,	/* Time for array lookups */
+			index_secs;	/* Time for index lookups */
+
+
+  printf("%d jobs:\n", num_jobs);
+
+  snprintf(name, sizeof(name), "jobs-%d", num_jobs);
+
+  if ((printer = testCreatePrinter(name)) == NULL)
+  {
+    puts("    serverCreatePrinter: FAIL");
+    return (1);
+  }
+
+  _cupsRWLockWrite(&printer->rwlock);
+
+ /*
+  * Add jobs...
+  */
+
+  fputs("    serverAddJob: ", stdout);
+
+  for (id = 1; id <= num_jobs; id ++)
+  {
+    snprintf(username, sizeof(username), "user%d", id % 100);
+
+    if (!testCreateJob(printer, id, IPP_JSTATE_PENDING, username))
+    {
+      puts("FAIL (unable to add job)");
+      _cupsRWUnlock(&printer->rwlock);
+      return (1);
+    }
+  }
+
+  if (printer->job_index_count != num_jobs)
+  {
+    printf("FAIL (%d jobs in index)\n", printer->job_index_count);
+    status = 1;
+  }
+  else
+    printf("PASS (%d slots)\n", printer->job_index_size);
+
+ /*
+  * Remove every third job and make sure the rest are found...
+  */
+
+  fputs("    serverDeleteJob: ", stdout);
+
+  for (id = 3; id <= num_jobs; id += 3)
+  {
+    key.id = id;
+    delete_job((server_job_t *)cupsArrayFind(printer->jobs, &key));
+  }
+
+  for (id = 1, found = 0; id <= num_jobs; id ++)
+  {
+    job = serverLookupJob(printer, id);
+
+    if ((id % 3) == 0 && job)
+      break;
+    else if ((id % 3) != 0 && (!job || job->id != id))
+      break;
+    else if (job)
+      found ++;
+  }
+
+  if (id <= num_jobs)
+  {
+    printf("FAIL (job #%d)\n", id);
+    status = 1;
+  }
+  else
+    printf("PASS (%d jobs)\n", found);
+
+ /*
+  * Time lookups using the array and the index...
+  */
+
+  lookups = 1000000;
+  ids     = malloc((size_t)lookups * sizeof(int));
+
+  for (i = 0; i < lookups; i ++)
+    ids[i] = 1 + (int)(CUPS_RAND() % (unsigned)num_jobs);
+
+  start = get_seconds();
+  for (i = 0, found = 0; i < lookups; i ++)
+  {
+    key.id = ids[i];
+
+    if (cupsArrayFind(printer->jobs, &key))
+      found ++;
+  }
+  array_secs = get_seconds() - start;
+
+  start = get_seconds();
+  for (i = 0; i < lookups; i ++)
+  {
+    if (serverLookupJob(printer, ids[i]))
+      found --;
+  }
+  index_secs = get_seconds() - start;
+
+  free(ids);
+
+  printf("    cupsArrayFind: %.1f ns/lookup\n", 1000000000.0 * array_secs / lookups);
+  printf("    serverLookupJob: %.1f ns/lookup\n", 1000000000.0 * index_secs / lookups);
+
+  if (found)
+  {
+    puts("    Lookup results: FAIL (array and index do not match)");
+    status = 1;
+  }
+
+  _cupsRWUnlock(&printer->rwlock);
+
+  cupsArrayRemove(Printers, printer);
+  serverDeletePrinter(printer);
+
+  return (status);
+}
+
+
+/*
+ * 'test_queue()' - Test the order of the pending job queue.
+ *
+ * Jobs are queued with a spread of job-priority values, some are deleted or
+ * re-prioritized while queued, and then the rest are taken from the front of
+ * the queue, which must be in descending priority order with ties in job-id
+ * order.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_queue(int num_jobs)		/* I - Number of jobs */
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*job,		/* Current job */
+			key;		/* Search key */
+  int			id,		/* Current job-id */
+			count,		/* Number of jobs dequeued */
+			last_priority,	/* Priority of last job */
+			last_id,	/* ID of last job */
+			status = 0;	/* Return status */
+
+
+  printf("Queue of %d jobs:\n", num_jobs);
+
+  if ((printer = testCreatePrinter("queue")) == NULL)
+  {
+    puts("    serverCreatePrinter: FAIL");
+    return (1);
+  }
+
+  _cupsRWLockWrite(&printer->rwlock);
+
+  fputs("    serverQueueJob: ", stdout);
+
+  for (id = 1; id <= num_jobs; id ++)
+  {
+    if ((job = testCreateJob(printer, id, IPP_JSTATE_PENDING, "test")) == NULL)
+    {
+      puts("FAIL (unable to add job)");
+      _cupsRWUnlock(&printer->rwlock);
+      return (1);
+    }
+
+    job->priority = 1 + (id * 37) % 100;
+
+    serverQueueJob(job);
+  }
+
+  if (printer->num_pending != num_jobs)
+  {
+    printf("FAIL (%d jobs queued)\n", printer->num_pending);
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * Delete every seventh job and move every eleventh job to the front...
+  */
+
+  fputs("    Delete queued jobs: ", stdout);
+
+  for (id = 7; id <= num_jobs; id += 7)
+  {
+    key.id = id;
+    delete_job((server_job_t *)cupsArrayFind(printer->jobs, &key));
+  }
+
+  if (printer->num_pending != num_jobs - num_jobs / 7)
+  {
+    printf("FAIL (%d jobs queued)\n", printer->num_pending);
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("    Re-prioritize queued jobs: ", stdout);
+
+  for (id = 11; id <= num_jobs; id += 11)
+  {
+    if ((job = serverLookupJob(printer, id)) != NULL)
+    {
+      job->priority = 100;
+      serverQueueJob(job);
+    }
+  }
+
+  if (printer->num_pending != num_jobs - num_jobs / 7)
+  {
+    printf("FAIL (%d jobs queued)\n", printer->num_pending);
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * Take jobs from the front of the queue...
+  */
+
+  fputs("    Queue order: ", stdout);
+
+  last_priority = 101;
+  last_id       = 0;
+  count         = 0;
+
+  while (printer->num_pending > 0)
+  {
+    job = printer->pending_jobs[0];
+
+    if (job->queue_index != 0)
+    {
+      printf("FAIL (job #%d has queue index %d)\n", job->id, job->queue_index);
+      status = 1;
+      break;
+    }
+    else if (job->priority > last_priority || (job->priority == last_priority && job->id < last_id))
+    {
+      printf("FAIL (job #%d with priority %d after job #%d with priority %d)\n", job->id, job->priority, last_id, last_priority);
+      status = 1;
+      break;
+    }
+
+    last_priority = job->priority;
+    last_id       = job->id;
+    count ++;
+
+    delete_job(job);
+  }
+
+  if (count == num_jobs - num_jobs / 7)
+    puts("PASS");
+  else if (!status)
+  {
+    printf("FAIL (%d jobs dequeued)\n", count);
+    status = 1;
+  }
+
+  _cupsRWUnlock(&printer->rwlock);
+
+  cupsArrayRemove(Printers, printer);
+  serverDeletePrinter(printer);
+
+  return (status);
+}
+
+
+/*
+ * 'test_users()' - Test the per-user job lists.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_users(void)
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*job;		/* Current job */
+  cups_array_t		*jobs;		/* User's jobs */
+  int			id,		/* Current job-id */
+			last_id,	/* ID of last job */
+			status = 0;	/* Return status */
+  static const char * const users[] =	/* Job owners */
+  {
+    "alice",
+    "bob",
+    "carol",
+    "Alice"
+  };
+
+
+  puts("User jobs:");
+
+  if ((printer = testCreatePrinter("users")) == NULL)
+  {
+    puts("    serverCreatePrinter: FAIL");
+    return (1);
+  }
+
+  _cupsRWLockWrite(&printer->rwlock);
+
+  for (id = 1; id <= 100; id ++)
+    testCreateJob(printer, id, id > 90 ? IPP_JSTATE_COMPLETED : IPP_JSTATE_PENDING, users[id % 4]);
+
+  fputs("    serverFindUserJobs: ", stdout);
+
+  if ((jobs = serverFindUserJobs(printer, "alice")) == NULL)
+  {
+    puts("FAIL (no jobs for alice)");
+    status = 1;
+  }
+  else if (cupsArrayCount(jobs) != 50)
+  {
+    printf("FAIL (%d jobs for alice, expected 50)\n", cupsArrayCount(jobs));
+    status = 1;
+  }
+  else
+  {
+    for (job = (server_job_t *)cupsArrayFirst(jobs), last_id = 0; job; job = (server_job_t *)cupsArrayNext(jobs))
+    {
+      if (job->id <= last_id || strcasecmp(job->username, "alice"))
+        break;
+
+      last_id = job->id;
+    }
+
+    if (job)
+    {
+      printf("FAIL (job #%d for %s after job #%d)\n", job->id, job->username, last_id);
+      status = 1;
+    }
+    else
+      puts("PASS");
+  }
+
+  fputs("    Case-insensitive lookup: ", stdout);
+
+  if (serverFindUserJobs(printer, "ALICE") != jobs || serverFindUserJobs(printer, "Bob") != serverFindUserJobs(printer, "bob"))
+  {
+    puts("FAIL");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("    Unknown user: ", stdout);
+
+  if (serverFindUserJobs(printer, "dave"))
+  {
+    puts("FAIL (jobs found)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * Delete all of carol's jobs and one of bob's...
+  */
+
+  fputs("    Delete user jobs: ", stdout);
+
+  for (id = 2; id <= 100; id += 4)
+    delete_job(serverLookupJob(printer, id));
+
+  delete_job(serverLookupJob(printer, 1));
+
+  if (serverFindUserJobs(printer, "carol"))
+  {
+    puts("FAIL (jobs still listed for carol)");
+    status = 1;
+  }
+  else if ((jobs = serverFindUserJobs(printer, "bob")) == NULL || cupsArrayCount(jobs) != 24 || ((server_job_t *)cupsArrayFirst(jobs))->id != 5)
+  {
+    printf("FAIL (%d jobs for bob, expected 24)\n", jobs ? cupsArrayCount(jobs) : 0);
+    status = 1;
+  }
+  else if (cupsArrayCount(printer->users) != 2)
+  {
+    printf("FAIL (%d users, expected 2)\n", cupsArrayCount(printer->users));
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  _cupsRWUnlock(&printer->rwlock);
+
+  cupsArrayRemove(Printers, printer);
+  serverDeletePrinter(printer);
+
+  return (status);
+}
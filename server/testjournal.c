@@ -0,0 +1,334 @@
+/*
+ * Job journal test program for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ *
+ * Usage:
+ *
+ *   ./testjournal
+ *
+ * Journals a set of jobs in a temporary spool directory and then replays the
+ * journal twice, each time in a new process as if the server was restarted,
+ * checking the recovered jobs and that job-id values are never reused.
+ */
+
+#define _MAIN_C_
+#include "testsupport.h"
+#include <sys/wait.h>
+
+
+/*
+ * Local functions...
+ */
+
+static server_job_t	*create_job(server_printer_t *printer, int id, ipp_jstate_t state, const char *filename, time_t completed);
+static server_printer_t	*create_printer(void);
+static int		recover_jobs(void);
+static int		run_test(int (*test)(void));
+static int		write_jobs(void);
+
+
+/*
+ * 'main()' - Main entry.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int		status = 0;		/* Exit status */
+
+
+  if (!testCreateSpoolDirectory("testjournal"))
+    return (1);
+
+  JobJournal = 1;
+
+  puts("Writing journal:");
+  status |= run_test(write_jobs);
+
+  puts("Recovering jobs:");
+  status |= run_test(recover_jobs);
+
+  puts("Recovering jobs again:");
+  status |= run_test(recover_jobs);
+
+  testRemoveSpoolDirectory();
+
+  return (status);
+}
+
+
+/*
+ * 'create_job()' - Create and add a job with a spool file and completion time.
+ *
+ * The printer must be locked for writing by the caller.
+ */
+
+static server_job_t *			/* O - Job */
+create_job(server_printer_t *printer,	/* I - Printer */
+           int              id,		/* I - job-id */
+           ipp_jstate_t     state,	/* I - job-state */
+	   const char       *filename,	/* I - Spool file or NULL */
+	   time_t           completed)	/* I - time-at-completed or 0 */
+{
+  server_job_t	*job;			/* Job */
+
+
+  if ((job = testCreateJob(printer, id, IPP_JSTATE_PENDING, "test")) == NULL)
+    return (NULL);
+
+  if (filename)
+    job->filename = strdup(filename);
+
+  if (completed)
+  {
+    job->created   = completed;
+    job->completed = completed;
+  }
+
+  job->state = state;
+
+  return (job);
+}
+
+
+/*
+ * 'create_printer()' - Create the test printer.
+ */
+
+static server_printer_t *		/* O - Printer */
+create_printer(void)
+{
+  server_printer_t	*printer;	/* Printer */
+
+
+  if ((printer = testCreatePrinter("test")) == NULL)
+    return (NULL);
+
+ /*
+  * Pretend that the processing slot is already running so that recovered jobs
+  * stay queued...
+  */
+
+  printer->pinfo.max_active_jobs = 1;
+  printer->num_slots             = 1;
+
+  return (printer);
+}
+
+
+/*
+ * 'recover_jobs()' - Replay the journal and check the recovered jobs.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+recover_jobs(void)
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*job;		/* Current job */
+  int			status = 0;	/* Return status */
+
+
+  if ((printer = create_printer()) == NULL)
+  {
+    puts("    serverCreatePrinter: FAIL");
+    return (1);
+  }
+
+  fputs("    serverOpenJournal: ", stdout);
+  if (serverOpenJournal())
+    puts("PASS");
+  else
+  {
+    puts("FAIL");
+    return (1);
+  }
+
+  fputs("    next-job-id: ", stdout);
+  if (printer->next_job_id == 5)
+    puts("PASS");
+  else
+  {
+    printf("FAIL (got %d, expected 5)\n", printer->next_job_id);
+    status = 1;
+  }
+
+  fputs("    Queued job: ", stdout);
+  if ((job = serverLookupJob(printer, 1)) == NULL)
+  {
+    puts("FAIL (job #1 not found)");
+    status = 1;
+  }
+  else if (job->state != IPP_JSTATE_PENDING || printer->num_pending != 1 || printer->pending_jobs[0] != job)
+  {
+    printf("FAIL (job #1 is %s with %d queued jobs)\n", ippEnumString("job-state", (int)job->state), printer->num_pending);
+    status = 1;
+  }
+  else if (!job->name || strcmp(job->name, "Job 1") || strcmp(job->username, "test"))
+  {
+    puts("FAIL (job #1 attributes not recovered)");
+    status = 1;
+  }
+  else if (printer->spool_used != 10)
+  {
+    printf("FAIL (%ld bytes charged to spool, expected 10)\n", (long)printer->spool_used);
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("    Missing spool file: ", stdout);
+  if ((job = serverLookupJob(printer, 2)) == NULL)
+  {
+    puts("FAIL (job #2 not found)");
+    status = 1;
+  }
+  else if (job->state != IPP_JSTATE_ABORTED || !cupsArrayFind(printer->completed_jobs, job))
+  {
+    printf("FAIL (job #2 is %s)\n", ippEnumString("job-state", (int)job->state));
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("    Completed job: ", stdout);
+  if ((job = serverLookupJob(printer, 3)) == NULL)
+  {
+    puts("FAIL (job #3 not found)");
+    status = 1;
+  }
+  else if (job->state != IPP_JSTATE_COMPLETED || !cupsArrayFind(printer->completed_jobs, job))
+  {
+    printf("FAIL (job #3 is %s)\n", ippEnumString("job-state", (int)job->state));
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("    Expired job: ", stdout);
+  if (serverLookupJob(printer, 4))
+  {
+    puts("FAIL (job #4 still in history)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  return (status);
+}
+
+
+/*
+ * 'run_test()' - Run a test in a new process.
+ *
+ * The journal can only be opened once per process, so each test runs in its
+ * own process.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+run_test(int (*test)(void))		/* I - Test function */
+{
+  pid_t	pid;				/* Child process ID */
+  int	status;				/* Exit status */
+
+
+  fflush(stdout);
+
+  if ((pid = fork()) < 0)
+  {
+    perror("fork");
+    return (1);
+  }
+  else if (pid == 0)
+  {
+    status = (*test)();
+
+    fflush(stdout);
+    _exit(status);
+  }
+
+  while (waitpid(pid, &status, 0) < 0)
+  {
+    if (errno != EINTR)
+    {
+      perror("waitpid");
+      return (1);
+    }
+  }
+
+  return (!WIFEXITED(status) || WEXITSTATUS(status));
+}
+
+
+/*
+ * 'write_jobs()' - Journal a queued job, a job whose spool file is missing, a
+ *                  completed job, and a completed job that has expired.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+write_jobs(void)
+{
+  server_printer_t	*printer;	/* Printer */
+  server_job_t		*job;		/* Current job */
+  char			filename[1024];	/* Spool file */
+  int			fd;		/* Spool file descriptor */
+  time_t		curtime = time(NULL);
+					/* Current time */
+
+
+  if ((printer = create_printer()) == NULL)
+  {
+    puts("    serverCreatePrinter: FAIL");
+    return (1);
+  }
+
+  fputs("    serverOpenJournal: ", stdout);
+  if (serverOpenJournal())
+    puts("PASS");
+  else
+  {
+    puts("FAIL");
+    return (1);
+  }
+
+  fputs("    serverJournalJob: ", stdout);
+
+  snprintf(filename, sizeof(filename), "%s/1.txt", SpoolDirectory);
+  if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 || write(fd, "Test Page\n", 10) != 10)
+  {
+    printf("FAIL (%s: %s)\n", filename, strerror(errno));
+    return (1);
+  }
+  close(fd);
+
+  _cupsRWLockWrite(&(printer->rwlock));
+
+  job = create_job(printer, 1, IPP_JSTATE_PENDING, filename, 0);
+  serverJournalJob(job, 1);
+  serverQueueJob(job);
+
+  snprintf(filename, sizeof(filename), "%s/2.txt", SpoolDirectory);
+  job = create_job(printer, 2, IPP_JSTATE_PENDING, filename, 0);
+  serverJournalJob(job, 1);
+
+  job = create_job(printer, 3, IPP_JSTATE_COMPLETED, NULL, curtime);
+  serverJournalJob(job, 1);
+  serverFinishJob(job);
+
+  job = create_job(printer, 4, IPP_JSTATE_COMPLETED, NULL, curtime - 120);
+  serverJournalJob(job, 1);
+  serverFinishJob(job);
+
+  printer->next_job_id = 5;
+
+  _cupsRWUnlock(&(printer->rwlock));
+
+  serverSyncJournal();
+
+  puts("PASS");
+
+  return (0);
+}
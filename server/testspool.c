@@ -0,0 +1,144 @@
+/*
+ * Spool quota test program for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ *
+ * Usage:
+ *
+ *   ./testspool
+ *
+ * Charges jobs on two printers against a per-printer and a server
+ * "MaxSpoolSize", checking which jobs are admitted and that the
+ * "spool-area-full" reason is set and cleared as space is used and released.
+ */
+
+#define _MAIN_C_
+#include "testsupport.h"
+
+
+/*
+ * Local functions...
+ */
+
+static int	test_spool(const char *title, server_job_t *job, off_t bytes, int force, int expected, server_printer_t *printer, off_t used, server_preason_t reasons);
+
+
+/*
+ * 'main()' - Main entry.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  server_printer_t	*a,		/* Printer with a quota */
+			*b;		/* Printer without a quota */
+  server_job_t		*job1,		/* Jobs */
+			*job2,
+			*job3,
+			*job4;
+  int			status = 0;	/* Exit status */
+
+
+  if (!testCreateSpoolDirectory("testspool"))
+    return (1);
+
+  MaxSpoolSize = 150;
+
+  if ((a = testCreatePrinter("a")) == NULL || (b = testCreatePrinter("b")) == NULL)
+  {
+    puts("    serverCreatePrinter: FAIL");
+    testRemoveSpoolDirectory();
+    return (1);
+  }
+
+  a->pinfo.max_spool_size = 100;
+
+  _cupsRWLockWrite(&a->rwlock);
+  job1 = testCreateJob(a, 1, IPP_JSTATE_PENDING, "test");
+  job2 = testCreateJob(a, 2, IPP_JSTATE_PENDING, "test");
+  _cupsRWUnlock(&a->rwlock);
+
+  _cupsRWLockWrite(&b->rwlock);
+  job3 = testCreateJob(b, 3, IPP_JSTATE_PENDING, "test");
+  job4 = testCreateJob(b, 4, IPP_JSTATE_PENDING, "test");
+  _cupsRWUnlock(&b->rwlock);
+
+  status |= test_spool("Printer exact fit", job1, 100, 0, 1, a, 100, SERVER_PREASON_NONE);
+  status |= test_spool("Printer over quota", job2, 1, 0, 0, a, 100, SERVER_PREASON_SPOOL_AREA_FULL);
+  status |= test_spool("Other printer", job3, 10, 0, 1, b, 10, SERVER_PREASON_NONE);
+  status |= test_spool("Server exact fit", job3, 50, 0, 1, b, 50, SERVER_PREASON_NONE);
+  status |= test_spool("Server over quota", job4, 1, 0, 0, b, 50, SERVER_PREASON_SPOOL_AREA_FULL);
+  status |= test_spool("Forced update", job4, 1, 1, 1, b, 51, SERVER_PREASON_SPOOL_AREA_FULL);
+
+  fputs("    All printers full: ", stdout);
+  if (!(a->spool_reasons & SERVER_PREASON_SPOOL_AREA_FULL))
+  {
+    puts("FAIL (printer a not full)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  status |= test_spool("Release forced", job4, 0, 1, 1, b, 50, SERVER_PREASON_SPOOL_AREA_FULL);
+  status |= test_spool("Release server", job3, 0, 1, 1, b, 0, SERVER_PREASON_NONE);
+
+  fputs("    Printer still full: ", stdout);
+  if (!(a->spool_reasons & SERVER_PREASON_SPOOL_AREA_FULL))
+  {
+    puts("FAIL (printer a not full)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  status |= test_spool("Release printer", job1, 0, 1, 1, a, 0, SERVER_PREASON_NONE);
+  status |= test_spool("Printer fits again", job2, 100, 0, 1, a, 100, SERVER_PREASON_NONE);
+
+  testRemoveSpoolDirectory();
+
+  return (status);
+}
+
+
+/*
+ * 'test_spool()' - Update the spool space for a job and check the result.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_spool(const char       *title,	/* I - Test title */
+           server_job_t     *job,	/* I - Job */
+           off_t            bytes,	/* I - New size of job files */
+           int              force,	/* I - Ignore spool limits? */
+           int              expected,	/* I - Expected result */
+           server_printer_t *printer,	/* I - Printer to check */
+           off_t            used,	/* I - Expected spool use for printer */
+           server_preason_t reasons)	/* I - Expected spool reasons for printer */
+{
+  int	result;				/* Result of update */
+
+
+  printf("    %s: ", title);
+
+  if ((result = serverUpdateJobSpool(job, bytes, force)) != expected)
+  {
+    printf("FAIL (update %s)\n", result ? "accepted" : "rejected");
+    return (1);
+  }
+  else if (printer->spool_used != used)
+  {
+    printf("FAIL (%ld bytes used, expected %ld)\n", (long)printer->spool_used, (long)used);
+    return (1);
+  }
+  else if (printer->spool_reasons != reasons)
+  {
+    printf("FAIL (spool-area-full %s)\n", reasons ? "not set" : "set");
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
@@ -0,0 +1,209 @@
+/*
+ * Unit test support for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#include "testsupport.h"
+#include <cups/dir.h>
+
+
+/*
+ * Local globals...
+ */
+
+static char	test_spooldir[256] = "";/* Temporary spool directory */
+
+
+/*
+ * Local functions...
+ */
+
+static void	remove_directory(const char *path);
+
+
+/*
+ * 'testCreateJob()' - Create a job and add it to the printer's active jobs.
+ *
+ * Jobs normally come from a client's Print-Job or Create-Job request, so this
+ * sets the same fields and attributes that serverCreateJob() does.  Jobs in a
+ * completed state are added to the job history with serverFinishJob().  The
+ * printer must be locked for writing by the caller.
+ */
+
+server_job_t *				/* O - Job */
+testCreateJob(
+    server_printer_t *printer,		/* I - Printer */
+    int              id,		/* I - job-id */
+    ipp_jstate_t     state,		/* I - job-state */
+    const char       *username)		/* I - job-originating-user-name */
+{
+  server_job_t	*job;			/* Job */
+  char		name[256];		/* job-name */
+
+
+  if ((job = calloc(1, sizeof(server_job_t))) == NULL)
+    return (NULL);
+
+  snprintf(name, sizeof(name), "Job %d", id);
+
+  job->id          = id;
+  job->printer     = printer;
+  job->fd          = -1;
+  job->queue_index = -1;
+  job->priority    = 50;
+  job->state       = state;
+  job->created     = time(NULL);
+  job->format      = "text/plain";
+  job->attrs       = ippNew();
+
+  ippAddString(job->attrs, IPP_TAG_JOB, IPP_TAG_NAME, "job-name", NULL, name);
+  ippAddString(job->attrs, IPP_TAG_JOB, IPP_TAG_NAME, "job-originating-user-name", NULL, username);
+
+  job->name     = ippGetString(ippFindAttribute(job->attrs, "job-name", IPP_TAG_NAME), 0, NULL);
+  job->username = ippGetString(ippFindAttribute(job->attrs, "job-originating-user-name", IPP_TAG_NAME), 0, NULL);
+
+  if (!serverAddJob(job))
+  {
+    ippDelete(job->attrs);
+    free(job);
+    return (NULL);
+  }
+
+  cupsArrayAdd(printer->active_jobs, job);
+
+  if (state >= IPP_JSTATE_CANCELED)
+  {
+    job->completed = job->created;
+
+    serverFinishJob(job);
+  }
+
+  if (id >= printer->next_job_id)
+    printer->next_job_id = id + 1;
+
+  return (job);
+}
+
+
+/*
+ * 'testCreatePrinter()' - Create a printer.
+ *
+ * The printer is created with serverCreatePrinter() in the spool directory
+ * from testCreateSpoolDirectory() and is added to the "Printers" array.  A
+ * listener for "localhost" is added if needed for the printer URIs, but no
+ * sockets are opened.
+ */
+
+server_printer_t *			/* O - Printer */
+testCreatePrinter(const char *name)	/* I - Printer name */
+{
+  server_pinfo_t	pinfo;		/* Printer information */
+  server_printer_t	*printer;	/* Printer */
+  char			resource[256];	/* Resource path */
+
+
+  if (!Listeners)
+  {
+    server_listener_t	*lis;		/* Listener */
+
+    Listeners = cupsArrayNew(NULL, NULL);
+
+    if ((lis = calloc(1, sizeof(server_listener_t))) == NULL)
+      return (NULL);
+
+    lis->fd   = -1;
+    lis->port = 8631;
+    strlcpy(lis->host, "localhost", sizeof(lis->host));
+
+    cupsArrayAdd(Listeners, lis);
+  }
+
+  if (!Printers)
+    Printers = cupsArrayNew(NULL, NULL);
+
+  memset(&pinfo, 0, sizeof(pinfo));
+  pinfo.attrs = ippNew();
+
+  snprintf(resource, sizeof(resource), "/ipp/print/%s", name);
+
+  if ((printer = serverCreatePrinter(resource, name, &pinfo)) != NULL)
+    cupsArrayAdd(Printers, printer);
+
+  return (printer);
+}
+
+
+/*
+ * 'testCreateSpoolDirectory()' - Create a temporary spool directory.
+ *
+ * "SpoolDirectory" is set to the new directory.  Call
+ * testRemoveSpoolDirectory() to remove it and its contents.
+ */
+
+const char *				/* O - Spool directory or `NULL` on error */
+testCreateSpoolDirectory(
+    const char *name)			/* I - Test program name */
+{
+  snprintf(test_spooldir, sizeof(test_spooldir), "/tmp/%s.%d", name, (int)getpid());
+
+  if (mkdir(test_spooldir, 0700))
+  {
+    perror(test_spooldir);
+    test_spooldir[0] = '\0';
+    return (NULL);
+  }
+
+  SpoolDirectory = test_spooldir;
+
+  return (test_spooldir);
+}
+
+
+/*
+ * 'testRemoveSpoolDirectory()' - Remove the temporary spool directory.
+ */
+
+void
+testRemoveSpoolDirectory(void)
+{
+  if (test_spooldir[0])
+  {
+    remove_directory(test_spooldir);
+    test_spooldir[0] = '\0';
+  }
+}
+
+
+/*
+ * 'remove_directory()' - Remove a directory and its contents.
+ */
+
+static void
+remove_directory(const char *path)	/* I - Directory */
+{
+  cups_dir_t	*dir;			/* Directory */
+  cups_dentry_t	*dent;			/* Directory entry */
+  char		filename[1024];		/* Filename */
+
+
+  if ((dir = cupsDirOpen(path)) != NULL)
+  {
+    while ((dent = cupsDirRead(dir)) != NULL)
+    {
+      snprintf(filename, sizeof(filename), "%s/%s", path, dent->filename);
+
+      if (S_ISDIR(dent->fileinfo.st_mode))
+        remove_directory(filename);
+      else
+        unlink(filename);
+    }
+
+    cupsDirClose(dir);
+  }
+
+  rmdir(path);
+}
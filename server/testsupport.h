@@ -0,0 +1,29 @@
+/*
+ * Unit test support header for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#ifndef _IPPSERVER_TESTSUPPORT_H_
+#  define _IPPSERVER_TESTSUPPORT_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include "ippserver.h"
+
+
+/*
+ * Functions...
+ */
+
+extern server_job_t	*testCreateJob(server_printer_t *printer, int id, ipp_jstate_t state, const char *username);
+extern server_printer_t	*testCreatePrinter(const char *name);
+extern const char	*testCreateSpoolDirectory(const char *name);
+extern void		testRemoveSpoolDirectory(void);
+
+#endif /* !_IPPSERVER_TESTSUPPORT_H_ */
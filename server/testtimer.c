@@ -0,0 +1,197 @@
+/*
+ * Timer test program for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ *
+ * Usage:
+ *
+ *   ./testtimer
+ *
+ * Schedules, reschedules, and cancels timers on the timer wheel and runs them
+ * for a few seconds, checking that each timer fires once and no earlier than
+ * its deadline.
+ */
+
+#define _MAIN_C_
+#include "ippserver.h"
+
+
+/*
+ * Timer IDs...
+ */
+
+enum
+{
+  TEST_DUE,				/* Timer that is due now */
+  TEST_CANCELED,			/* Timer that is canceled */
+  TEST_FUTURE,				/* Timer that is due in 2 seconds */
+  TEST_MOVED,				/* Timer that is moved to a later time */
+  TEST_ADDER,				/* Timer that adds another timer */
+  TEST_ADDED,				/* Timer added from a callback */
+  TEST_FAR,				/* Timer that is due in 100000 seconds */
+  TEST_MAX
+};
+
+
+/*
+ * Local globals...
+ */
+
+static server_timer_t	timers[TEST_MAX];
+					/* Timers */
+static time_t		deadlines[TEST_MAX],
+					/* Deadlines for timers */
+			fired[TEST_MAX];/* Time each timer fired */
+static int		counts[TEST_MAX];
+					/* Number of times each timer fired */
+
+
+/*
+ * Local functions...
+ */
+
+static void	add_timer(int id, time_t deadline);
+static void	fire_timer(void *data, int id);
+static void	run_timers(int seconds);
+static int	test_timer(const char *title, int id, int expected);
+
+
+/*
+ * 'main()' - Main entry.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  time_t	curtime = time(NULL);	/* Current time */
+  int		status = 0;		/* Exit status */
+
+
+ /*
+  * Timers that fire (or not) right away...
+  */
+
+  add_timer(TEST_DUE, curtime);
+  add_timer(TEST_CANCELED, curtime);
+  serverCancelTimer(timers + TEST_CANCELED);
+
+  serverRunTimers();
+
+  status |= test_timer("Due timer", TEST_DUE, 1);
+  status |= test_timer("Canceled timer", TEST_CANCELED, 0);
+
+ /*
+  * Timers that fire later...
+  */
+
+  curtime = time(NULL);
+
+  add_timer(TEST_FUTURE, curtime + 2);
+  add_timer(TEST_MOVED, curtime + 1);
+  add_timer(TEST_MOVED, curtime + 3);
+  add_timer(TEST_ADDER, curtime + 1);
+  add_timer(TEST_FAR, curtime + 100000);
+
+  run_timers(4);
+
+  status |= test_timer("Future timer", TEST_FUTURE, 1);
+  status |= test_timer("Moved timer", TEST_MOVED, 1);
+  status |= test_timer("Timer from callback", TEST_ADDED, 1);
+  status |= test_timer("Far timer", TEST_FAR, 0);
+
+  fputs("    Cancel far timer: ", stdout);
+
+  serverCancelTimer(timers + TEST_FAR);
+
+  if (timers[TEST_FAR].prev)
+  {
+    puts("FAIL (still scheduled)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  return (status);
+}
+
+
+/*
+ * 'add_timer()' - Schedule a test timer.
+ */
+
+static void
+add_timer(int    id,			/* I - Timer ID */
+          time_t deadline)		/* I - Time to fire */
+{
+  deadlines[id] = deadline;
+
+  serverAddTimer(timers + id, deadline, fire_timer, timers, id);
+}
+
+
+/*
+ * 'fire_timer()' - Record that a timer fired.
+ */
+
+static void
+fire_timer(void *data,			/* I - Timers */
+           int  id)			/* I - Timer ID */
+{
+  (void)data;
+
+  fired[id] = time(NULL);
+  counts[id] ++;
+
+  if (id == TEST_ADDER)
+    add_timer(TEST_ADDED, fired[id]);
+}
+
+
+/*
+ * 'run_timers()' - Run timers for the given number of seconds.
+ */
+
+static void
+run_timers(int seconds)			/* I - Number of seconds */
+{
+  time_t	endtime = time(NULL) + seconds;
+					/* End time */
+
+
+  while (time(NULL) <= endtime)
+  {
+    serverRunTimers();
+    usleep(100000);
+  }
+}
+
+
+/*
+ * 'test_timer()' - Check how many times a timer fired and when.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_timer(const char *title,		/* I - Test title */
+           int        id,		/* I - Timer ID */
+           int        expected)		/* I - Expected number of times fired */
+{
+  printf("    %s: ", title);
+
+  if (counts[id] != expected)
+  {
+    printf("FAIL (fired %d times, expected %d)\n", counts[id], expected);
+    return (1);
+  }
+  else if (counts[id] && fired[id] < deadlines[id])
+  {
+    printf("FAIL (fired %d seconds early)\n", (int)(deadlines[id] - fired[id]));
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
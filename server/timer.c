@@ -0,0 +1,283 @@
+/*
+ * Timer support for sample IPP server implementation.
+ *
+ * Copyright © 2018 by the IEEE-ISTO Printer Working Group
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#include "ippserver.h"
+
+
+/*
+ * Timers are kept in a hierarchical timing wheel with a resolution of one
+ * second.  Level 0 holds timers that expire in the next 64 seconds, level 1
+ * the next 64*64 seconds, and so forth.  Each time the level 0 wheel wraps
+ * around, the next slot of the level above is "cascaded" down so that its
+ * timers land in the right level 0 slot before they are due.  Scheduling and
+ * canceling a timer are O(1).
+ *
+ * Timer callbacks run on the main loop thread without the timer mutex held,
+ * so they can schedule or cancel other timers.  Since an object can be freed
+ * by another thread while its timer is firing, callbacks only get a pointer
+ * to a long-lived object (i.e. a printer) and an ID they can look up.
+ */
+
+#define SERVER_TIMER_BITS	6	/* Bits per wheel level */
+#define SERVER_TIMER_SLOTS	(1 << SERVER_TIMER_BITS)
+					/* Slots per wheel level */
+#define SERVER_TIMER_MASK	(SERVER_TIMER_SLOTS - 1)
+					/* Mask for slot index */
+#define SERVER_TIMER_LEVELS	4	/* Number of wheel levels */
+
+
+/*
+ * Local globals...
+ */
+
+static _cups_mutex_t	timer_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for timer wheel */
+static server_timer_t	*timer_wheel[SERVER_TIMER_LEVELS][SERVER_TIMER_SLOTS];
+					/* Timer wheel */
+static time_t		timer_base = 0;	/* Next time to process */
+static int		timer_count = 0;/* Number of scheduled timers */
+
+
+/*
+ * Local functions...
+ */
+
+static void	add_timer(server_timer_t *timer);
+static void	remove_timer(server_timer_t *timer);
+
+
+/*
+ * 'serverAddTimer()' - Schedule a timer.
+ *
+ * If the timer is already scheduled, it is moved to the new deadline.
+ */
+
+void
+serverAddTimer(
+    server_timer_t    *timer,		/* I - Timer */
+    time_t            deadline,		/* I - Time to fire */
+    server_timer_cb_t cb,		/* I - Callback function */
+    void              *data,		/* I - Callback data */
+    int               id)		/* I - Callback object ID */
+{
+  _cupsMutexLock(&timer_mutex);
+
+  if (!timer_base)
+    timer_base = time(NULL);
+
+  if (timer->prev)
+    remove_timer(timer);
+
+  timer->deadline = deadline;
+  timer->cb       = cb;
+  timer->data     = data;
+  timer->id       = id;
+
+  add_timer(timer);
+
+  _cupsMutexUnlock(&timer_mutex);
+}
+
+
+/*
+ * 'serverCancelTimer()' - Cancel a timer.
+ */
+
+void
+serverCancelTimer(
+    server_timer_t *timer)		/* I - Timer */
+{
+  _cupsMutexLock(&timer_mutex);
+
+  if (timer->prev)
+    remove_timer(timer);
+
+  _cupsMutexUnlock(&timer_mutex);
+}
+
+
+/*
+ * 'serverRunTimers()' - Run any timers that have expired.
+ *
+ * This function is called from the main loop at least once a second.
+ */
+
+void
+serverRunTimers(void)
+{
+  time_t		curtime = time(NULL),
+					/* Current time */
+			base;		/* Time being processed */
+  int			level,		/* Current level */
+			slot;		/* Current slot */
+  server_timer_t	*timer,		/* Current timer */
+			*next,		/* Next timer */
+			*expired;	/* Expired timers */
+  server_timer_cb_t	cb;		/* Callback function */
+  void			*data;		/* Callback data */
+  int			id;		/* Callback object ID */
+
+
+  _cupsMutexLock(&timer_mutex);
+
+  if (!timer_base || curtime < timer_base - 1)
+  {
+   /*
+    * First call or the clock went backwards, start over from the current
+    * time.  Scheduled timers are kept and fire when their slot comes around.
+    */
+
+    timer_base = curtime;
+  }
+
+  while (timer_count > 0 && timer_base <= curtime)
+  {
+   /*
+    * Cascade the higher levels as the lower ones wrap around...
+    */
+
+    for (level = 1; level < SERVER_TIMER_LEVELS; level ++)
+    {
+      if ((timer_base >> (SERVER_TIMER_BITS * (level - 1))) & SERVER_TIMER_MASK)
+        break;
+
+      slot  = (int)((timer_base >> (SERVER_TIMER_BITS * level)) & SERVER_TIMER_MASK);
+      timer = timer_wheel[level][slot];
+
+      timer_wheel[level][slot] = NULL;
+
+      for (; timer; timer = next)
+      {
+        next        = timer->next;
+        timer->prev = NULL;
+        timer_count --;
+
+        add_timer(timer);
+      }
+    }
+
+   /*
+    * Fire the timers in the current slot.  The wheel moves on to the next
+    * second first, so that timers the callbacks add for the current time
+    * fire on the next second rather than on the next lap...
+    */
+
+    base = timer_base ++;
+    slot = (int)(base & SERVER_TIMER_MASK);
+
+    if ((expired = timer_wheel[0][slot]) != NULL)
+    {
+     /*
+      * Move the slot's timers to a local list - timers that are canceled
+      * while we are running callbacks unlink themselves from it...
+      */
+
+      expired->prev        = &expired;
+      timer_wheel[0][slot] = NULL;
+    }
+
+    while ((timer = expired) != NULL)
+    {
+      remove_timer(timer);
+
+      if (timer->deadline > base)
+      {
+       /*
+        * Timer is for a later lap of the wheel...
+        */
+
+        add_timer(timer);
+        continue;
+      }
+
+      cb   = timer->cb;
+      data = timer->data;
+      id   = timer->id;
+
+      _cupsMutexUnlock(&timer_mutex);
+
+      (cb)(data, id);
+
+      _cupsMutexLock(&timer_mutex);
+    }
+  }
+
+  if (timer_count == 0)
+    timer_base = curtime + 1;
+
+  _cupsMutexUnlock(&timer_mutex);
+}
+
+
+/*
+ * 'add_timer()' - Add a timer to the wheel.
+ *
+ * The timer mutex must be held by the caller.
+ */
+
+static void
+add_timer(server_timer_t *timer)	/* I - Timer */
+{
+  time_t	deadline = timer->deadline,
+					/* Deadline */
+		delta;			/* Seconds until deadline */
+  int		level;			/* Wheel level */
+  server_timer_t **slot;		/* Wheel slot */
+
+
+  if (deadline < timer_base)
+    deadline = timer_base;
+
+  delta = deadline - timer_base;
+
+  for (level = 0; level < (SERVER_TIMER_LEVELS - 1); level ++)
+  {
+    if (delta < ((time_t)1 << (SERVER_TIMER_BITS * (level + 1))))
+      break;
+  }
+
+  if (delta >= ((time_t)1 << (SERVER_TIMER_BITS * SERVER_TIMER_LEVELS)))
+  {
+   /*
+    * Beyond the end of the wheel - park in the farthest slot; the timer is
+    * re-added when the slot is cascaded.
+    */
+
+    deadline = timer_base + ((time_t)1 << (SERVER_TIMER_BITS * SERVER_TIMER_LEVELS)) - 1;
+  }
+
+  slot = timer_wheel[level] + ((deadline >> (SERVER_TIMER_BITS * level)) & SERVER_TIMER_MASK);
+
+  if ((timer->next = *slot) != NULL)
+    timer->next->prev = &timer->next;
+
+  timer->prev = slot;
+  *slot       = timer;
+
+  timer_count ++;
+}
+
+
+/*
+ * 'remove_timer()' - Remove a timer from the wheel.
+ *
+ * The timer mutex must be held by the caller.
+ */
+
+static void
+remove_timer(server_timer_t *timer)	/* I - Timer */
+{
+  if ((*(timer->prev) = timer->next) != NULL)
+    timer->next->prev = timer->prev;
+
+  timer->next = NULL;
+  timer->prev = NULL;
+
+  timer_count --;
+}
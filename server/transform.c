@@ -9,25 +9,126 @@
  */
 
 #include "ippserver.h"
+#include <cups/http-private.h>
 
 #ifdef WIN32
 #  include <sys/timeb.h>
 #else
+#  include <signal.h>
 #  include <spawn.h>
+#  include <sys/resource.h>
+#  include <sys/socket.h>
+#  ifdef __linux
+#    include <sys/syscall.h>
+#  endif /* __linux */
 #endif /* WIN32 */
 
 
+/*
+ * Local types...
+ */
+
+typedef struct server_stream_s		/**** Streamed document data ****/
+{
+  server_job_t	*job;			/* Job */
+  int		fd;			/* Pipe to command's stdin */
+  int		pid;			/* Process ID of command */
+  int		done;			/* Non-zero when command has exited */
+} server_stream_t;
+
+typedef struct server_twait_s		/**** Command waiting to run ****/
+{
+  struct server_twait_s	*next;		/* Next waiting command */
+  server_printer_t	*printer;	/* Printer */
+  int			ready;		/* Non-zero when the command can run */
+} server_twait_t;
+
+typedef struct server_worker_s		/**** Transform worker ****/
+{
+  struct server_worker_s *next;		/* Next idle worker */
+  char		*command;		/* Command */
+  int		pid,			/* Process ID */
+		fd;			/* Socket to worker */
+} server_worker_t;
+
+
+/*
+ * Local globals...
+ */
+
+static _cups_mutex_t	env_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for cached environments */
+static int		num_transforms = 0,
+					/* Number of running commands */
+			num_queued_transforms = 0;
+					/* Number of commands waiting to run */
+static unsigned		transform_seq = 0;
+					/* Sequence number of last command run */
+static _cups_cond_t	transform_cond = _CUPS_COND_INITIALIZER;
+					/* Condition for running commands */
+static _cups_mutex_t	transform_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for running commands */
+static server_twait_t	*transform_queue = NULL;
+					/* Commands waiting to run */
+#ifndef WIN32
+static server_worker_t	*idle_workers = NULL;
+					/* Idle workers */
+static int		num_workers = 0;/* Number of workers */
+static cups_array_t	*unsupported_workers = NULL;
+					/* Commands that can't run as workers */
+static _cups_mutex_t	worker_mutex = _CUPS_MUTEX_INITIALIZER;
+					/* Mutex for workers */
+#endif /* !WIN32 */
+
+
 /*
  * Local functions...
  */
 
+static int	add_env(server_env_t *env, const char *format, ...) __attribute__((__format__(__printf__, 2, 3)));
+static int	copy_env(server_printer_t *printer, server_env_t *env);
+static server_env_t *create_env(server_printer_t *printer);
+static void	finish_transform(server_printer_t *printer);
+#ifndef WIN32
+static server_worker_t *get_worker(const char *command);
+#endif /* !WIN32 */
 static void	process_attr_message(server_job_t *job, char *message, server_transform_t mode);
 static void	process_state_message(server_job_t *job, char *message);
+#ifndef WIN32
+static void	release_worker(server_worker_t *worker, int reuse);
+static int	send_worker_request(server_worker_t *worker, char **argv, char **envp, int fds[3]);
+static void	set_limits(server_pinfo_t *pinfo);
+#  ifdef HAVE_SPLICE
+static int	splice_output(server_client_t *client, server_job_t *job, int fd, int pipefds[2], int *cachefd, const char *cachefile);
+#  endif /* HAVE_SPLICE */
+#endif /* !WIN32 */
+static void	start_transform(server_job_t *job);
+#ifndef WIN32
+static server_worker_t *start_worker(const char *command);
+static void	*stream_job(server_stream_t *stream);
+#endif /* !WIN32 */
 static double	time_seconds(void);
+static void	update_transform_stats(void);
+#ifndef WIN32
+static void	write_error(const char *message);
+#endif /* !WIN32 */
 
 
 /*
  * 'serverTransformJob()' - Generate printer-ready document data for a Job.
+ *
+ * When the job's document is still being received (the "job-incoming" reason
+ * is set for printers with "StreamJobs" enabled), the command is run without
+ * a filename and gets the document data on stdin as it arrives.
+ *
+ * Output sent to the client is kept in the transform cache, and later
+ * requests for the same output are sent from the cache instead of running
+ * the command again.
+ *
+ * The "ipptransform" command is run by a pool of up to "TransformWorkers"
+ * pre-started worker processes, which saves initializing the renderer for
+ * every job.  Other commands, and "ipptransform" when all of the workers are
+ * busy, are started for each job.
  */
 
 int					/* O - 0 on success, non-zero on error */
@@ -38,6 +139,8 @@ serverTransformJob(
     const char         *format,		/* I - Destination MIME media type */
     server_transform_t mode)		/* I - Transform mode */
 {
+  server_pinfo_t *pinfo = &job->printer->pinfo;
+					/* Printer information */
   int 		pid,			/* Process ID */
                 status = 0;		/* Exit status */
   double	start,			/* Start time */
@@ -45,13 +148,18 @@ serverTransformJob(
   char		*myargv[3],		/* Command-line arguments */
 		*myenvp[200];		/* Environment variables */
   int		myenvc;			/* Number of environment variables */
+  server_env_t	myenv;			/* Environment buffer */
   ipp_attribute_t *attr;		/* Job attribute */
   char		val[1280],		/* IPP_NAME=value */
                 *valptr;		/* Pointer into string */
 #ifndef WIN32
   posix_spawn_file_actions_t actions;	/* Spawn file actions */
-  int		mystdout[2] = {-1, -1},	/* Pipe for stdout */
+  int		mystdin[2] = {-1, -1},	/* Pipe for stdin */
+		mystdout[2] = {-1, -1},	/* Pipe for stdout */
 		mystderr[2] = {-1, -1};	/* Pipe for stderr */
+  int		streaming;		/* Stream document data to stdin? */
+  server_stream_t stream;		/* Streamed document data */
+  _cups_thread_t stream_thread = 0;	/* Thread copying data to stdin */
   struct pollfd	polldata[2];		/* Poll data */
   int		pollcount,		/* Number of pipes to poll */
                 pollret;                /* Return value from poll() */
@@ -60,10 +168,69 @@ serverTransformJob(
                 *ptr,			/* Pointer into line */
                 *endptr;		/* End of line */
   ssize_t	bytes;			/* Bytes read */
+  char		cachekey[65],		/* Transform cache key */
+		cachefile[1024],	/* Transform cache file */
+		cacheattrs[2048],	/* "ATTR:" messages for cache */
+		*cacheptr = cacheattrs;	/* Pointer into messages */
+  int		cachefd = -1;		/* Transform cache file descriptor */
+  server_worker_t *worker;		/* Transform worker, if any */
+#  ifdef HAVE_SPLICE
+  int		splicefds[2] = {-1, -1};/* Pipe for output to client */
+#  endif /* HAVE_SPLICE */
+  int		clienterr = 0;		/* Unable to write to client? */
+  int		workerfds[3];		/* stdin, stdout, and stderr for worker */
 #endif /* !WIN32 */
 
 
+#ifdef WIN32
   serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Running command \"%s %s\".", command, job->filename);
+
+#else
+  if (mode == SERVER_TRANSFORM_TO_CLIENT && (cachefd = serverFindCachedTransform(job, command, format, cachekey, sizeof(cachekey), cacheattrs, sizeof(cacheattrs))) >= 0)
+  {
+   /*
+    * Report the job attributes from the original run and send the cached
+    * output.  The caller ends the response...
+    */
+
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Sending cached output of command \"%s %s\".", command, job->filename);
+
+    for (ptr = cacheattrs; *ptr; ptr = endptr)
+    {
+      if ((endptr = strchr(ptr, '\n')) != NULL)
+        *endptr++ = '\0';
+      else
+        endptr = ptr + strlen(ptr);
+
+      process_attr_message(job, ptr, mode);
+    }
+
+    while ((bytes = read(cachefd, data, sizeof(data))) > 0)
+      httpWrite2(client->http, data, (size_t)bytes);
+
+    close(cachefd);
+
+    httpFlushWrite(client->http);
+
+    return (0);
+  }
+
+  *cacheptr = '\0';
+
+  streaming = mode == SERVER_TRANSFORM_COMMAND && (job->state_reasons & SERVER_JREASON_JOB_INCOMING);
+
+  if (streaming)
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Running command \"%s\" with streamed document data.", command);
+  else
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Running command \"%s %s\".", command, job->filename);
+#endif /* WIN32 */
+
+ /*
+  * Wait until the command can run...
+  */
+
+  start_transform(job);
+
   start = time_seconds();
 
  /*
@@ -71,80 +238,53 @@ serverTransformJob(
   */
 
   myargv[0] = (char *)command;
+#ifdef WIN32
   myargv[1] = job->filename;
+#else
+  myargv[1] = streaming ? NULL : job->filename;
+#endif /* WIN32 */
   myargv[2] = NULL;
 
  /*
-  * Copy the current environment, then add environment variables for every
-  * Job attribute and select Printer attributes...
+  * Start with a copy of the printer's environment, then add environment
+  * variables for every Job attribute...
   */
 
-  for (myenvc = 0; environ[myenvc] && myenvc < (int)(sizeof(myenvp) / sizeof(myenvp[0]) - 1); myenvc ++)
-    myenvp[myenvc] = strdup(environ[myenvc]);
-
-  if (myenvc > (int)(sizeof(myenvp) / sizeof(myenvp[0]) - 32))
+  if (!copy_env(job->printer, &myenv))
   {
-    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Too many environment variables to transform job.");
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to create environment for transform job: %s", strerror(errno));
     goto transform_failure;
   }
 
-  if (asprintf(myenvp + myenvc, "CONTENT_TYPE=%s", job->format) > 0)
-    myenvc ++;
-
-  if (job->printer->pinfo.device_uri && asprintf(myenvp + myenvc, "DEVICE_URI=%s", job->printer->pinfo.device_uri) > 0)
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->attrs, "document-name", IPP_TAG_NAME)) != NULL && asprintf(myenvp + myenvc, "DOCUMENT_NAME=%s", ippGetString(attr, 0, NULL)) > 0)
-    myenvc ++;
-
-  /* TODO: OUTPUT_ORDER, defaults (Issue #94) */
-
-  if (format && asprintf(myenvp + myenvc, "OUTPUT_TYPE=%s", format) > 0)
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "materials-col-default", IPP_TAG_BEGIN_COLLECTION)) != NULL)
+  if (myenv.num_vars > (int)(sizeof(myenv.vars) / sizeof(myenv.vars[0]) - 32))
   {
-    ippAttributeString(attr, val, sizeof(val));
-
-    if (asprintf(myenvp + myenvc, "PRINTER_MATERIALS_COL_DEFAULT=%s", val))
-      myenvc ++;
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Too many environment variables to transform job.");
+    goto transform_failure;
   }
 
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "media-default", IPP_TAG_KEYWORD)) != NULL && asprintf(myenvp + myenvc, "PRINTER_MEDIA_DEFAULT=%s", ippGetString(attr, 0, NULL)))
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "platform-temperature-default", IPP_TAG_INTEGER)) != NULL && asprintf(myenvp + myenvc, "PRINTER_PLATFORM_TEMPERATURE_DEFAULT=%d", ippGetInteger(attr, 0)))
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "print-base-default", IPP_TAG_KEYWORD)) != NULL && asprintf(myenvp + myenvc, "PRINTER_PRINT_BASE_DEFAULT=%s", ippGetString(attr, 0, NULL)))
-    myenvc ++;
+  add_env(&myenv, "CONTENT_TYPE=%s", job->format);
 
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "print-quality-default", IPP_TAG_ENUM)) != NULL && asprintf(myenvp + myenvc, "PRINTER_PRINT_QUALITY_DEFAULT=%d", ippGetInteger(attr, 0)))
-    myenvc ++;
+  if ((attr = ippFindAttribute(job->attrs, "document-name", IPP_TAG_NAME)) != NULL)
+    add_env(&myenv, "DOCUMENT_NAME=%s", ippGetString(attr, 0, NULL));
 
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "print-supports-default", IPP_TAG_INTEGER)) != NULL && asprintf(myenvp + myenvc, "PRINTER_PPRINT_SUPPORTS_DEFAULT=%s", ippGetString(attr, 0, NULL)))
-    myenvc ++;
+  if (format)
+    add_env(&myenv, "OUTPUT_TYPE=%s", format);
 
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "sides-default", IPP_TAG_KEYWORD)) != NULL && asprintf(myenvp + myenvc, "PRINTER_SIDES_DEFAULT=%s", ippGetString(attr, 0, NULL)))
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "pwg-raster-document-resolution-supported", IPP_TAG_RESOLUTION)) != NULL && ippAttributeString(attr, val, sizeof(val)) > 0 && asprintf(myenvp + myenvc, "PWG_RASTER_DOCUMENT_RESOLUTION_SUPPORTED=%s", val) > 0)
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "pwg-raster-document-sheet-back", IPP_TAG_KEYWORD)) != NULL && asprintf(myenvp + myenvc, "PWG_RASTER_DOCUMENT_SHEET_BACK=%s", ippGetString(attr, 0, NULL)) > 0)
-    myenvc ++;
-
-  if ((attr = ippFindAttribute(job->printer->pinfo.attrs, "pwg-raster-document-type-supported", IPP_TAG_RESOLUTION)) != NULL && ippAttributeString(attr, val, sizeof(val)) > 0 && asprintf(myenvp + myenvc, "PWG_RASTER_DOCUMENT_TYPE_SUPPORTED=%s", val) > 0)
-    myenvc ++;
+ /*
+  * Transform workers set the resource limits in the child process they fork
+  * for each command...
+  */
 
-  if (LogLevel == SERVER_LOGLEVEL_INFO)
-    myenvp[myenvc ++] = strdup("SERVER_LOGLEVEL=info");
-  else if (LogLevel == SERVER_LOGLEVEL_DEBUG)
-    myenvp[myenvc ++] = strdup("SERVER_LOGLEVEL=debug");
-  else
-    myenvp[myenvc ++] = strdup("SERVER_LOGLEVEL=error");
+  if (pinfo->transform_cpu > 0)
+    add_env(&myenv, "IPPTRANSFORM_CPU_LIMIT=%d", pinfo->transform_cpu);
+  if (pinfo->transform_memory > 0)
+    add_env(&myenv, "IPPTRANSFORM_MEMORY_LIMIT=%lld", (long long)pinfo->transform_memory);
+  if (pinfo->transform_nice)
+    add_env(&myenv, "IPPTRANSFORM_NICE=%d", pinfo->transform_nice);
+  if (pinfo->transform_ioclass)
+    add_env(&myenv, "IPPTRANSFORM_IOPRIORITY=%d", (pinfo->transform_ioclass << 13) | pinfo->transform_iolevel);
 
-  for (attr = ippFirstAttribute(job->attrs); attr && myenvc < (int)(sizeof(myenvp) / sizeof(myenvp[0]) - 1); attr = ippNextAttribute(job->attrs))
+  for (attr = ippFirstAttribute(job->attrs); attr; attr = ippNextAttribute(job->attrs))
   {
    /*
     * Convert "attribute-name" to "IPP_ATTRIBUTE_NAME=" and then add the
@@ -172,8 +312,17 @@ serverTransformJob(
     *valptr++ = '=';
     ippAttributeString(attr, valptr, sizeof(val) - (size_t)(valptr - val));
 
-    myenvp[myenvc++] = strdup(val);
+    if (!add_env(&myenv, "%s", val))
+      break;
   }
+
+ /*
+  * The variables are stored as offsets into a single buffer, which may have
+  * moved as it grew...
+  */
+
+  for (myenvc = 0; myenvc < myenv.num_vars; myenvc ++)
+    myenvp[myenvc] = myenv.data + myenv.vars[myenvc];
   myenvp[myenvc] = NULL;
 
  /*
@@ -184,6 +333,23 @@ serverTransformJob(
   status = _spawnvpe(_P_WAIT, command, myargv, myenvp);
 
 #else
+  if (streaming)
+  {
+   /*
+    * Don't let other commands inherit the pipe, otherwise the command won't
+    * see the end of the data...
+    */
+
+    if (pipe(mystdin))
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to create pipe for stdin: %s", strerror(errno));
+      goto transform_failure;
+    }
+
+    fcntl(mystdin[0], F_SETFD, FD_CLOEXEC);
+    fcntl(mystdin[1], F_SETFD, FD_CLOEXEC);
+  }
+
   if (mode == SERVER_TRANSFORM_TO_CLIENT)
   {
     if (pipe(mystdout))
@@ -191,6 +357,9 @@ serverTransformJob(
       serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to create pipe for stdout: %s", strerror(errno));
       goto transform_failure;
     }
+
+    fcntl(mystdout[0], F_SETFD, FD_CLOEXEC);
+    fcntl(mystdout[1], F_SETFD, FD_CLOEXEC);
   }
   else
   {
@@ -209,6 +378,8 @@ serverTransformJob(
       serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to open file for stdout: %s", strerror(errno));
       goto transform_failure;
     }
+
+    fcntl(mystdout[1], F_SETFD, FD_CLOEXEC);
   }
 
   if (pipe(mystderr))
@@ -217,37 +388,159 @@ serverTransformJob(
     goto transform_failure;
   }
 
-  posix_spawn_file_actions_init(&actions);
-  posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
-  if (mystdout[1] < 0)
-    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
-  else
-    posix_spawn_file_actions_adddup2(&actions, mystdout[1], 1);
+ /*
+  * Don't let other commands or workers inherit the pipes, otherwise we won't
+  * see the end of the output...
+  */
 
-  if (mystderr[1] < 0)
-    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
-  else
-    posix_spawn_file_actions_adddup2(&actions, mystderr[1], 2);
+  fcntl(mystderr[0], F_SETFD, FD_CLOEXEC);
+  fcntl(mystderr[1], F_SETFD, FD_CLOEXEC);
 
-  if (posix_spawn(&pid, command, &actions, NULL, myargv, myenvp))
+  if ((worker = get_worker(command)) != NULL)
   {
-    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to start job processing command: %s", strerror(errno));
+   /*
+    * Send the job to a worker...
+    */
 
-    posix_spawn_file_actions_destroy(&actions);
+    workerfds[0] = mystdin[0] >= 0 ? mystdin[0] : open("/dev/null", O_RDONLY);
+    workerfds[1] = mystdout[1];
+    workerfds[2] = mystderr[1];
 
-    goto transform_failure;
+    if (!send_worker_request(worker, myargv, myenvp, workerfds))
+    {
+      release_worker(worker, 0);
+      worker = NULL;
+    }
+
+    if (mystdin[0] < 0 && workerfds[0] >= 0)
+      close(workerfds[0]);
+
+    if (worker)
+    {
+     /*
+      * The worker replies with the process ID of the command...
+      */
+
+      while ((bytes = read(worker->fd, &pid, sizeof(pid))) < 0 && errno == EINTR);
+
+      if (bytes != sizeof(pid))
+      {
+        serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Transform worker (pid %d) stopped unexpectedly.", worker->pid);
+        release_worker(worker, 0);
+        goto transform_failure;
+      }
+    }
+  }
+
+  if (worker)
+  {
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Sent job to transform worker (pid %d), pid=%d", worker->pid, pid);
+  }
+  else if (pinfo->transform_cpu > 0 || pinfo->transform_memory > 0 || pinfo->transform_nice || pinfo->transform_ioclass)
+  {
+   /*
+    * posix_spawn() has no way to set resource limits for the new process, so
+    * fork and set them in the child before running the command...
+    */
+
+    if ((pid = fork()) == 0)
+    {
+      int	fd;			/* /dev/null */
+
+      if (mystdin[0] < 0)
+      {
+        if ((fd = open("/dev/null", O_RDONLY)) > 0)
+        {
+          dup2(fd, 0);
+          close(fd);
+        }
+      }
+      else
+        dup2(mystdin[0], 0);
+
+      dup2(mystdout[1], 1);
+      dup2(mystderr[1], 2);
+
+      set_limits(pinfo);
+
+      execve(command, myargv, myenvp);
+
+      _exit(errno);
+    }
+    else if (pid < 0)
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to start job processing command: %s", strerror(errno));
+      goto transform_failure;
+    }
+
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Started job processing command, pid=%d", pid);
   }
+  else
+  {
+    posix_spawn_file_actions_init(&actions);
+    if (mystdin[0] < 0)
+      posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    else
+      posix_spawn_file_actions_adddup2(&actions, mystdin[0], 0);
+    if (mystdout[1] < 0)
+      posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    else
+      posix_spawn_file_actions_adddup2(&actions, mystdout[1], 1);
+
+    if (mystderr[1] < 0)
+      posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    else
+      posix_spawn_file_actions_adddup2(&actions, mystderr[1], 2);
+
+    if (posix_spawn(&pid, command, &actions, NULL, myargv, myenvp))
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to start job processing command: %s", strerror(errno));
+
+      posix_spawn_file_actions_destroy(&actions);
+
+      goto transform_failure;
+    }
+
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Started job processing command, pid=%d", pid);
 
-  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Started job processing command, pid=%d", pid);
+    posix_spawn_file_actions_destroy(&actions);
+  }
 
  /*
   * Free memory used for command...
   */
 
-  posix_spawn_file_actions_destroy(&actions);
+  free(myenv.data);
+
+  if (mode == SERVER_TRANSFORM_TO_CLIENT && cachekey[0])
+  {
+   /*
+    * Save a copy of the output for the transform cache...
+    */
+
+    cachefd = serverCreateCachedTransform(cachekey, cachefile, sizeof(cachefile));
+  }
+
+  if (streaming)
+  {
+   /*
+    * Copy the document data to the command as it arrives...
+    */
+
+    close(mystdin[0]);
 
-  while (myenvc > 0)
-    free(myenvp[-- myenvc]);
+    stream.job  = job;
+    stream.fd   = mystdin[1];
+    stream.pid  = pid;
+    stream.done = 0;
+
+    if ((stream_thread = _cupsThreadCreate((_cups_thread_func_t)stream_job, &stream)) == 0)
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to create thread for streamed document data: %s", strerror(errno));
+      close(mystdin[1]);
+      streaming = 0;
+    }
+  }
 
  /*
   * Read from the stdout and stderr pipes until EOF...
@@ -268,6 +561,20 @@ serverTransformJob(
     polldata[pollcount].fd     = mystdout[0];
     polldata[pollcount].events = POLLIN;
     pollcount ++;
+
+#  ifdef HAVE_SPLICE
+   /*
+    * Output for unencrypted connections is moved from the stdout pipe to the
+    * client through a second pipe, so the size of each chunk is known before
+    * the data is sent...
+    */
+
+    if (!httpIsEncrypted(client->http) && !pipe(splicefds))
+    {
+      fcntl(splicefds[0], F_SETFD, FD_CLOEXEC);
+      fcntl(splicefds[1], F_SETFD, FD_CLOEXEC);
+    }
+#  endif /* HAVE_SPLICE */
   }
 
   while ((pollret = poll(polldata, (nfds_t)pollcount, -1)) > 0)
@@ -296,9 +603,26 @@ serverTransformJob(
 	  else if (!strncmp(line, "ATTR:", 5))
 	  {
 	   /*
-	    * Process job/printer attribute update.
+	    * Process job/printer attribute update, keeping job attributes for
+	    * the transform cache.
 	    */
 
+	    if (cachefd >= 0 && !strncmp(line, "ATTR: job-", 10))
+	    {
+	      if ((size_t)(ptr - line) < sizeof(cacheattrs) - (size_t)(cacheptr - cacheattrs))
+	      {
+	        snprintf(cacheptr, sizeof(cacheattrs) - (size_t)(cacheptr - cacheattrs), "%s\n", line);
+	        cacheptr += strlen(cacheptr);
+	      }
+	      else
+	      {
+		serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Not caching transform output, too many attributes.");
+		close(cachefd);
+		unlink(cachefile);
+		cachefd = -1;
+	      }
+	    }
+
 	    process_attr_message(job, line, mode);
 	  }
 	  else
@@ -314,19 +638,59 @@ serverTransformJob(
     }
     else if (pollcount > 1 && polldata[1].revents & POLLIN)
     {
+#  ifdef HAVE_SPLICE
+      if (splicefds[0] >= 0)
+      {
+        if (splice_output(client, job, mystdout[0], splicefds, &cachefd, cachefile))
+          clienterr = 1;
+      }
+      else
+#  endif /* HAVE_SPLICE */
       if ((bytes = read(mystdout[0], data, sizeof(data))) > 0)
-	httpWrite2(client->http, data, (size_t)bytes);
+      {
+       /*
+        * Keep reading after a client error so the command doesn't block...
+        */
+
+        if (!clienterr)
+	  httpWrite2(client->http, data, (size_t)bytes);
+
+        if (cachefd >= 0 && write(cachefd, data, (size_t)bytes) != bytes)
+        {
+          serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to write transform cache file: %s", strerror(errno));
+          close(cachefd);
+          unlink(cachefile);
+          cachefd = -1;
+        }
+      }
     }
 
-    if (polldata[0].revents & POLLHUP)
+   /*
+    * Stop when the command closes stderr, but only after reading any output
+    * still waiting in the stdout pipe...
+    */
+
+    if ((polldata[0].revents & POLLHUP) && (pollcount == 1 || !(polldata[1].revents & POLLIN)))
       break;
   }
 
+#  ifdef HAVE_SPLICE
+  if (splicefds[0] >= 0)
+  {
+    close(splicefds[0]);
+    close(splicefds[1]);
+  }
+#  endif /* HAVE_SPLICE */
+
   if (mystdout[0] >= 0)
   {
     close(mystdout[0]);
-    httpFlushWrite(client->http);
-    httpWrite2(client->http, "", 0);
+
+    if (!clienterr)
+    {
+      httpFlushWrite(client->http);
+      httpWrite2(client->http, "", 0);
+    }
   }
 
   close(mystderr[0]);
@@ -340,17 +704,68 @@ serverTransformJob(
     serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "%s: %s", command, line);
   }
 
+  if (streaming)
+  {
+   /*
+    * Stop copying document data if the command exited early.  This is done
+    * before waiting for the command so that the copy thread never kills a
+    * process ID that has been reused...
+    */
+
+    _cupsMutexLock(&job->printer->stream_mutex);
+    stream.done = 1;
+    _cupsCondBroadcast(&job->printer->stream_cond);
+    _cupsMutexUnlock(&job->printer->stream_mutex);
+
+    _cupsThreadWait(stream_thread);
+  }
+
  /*
   * Wait for child to complete...
   */
 
+  if (worker)
+  {
+   /*
+    * The worker replies with the wait status of the command...
+    */
+
+    while ((bytes = read(worker->fd, &status, sizeof(status))) < 0 && errno == EINTR);
+
+    if (bytes != sizeof(status))
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Transform worker (pid %d) stopped unexpectedly.", worker->pid);
+      status = -1;
+    }
+
+    release_worker(worker, bytes == sizeof(status));
+  }
+  else
+  {
 #  ifdef HAVE_WAITPID
-  while (waitpid(pid, &status, 0) < 0);
+    while (waitpid(pid, &status, 0) < 0);
 #  else
-  while (wait(&status) < 0);
+    while (wait(&status) < 0);
 #  endif /* HAVE_WAITPID */
+  }
+
+  if (cachefd >= 0)
+  {
+   /*
+    * Only cache the output of successful transforms...
+    */
+
+    close(cachefd);
+
+    if (status)
+      unlink(cachefile);
+    else
+      serverAddCachedTransform(cachekey, cachefile, cacheattrs);
+  }
 #endif /* WIN32 */
 
+  finish_transform(job->printer);
+
   end = time_seconds();
   serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Total transform time is %.3f seconds.", end - start);
 
@@ -362,6 +777,13 @@ serverTransformJob(
 
   transform_failure:
 
+#ifndef WIN32
+  if (mystdin[0] >= 0)
+    close(mystdin[0]);
+  if (mystdin[1] >= 0)
+    close(mystdin[1]);
+#endif /* !WIN32 */
+
   if (mystdout[0] >= 0)
     close(mystdout[0]);
   if (mystdout[1] >= 0)
@@ -372,53 +794,351 @@ serverTransformJob(
   if (mystderr[1] >= 0)
     close(mystderr[1]);
 
-  while (myenvc > 0)
-    free(myenvp[-- myenvc]);
+  free(myenv.data);
+
+  finish_transform(job->printer);
 
   return (-1);
 }
 
 
 /*
- * 'process_attr_message()' - Process an ATTR: message from a command.
+ * 'add_env()' - Add a variable to an environment.
  */
 
-static void
-process_attr_message(
-    server_job_t       *job,		/* I - Job */
-    char               *message,	/* I - Message */
-    server_transform_t mode)		/* I - Transform mode */
+static int				/* O - 1 on success, 0 on failure */
+add_env(server_env_t *env,		/* I - Environment */
+        const char   *format,		/* I - printf-style "NAME=value" string */
+        ...)				/* I - Additional arguments as needed */
 {
-  int		i,			/* Looping var */
-		num_options = 0;	/* Number of name=value pairs */
-  cups_option_t	*options = NULL,	/* name=value pairs from message */
-		*option;		/* Current option */
-  ipp_attribute_t *attr;		/* Current attribute */
+  va_list	ap;			/* Pointer to arguments */
+  int		bytes;			/* Length of variable */
+  size_t	datasize;		/* New size of buffer */
+  char		*data;			/* New buffer */
 
 
- /*
-  * Grab attributes from the message line...
-  */
+  if (env->num_vars >= (int)(sizeof(env->vars) / sizeof(env->vars[0]) - 1))
+    return (0);
 
-  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "%s", message);
+  va_start(ap, format);
+  bytes = vsnprintf(NULL, 0, format, ap);
+  va_end(ap);
 
-  num_options = cupsParseOptions(message + 5, num_options, &options);
+  if (bytes < 0)
+    return (0);
 
-  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "num_options=%d", num_options);
+  if ((env->datalen + (size_t)bytes + 1) > env->datasize)
+  {
+    for (datasize = env->datasize ? 2 * env->datasize : 4096; datasize < (env->datalen + (size_t)bytes + 1); datasize *= 2);
 
- /*
-  * Loop through the options and record them in the printer or job objects...
-  */
+    if ((data = realloc(env->data, datasize)) == NULL)
+      return (0);
 
-  for (i = num_options, option = options; i > 0; i --, option ++)
-  {
-    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "options[%d].name=\"%s\", .value=\"%s\"", num_options - i, option->name, option->value);
+    env->data     = data;
+    env->datasize = datasize;
+  }
 
-    if (!strcmp(option->name, "job-impressions"))
-    {
-     /*
-      * Update job-impressions attribute...
-      */
+  va_start(ap, format);
+  vsnprintf(env->data + env->datalen, (size_t)bytes + 1, format, ap);
+  va_end(ap);
+
+  env->vars[env->num_vars ++] = env->datalen;
+  env->datalen += (size_t)bytes + 1;
+
+  return (1);
+}
+
+
+/*
+ * 'copy_env()' - Copy the cached environment for a printer.
+ *
+ * The cached environment is rebuilt when the printer's configuration has
+ * changed.  The copy has room for the job's variables, and the caller frees
+ * "env->data" when done.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+copy_env(server_printer_t *printer,	/* I - Printer */
+         server_env_t     *env)		/* O - Copy of environment */
+{
+  server_env_t	*penv;			/* Printer's environment */
+
+
+  _cupsMutexLock(&env_mutex);
+
+  if ((penv = printer->transform_env) == NULL || penv->config_time != printer->config_time)
+  {
+    if ((penv = create_env(printer)) == NULL)
+    {
+      _cupsMutexUnlock(&env_mutex);
+      env->data = NULL;
+      return (0);
+    }
+
+    if (printer->transform_env)
+    {
+      free(printer->transform_env->data);
+      free(printer->transform_env);
+    }
+
+    printer->transform_env = penv;
+  }
+
+  memcpy(env, penv, sizeof(server_env_t));
+
+  env->datasize = penv->datalen + 4096;
+
+  if ((env->data = malloc(env->datasize)) != NULL)
+    memcpy(env->data, penv->data, penv->datalen);
+
+  _cupsMutexUnlock(&env_mutex);
+
+  return (env->data != NULL);
+}
+
+
+/*
+ * 'create_env()' - Create the environment for a printer's commands.
+ *
+ * The environment contains a copy of the server's environment and variables
+ * for select Printer attributes.
+ */
+
+static server_env_t *			/* O - Environment or NULL on error */
+create_env(server_printer_t *printer)	/* I - Printer */
+{
+  int		i;			/* Looping var */
+  server_env_t	*env;			/* Environment */
+  ipp_attribute_t *attr;		/* Printer attribute */
+  char		val[1280];		/* Attribute value */
+
+
+  if ((env = calloc(1, sizeof(server_env_t))) == NULL)
+    return (NULL);
+
+  env->config_time = printer->config_time;
+
+  for (i = 0; environ[i]; i ++)
+    if (!add_env(env, "%s", environ[i]))
+      break;
+
+  if (printer->pinfo.device_uri)
+    add_env(env, "DEVICE_URI=%s", printer->pinfo.device_uri);
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "materials-col-default", IPP_TAG_BEGIN_COLLECTION)) != NULL)
+  {
+    ippAttributeString(attr, val, sizeof(val));
+    add_env(env, "PRINTER_MATERIALS_COL_DEFAULT=%s", val);
+  }
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "media-default", IPP_TAG_KEYWORD)) != NULL)
+    add_env(env, "PRINTER_MEDIA_DEFAULT=%s", ippGetString(attr, 0, NULL));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "platform-temperature-default", IPP_TAG_INTEGER)) != NULL)
+    add_env(env, "PRINTER_PLATFORM_TEMPERATURE_DEFAULT=%d", ippGetInteger(attr, 0));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "print-base-default", IPP_TAG_KEYWORD)) != NULL)
+    add_env(env, "PRINTER_PRINT_BASE_DEFAULT=%s", ippGetString(attr, 0, NULL));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "print-quality-default", IPP_TAG_ENUM)) != NULL)
+    add_env(env, "PRINTER_PRINT_QUALITY_DEFAULT=%d", ippGetInteger(attr, 0));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "print-supports-default", IPP_TAG_INTEGER)) != NULL)
+    add_env(env, "PRINTER_PPRINT_SUPPORTS_DEFAULT=%s", ippGetString(attr, 0, NULL));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "sides-default", IPP_TAG_KEYWORD)) != NULL)
+    add_env(env, "PRINTER_SIDES_DEFAULT=%s", ippGetString(attr, 0, NULL));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "pwg-raster-document-resolution-supported", IPP_TAG_RESOLUTION)) != NULL && ippAttributeString(attr, val, sizeof(val)) > 0)
+    add_env(env, "PWG_RASTER_DOCUMENT_RESOLUTION_SUPPORTED=%s", val);
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "pwg-raster-document-sheet-back", IPP_TAG_KEYWORD)) != NULL)
+    add_env(env, "PWG_RASTER_DOCUMENT_SHEET_BACK=%s", ippGetString(attr, 0, NULL));
+
+  if ((attr = ippFindAttribute(printer->pinfo.attrs, "pwg-raster-document-type-supported", IPP_TAG_RESOLUTION)) != NULL && ippAttributeString(attr, val, sizeof(val)) > 0)
+    add_env(env, "PWG_RASTER_DOCUMENT_TYPE_SUPPORTED=%s", val);
+
+  if (LogLevel == SERVER_LOGLEVEL_INFO)
+    add_env(env, "SERVER_LOGLEVEL=info");
+  else if (LogLevel == SERVER_LOGLEVEL_DEBUG)
+    add_env(env, "SERVER_LOGLEVEL=debug");
+  else
+    add_env(env, "SERVER_LOGLEVEL=error");
+
+  if (!env->data)
+  {
+    free(env);
+    return (NULL);
+  }
+
+  return (env);
+}
+
+
+/*
+ * 'finish_transform()' - Finish running a command.
+ *
+ * When commands are waiting to run, the slot goes to the waiting command
+ * whose printer has the fewest running commands and, of those, the printer
+ * that least recently ran a command.  This way one busy printer can't keep the
+ * others from running their jobs.
+ */
+
+static void
+finish_transform(
+    server_printer_t *printer)		/* I - Printer */
+{
+  server_twait_t	*twait,		/* Current waiting command */
+			**prev,		/* Pointer to current waiting command */
+			**best;		/* Pointer to waiting command to run */
+
+
+  _cupsMutexLock(&transform_mutex);
+
+  num_transforms --;
+  printer->num_transforms --;
+
+  while (transform_queue && num_transforms < MaxTransforms)
+  {
+    for (best = &transform_queue, prev = &transform_queue; (twait = *prev) != NULL; prev = &twait->next)
+    {
+      if (twait->printer->num_transforms < (*best)->printer->num_transforms || (twait->printer->num_transforms == (*best)->printer->num_transforms && twait->printer->last_transform < (*best)->printer->last_transform))
+        best = prev;
+    }
+
+    twait        = *best;
+    *best        = twait->next;
+    twait->ready = 1;
+
+    num_transforms ++;
+    num_queued_transforms --;
+    twait->printer->num_transforms ++;
+    twait->printer->num_queued_transforms --;
+    twait->printer->last_transform = ++ transform_seq;
+  }
+
+  _cupsCondBroadcast(&transform_cond);
+
+  update_transform_stats();
+
+  _cupsMutexUnlock(&transform_mutex);
+}
+
+
+#ifndef WIN32
+/*
+ * 'get_worker()' - Get an idle transform worker for a command.
+ *
+ * Only "ipptransform" supports running as a worker.  A new worker is started
+ * when there are no idle workers for the command and fewer than
+ * "TransformWorkers" workers are running.
+ */
+
+static server_worker_t *		/* O - Worker or NULL to start command */
+get_worker(const char *command)		/* I - Command */
+{
+  const char		*name;		/* Command name */
+  server_worker_t	*worker,	/* Current worker */
+			*prev;		/* Previous worker */
+
+
+  if ((name = strrchr(command, '/')) != NULL)
+    name ++;
+  else
+    name = command;
+
+  if (TransformWorkers <= 0 || strcmp(name, "ipptransform"))
+    return (NULL);
+
+  _cupsMutexLock(&worker_mutex);
+
+  for (prev = NULL, worker = idle_workers; worker; prev = worker, worker = worker->next)
+  {
+    if (!strcmp(worker->command, command))
+    {
+      if (prev)
+        prev->next = worker->next;
+      else
+        idle_workers = worker->next;
+
+      worker->next = NULL;
+      break;
+    }
+  }
+
+  if (worker || num_workers >= TransformWorkers || (unsupported_workers && cupsArrayFind(unsupported_workers, (void *)command)))
+  {
+    _cupsMutexUnlock(&worker_mutex);
+    return (worker);
+  }
+
+  num_workers ++;
+
+  _cupsMutexUnlock(&worker_mutex);
+
+  if ((worker = start_worker(command)) == NULL)
+  {
+   /*
+    * Don't try again with a command that can't run as a worker...
+    */
+
+    _cupsMutexLock(&worker_mutex);
+
+    num_workers --;
+
+    if (!unsupported_workers)
+      unsupported_workers = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0, (cups_acopy_func_t)strdup, (cups_afree_func_t)free);
+
+    cupsArrayAdd(unsupported_workers, (void *)command);
+
+    _cupsMutexUnlock(&worker_mutex);
+  }
+
+  return (worker);
+}
+#endif /* !WIN32 */
+
+
+/*
+ * 'process_attr_message()' - Process an ATTR: message from a command.
+ */
+
+static void
+process_attr_message(
+    server_job_t       *job,		/* I - Job */
+    char               *message,	/* I - Message */
+    server_transform_t mode)		/* I - Transform mode */
+{
+  int		i,			/* Looping var */
+		num_options = 0;	/* Number of name=value pairs */
+  cups_option_t	*options = NULL,	/* name=value pairs from message */
+		*option;		/* Current option */
+  ipp_attribute_t *attr;		/* Current attribute */
+
+
+ /*
+  * Grab attributes from the message line...
+  */
+
+  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "%s", message);
+
+  num_options = cupsParseOptions(message + 5, num_options, &options);
+
+  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "num_options=%d", num_options);
+
+ /*
+  * Loop through the options and record them in the printer or job objects...
+  */
+
+  for (i = num_options, option = options; i > 0; i --, option ++)
+  {
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "options[%d].name=\"%s\", .value=\"%s\"", num_options - i, option->name, option->value);
+
+    if (!strcmp(option->name, "job-impressions"))
+    {
+     /*
+      * Update job-impressions attribute...
+      */
 
       serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Setting Job Status attribute \"%s\" to \"%s\".", option->name, option->value);
 
@@ -577,9 +1297,547 @@ process_state_message(
   }
 
   job->printer->state_reasons = state_reasons;
+
+  serverSignalPrinterStateReasons(job->printer);
+}
+
+
+#ifndef WIN32
+/*
+ * 'release_worker()' - Return a worker to the pool or stop it.
+ */
+
+static void
+release_worker(
+    server_worker_t *worker,		/* I - Worker */
+    int             reuse)		/* I - 1 to reuse, 0 to stop */
+{
+  int	status;				/* Exit status */
+
+
+  if (reuse)
+  {
+    _cupsMutexLock(&worker_mutex);
+    worker->next = idle_workers;
+    idle_workers = worker;
+    _cupsMutexUnlock(&worker_mutex);
+    return;
+  }
+
+  close(worker->fd);
+  kill(worker->pid, SIGTERM);
+  while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR);
+
+  serverLog(SERVER_LOGLEVEL_INFO, "Stopped transform worker for \"%s\" (pid %d).", worker->command, worker->pid);
+
+  free(worker->command);
+  free(worker);
+
+  _cupsMutexLock(&worker_mutex);
+  num_workers --;
+  _cupsMutexUnlock(&worker_mutex);
+}
+
+
+/*
+ * 'send_worker_request()' - Send a transform request to a worker.
+ *
+ * The request is a 32-bit length followed by the nul-terminated arguments, an
+ * empty string, and the nul-terminated environment strings.  The stdin,
+ * stdout, and stderr file descriptors are sent along with the request.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+send_worker_request(
+    server_worker_t *worker,		/* I - Worker */
+    char            **argv,		/* I - Command-line arguments */
+    char            **envp,		/* I - Environment variables */
+    int             fds[3])		/* I - stdin, stdout, and stderr */
+{
+  int		i;			/* Looping var */
+  size_t	length = 1;		/* Length of strings */
+  unsigned	ulength;		/* 32-bit length of strings */
+  char		*buffer,		/* Request buffer */
+		*bufptr,		/* Pointer into request */
+		*bufend;		/* End of request */
+  ssize_t	bytes;			/* Bytes written */
+  struct iovec	iov;			/* I/O vector for request */
+  struct msghdr	msg;			/* Request message */
+  struct cmsghdr *cmsg;			/* Control message */
+  union
+  {
+    struct cmsghdr	cmsg;		/* Control message header */
+    char		data[CMSG_SPACE(3 * sizeof(int))];
+					/* Control message data */
+  }		control;		/* Control message buffer */
+  int		flags = 0;		/* Send flags */
+
+
+ /*
+  * Build the request...
+  */
+
+  for (i = 0; argv[i]; i ++)
+    length += strlen(argv[i]) + 1;
+  for (i = 0; envp[i]; i ++)
+    length += strlen(envp[i]) + 1;
+
+  if ((buffer = malloc(sizeof(ulength) + length)) == NULL)
+    return (0);
+
+  ulength = (unsigned)length;
+  memcpy(buffer, &ulength, sizeof(ulength));
+
+  for (bufptr = buffer + sizeof(ulength), i = 0; argv[i]; i ++)
+  {
+    memcpy(bufptr, argv[i], strlen(argv[i]) + 1);
+    bufptr += strlen(argv[i]) + 1;
+  }
+
+  *bufptr++ = '\0';
+
+  for (i = 0; envp[i]; i ++)
+  {
+    memcpy(bufptr, envp[i], strlen(envp[i]) + 1);
+    bufptr += strlen(envp[i]) + 1;
+  }
+
+  bufend = bufptr;
+
+ /*
+  * Send it with the file descriptors...
+  */
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+
+  iov.iov_base       = buffer;
+  iov.iov_len        = (size_t)(bufend - buffer);
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.data;
+  msg.msg_controllen = sizeof(control.data);
+
+  cmsg             = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(3 * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+#ifdef MSG_NOSIGNAL
+  flags = MSG_NOSIGNAL;
+#endif /* MSG_NOSIGNAL */
+
+  while ((bytes = sendmsg(worker->fd, &msg, flags)) < 0 && errno == EINTR);
+
+  for (bufptr = buffer + (bytes > 0 ? bytes : 0); bytes > 0 && bufptr < bufend; bufptr += bytes)
+  {
+    while ((bytes = send(worker->fd, bufptr, (size_t)(bufend - bufptr), flags)) < 0 && errno == EINTR);
+  }
+
+  free(buffer);
+
+  if (bytes <= 0)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to send request to transform worker (pid %d): %s", worker->pid, strerror(errno));
+    return (0);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'set_limits()' - Apply the printer's resource limits to a command.
+ *
+ * This is called in the child process before running the command, so errors
+ * are written to the command's standard error which goes to the job log.
+ */
+
+static void
+set_limits(server_pinfo_t *pinfo)	/* I - Printer information */
+{
+  struct rlimit	limit;			/* Resource limit */
+
+
+  if (pinfo->transform_cpu > 0)
+  {
+   /*
+    * Send SIGXCPU at the limit and SIGKILL a few seconds later if the command
+    * doesn't exit...
+    */
+
+    limit.rlim_cur = (rlim_t)pinfo->transform_cpu;
+    limit.rlim_max = (rlim_t)pinfo->transform_cpu + 5;
+
+    if (setrlimit(RLIMIT_CPU, &limit))
+      write_error("ERROR: Unable to set CPU time limit for command.\n");
+  }
+
+  if (pinfo->transform_memory > 0)
+  {
+    limit.rlim_cur = limit.rlim_max = (rlim_t)pinfo->transform_memory;
+
+    if (setrlimit(RLIMIT_AS, &limit))
+      write_error("ERROR: Unable to set memory limit for command.\n");
+  }
+
+  if (pinfo->transform_nice && setpriority(PRIO_PROCESS, 0, pinfo->transform_nice))
+    write_error("ERROR: Unable to set nice value for command.\n");
+
+#ifdef SYS_ioprio_set
+  if (pinfo->transform_ioclass && syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, (pinfo->transform_ioclass << 13) | pinfo->transform_iolevel))
+    write_error("ERROR: Unable to set I/O priority for command.\n");
+#endif /* SYS_ioprio_set */
+}
+
+
+#  ifdef HAVE_SPLICE
+/*
+ * 'splice_output()' - Move output from a command to the client.
+ *
+ * The output is moved without copying it through a user space buffer.  When
+ * caching, tee() leaves the data in the stdout pipe so it can then be moved to
+ * the cache file.  If the output can't be spliced, the pipe is closed and the
+ * caller copies the rest of the output.  If sending fails, -1 is returned and
+ * the caller must not write anything more to the client.
+ */
+
+static int				/* O  - 0 on success, -1 if the client connection failed */
+splice_output(
+    server_client_t *client,		/* I  - Client connection */
+    server_job_t    *job,		/* I  - Job */
+    int             fd,			/* I  - Command's stdout pipe */
+    int             pipefds[2],		/* IO - Pipe to client */
+    int             *cachefd,		/* IO - Transform cache file or -1 */
+    const char      *cachefile)		/* I  - Transform cache filename */
+{
+  ssize_t	bytes,			/* Bytes in pipe */
+		total,			/* Total bytes moved to cache file */
+		moved;			/* Bytes moved */
+  char		data[32768];		/* Data that can't be moved */
+
+
+  if (*cachefd >= 0)
+    bytes = tee(fd, pipefds[1], sizeof(data), 0);
+  else
+    bytes = splice(fd, NULL, pipefds[1], NULL, sizeof(data), SPLICE_F_MOVE);
+
+  if (bytes < 0 && errno != EINTR && errno != EAGAIN)
+  {
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Unable to splice output to client: %s", strerror(errno));
+
+    close(pipefds[0]);
+    close(pipefds[1]);
+
+    pipefds[0] = pipefds[1] = -1;
+  }
+
+  if (bytes <= 0)
+    return (0);
+
+  if (*cachefd >= 0)
+  {
+    for (total = 0; total < bytes; total += moved)
+    {
+      if ((moved = splice(fd, NULL, *cachefd, NULL, (size_t)(bytes - total), SPLICE_F_MOVE)) <= 0)
+        break;
+    }
+
+    if (total < bytes)
+    {
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to write transform cache file: %s", strerror(errno));
+      close(*cachefd);
+      unlink(cachefile);
+      *cachefd = -1;
+
+     /*
+      * Discard the rest of the copy that tee() left in the stdout pipe...
+      */
+
+      while (total < bytes && (moved = read(fd, data, (size_t)(bytes - total))) > 0)
+        total += moved;
+    }
+  }
+
+  if ((moved = _httpSpliceWrite(client->http, pipefds[0], (size_t)bytes)) > 0)
+    return (0);
+
+  if (moved == 0)
+  {
+   /*
+    * Splicing isn't supported for this response, send what is in the pipe
+    * normally...
+    */
+
+    while (bytes > 0 && (moved = read(pipefds[0], data, (size_t)bytes)) > 0)
+    {
+      httpWrite2(client->http, data, (size_t)moved);
+      bytes -= moved;
+    }
+  }
+  else
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Unable to send output to client: %s", strerror(httpError(client->http)));
+
+ /*
+  * Stop splicing - on error part of a chunk may have been sent, so nothing
+  * more can be written to the client...
+  */
+
+  close(pipefds[0]);
+  close(pipefds[1]);
+
+  pipefds[0] = pipefds[1] = -1;
+
+  return (moved < 0 ? -1 : 0);
+}
+#  endif /* HAVE_SPLICE */
+#endif /* !WIN32 */
+
+
+/*
+ * 'start_transform()' - Wait until a command can be run.
+ *
+ * When "MaxTransforms" commands are already running, the caller waits in a
+ * queue shared by all printers until finish_transform() picks it.
+ */
+
+static void
+start_transform(server_job_t *job)	/* I - Job */
+{
+  server_printer_t	*printer = job->printer;
+					/* Printer */
+  server_twait_t	twait,		/* Waiting command */
+			**prev;		/* Pointer to last waiting command */
+
+
+  _cupsMutexLock(&transform_mutex);
+
+  if (MaxTransforms <= 0 || (!transform_queue && num_transforms < MaxTransforms))
+  {
+    num_transforms ++;
+    printer->num_transforms ++;
+    printer->last_transform = ++ transform_seq;
+  }
+  else
+  {
+    twait.next    = NULL;
+    twait.printer = printer;
+    twait.ready   = 0;
+
+    for (prev = &transform_queue; *prev; prev = &(*prev)->next);
+    *prev = &twait;
+
+    num_queued_transforms ++;
+    printer->num_queued_transforms ++;
+
+    update_transform_stats();
+
+    serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Waiting to run command, %d running and %d waiting.", num_transforms, num_queued_transforms);
+
+    while (!twait.ready)
+      _cupsCondWait(&transform_cond, &transform_mutex, 0.0);
+  }
+
+  update_transform_stats();
+
+  _cupsMutexUnlock(&transform_mutex);
+}
+
+
+#ifndef WIN32
+/*
+ * 'start_worker()' - Start a transform worker.
+ */
+
+static server_worker_t *		/* O - Worker or NULL on error */
+start_worker(const char *command)	/* I - Command */
+{
+  int		sv[2];			/* Socket pair */
+  int		pid,			/* Process ID */
+		status;			/* Ready status */
+  char		*myargv[3];		/* Command-line arguments */
+  posix_spawn_file_actions_t actions;	/* Spawn file actions */
+  struct pollfd	polldata;		/* Poll data */
+  server_worker_t *worker;		/* New worker */
+
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to create socket for transform worker: %s", strerror(errno));
+    return (NULL);
+  }
+
+  fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+  fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+  status = 1;
+  setsockopt(sv[0], SOL_SOCKET, SO_NOSIGPIPE, &status, sizeof(status));
+#endif /* SO_NOSIGPIPE */
+
+  myargv[0] = (char *)command;
+  myargv[1] = (char *)"--worker";
+  myargv[2] = NULL;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, sv[1], 0);
+  posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+  status = posix_spawn(&pid, command, &actions, NULL, myargv, environ);
+
+  posix_spawn_file_actions_destroy(&actions);
+  close(sv[1]);
+
+  if (status)
+  {
+    serverLog(SERVER_LOGLEVEL_ERROR, "Unable to start transform worker for \"%s\": %s", command, strerror(status));
+    close(sv[0]);
+    return (NULL);
+  }
+
+ /*
+  * Wait for the worker to say it is ready...
+  */
+
+  polldata.fd     = sv[0];
+  polldata.events = POLLIN;
+
+  if (poll(&polldata, 1, 30000) <= 0 || read(sv[0], &status, sizeof(status)) != sizeof(status) || status || (worker = calloc(1, sizeof(server_worker_t))) == NULL)
+  {
+    serverLog(SERVER_LOGLEVEL_INFO, "\"%s\" does not support running as a transform worker.", command);
+    close(sv[0]);
+    kill(pid, SIGTERM);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return (NULL);
+  }
+
+  worker->command = strdup(command);
+  worker->pid     = pid;
+  worker->fd      = sv[0];
+
+  serverLog(SERVER_LOGLEVEL_INFO, "Started transform worker for \"%s\" (pid %d).", command, pid);
+
+  return (worker);
 }
 
 
+/*
+ * 'stream_job()' - Copy streamed document data to a command.
+ *
+ * The data is read from the job's spool file as the client writes it.  When
+ * we catch up with the client we wait for more data, for the "job-incoming"
+ * reason to be cleared, for the job to be canceled, or for the command to
+ * exit.  A job that is canceled or aborted before all of its data arrives
+ * has an incomplete document, so the command is killed rather than being
+ * sent an end-of-file that would let it print the partial document.
+ */
+
+static void *				/* O - Thread exit status */
+stream_job(server_stream_t *stream)	/* I - Streamed document data */
+{
+  server_job_t	*job = stream->job;	/* Job */
+  server_printer_t *printer = job->printer;
+					/* Printer */
+  int		fd;			/* Spool file */
+  char		buffer[32768],		/* Copy buffer */
+		*bufptr;		/* Pointer into buffer */
+  ssize_t	bytes,			/* Bytes read */
+		written;		/* Bytes written */
+  off_t		offset = 0;		/* Bytes copied so far */
+  struct stat	fileinfo;		/* Spool file information */
+  int		incoming = 1,		/* Is data still arriving? */
+		stop;			/* Stop copying? */
+
+
+  if ((fd = open(job->filename, O_RDONLY)) < 0)
+  {
+    serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to open print file: %s", strerror(errno));
+    close(stream->fd);
+    return (NULL);
+  }
+
+  for (;;)
+  {
+    if ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+      offset += bytes;
+
+      for (bufptr = buffer; bytes > 0; bufptr += written, bytes -= written)
+      {
+        if ((written = write(stream->fd, bufptr, (size_t)bytes)) < 0)
+        {
+          if (errno == EINTR)
+          {
+            written = 0;
+            continue;
+	  }
+
+          serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Unable to copy document data to command: %s", strerror(errno));
+          goto stream_done;
+	}
+      }
+    }
+    else if (bytes < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      serverLogJob(SERVER_LOGLEVEL_ERROR, job, "Unable to read print file: %s", strerror(errno));
+      break;
+    }
+    else if (!incoming)
+    {
+     /*
+      * All of the document data has been copied...
+      */
+
+      break;
+    }
+    else
+    {
+     /*
+      * Wait for the client to write more data...
+      */
+
+      _cupsMutexLock(&printer->stream_mutex);
+
+      while (!stream->done && !job->cancel && (job->state_reasons & SERVER_JREASON_JOB_INCOMING) && !fstat(fd, &fileinfo) && fileinfo.st_size <= offset)
+        _cupsCondWait(&printer->stream_cond, &printer->stream_mutex, 0.0);
+
+      incoming = (job->state_reasons & SERVER_JREASON_JOB_INCOMING) != 0;
+      stop     = stream->done || job->cancel;
+
+      if (job->cancel && !stream->done)
+      {
+       /*
+        * Kill the command while it has not been waited for, so the process ID
+	* can't have been reused...
+	*/
+
+        serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Stopping command with incomplete document data.");
+        kill(stream->pid, SIGTERM);
+      }
+
+      _cupsMutexUnlock(&printer->stream_mutex);
+
+      if (stop)
+        break;
+    }
+  }
+
+  stream_done:
+
+  serverLogJob(SERVER_LOGLEVEL_DEBUG, job, "Copied %ld bytes of document data to command.", (long)offset);
+
+  close(fd);
+  close(stream->fd);
+
+  return (NULL);
+}
+#endif /* !WIN32 */
+
+
 /*
  * 'time_seconds()' - Return the current time in fractional seconds.
  */
@@ -604,3 +1862,41 @@ time_seconds(void)
   return ((double)curtime.tv_sec + 0.000001 * curtime.tv_usec);
 #endif /* WIN32 */
 }
+
+
+/*
+ * 'update_transform_stats()' - Update the running and waiting command counts.
+ *
+ * The caller must hold the transform mutex.
+ */
+
+static void
+update_transform_stats(void)
+{
+  _cupsMutexLock(&StatsMutex);
+
+  Stats.transforms        = num_transforms;
+  Stats.transforms_queued = num_queued_transforms;
+
+  _cupsMutexUnlock(&StatsMutex);
+}
+
+
+#ifndef WIN32
+/*
+ * 'write_error()' - Write an error message to the standard error.
+ *
+ * Only write() is used since the message is written in a child process
+ * forked from a multi-threaded server.
+ */
+
+static void
+write_error(const char *message)	/* I - Message */
+{
+  ssize_t	bytes;			/* Bytes written */
+
+
+  bytes = write(2, message, strlen(message));
+  (void)bytes;
+}
+#endif /* !WIN32 */
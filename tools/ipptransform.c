@@ -12,6 +12,12 @@
 #include <cups/array-private.h>
 #include <cups/string-private.h>
 #include <cups/thread-private.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef __linux
+#  include <sys/syscall.h>
+#endif /* __linux */
 
 #ifdef __APPLE__
 #  include <ApplicationServices/ApplicationServices.h>
@@ -88,6 +94,9 @@ struct xform_raster_s
  */
 
 static int	Verbosity = 0;		/* Log level */
+#ifdef HAVE_MUPDF
+static fz_context *Context = NULL;	/* Initialized context for workers */
+#endif /* HAVE_MUPDF */
 
 
 /*
@@ -113,6 +122,8 @@ static void	raster_init(xform_raster_t *ras);
 static void	raster_start_job(xform_raster_t *ras, xform_write_cb_t cb, void *ctx);
 static void	raster_start_page(xform_raster_t *ras, unsigned page, xform_write_cb_t cb, void *ctx);
 static void	raster_write_line(xform_raster_t *ras, unsigned y, const unsigned char *line, xform_write_cb_t cb, void *ctx);
+static int	run_worker(int *argc, char ***argv);
+static void	set_limits(void);
 static void	usage(int status) __attribute__((noreturn));
 static ssize_t	write_fd(int *fd, const unsigned char *buffer, size_t bytes);
 static int	xform_document(const char *filename, const char *informat, const char *outformat, const char *resolutions, const char *sheet_back, const char *types, int num_options, cups_option_t *options, xform_write_cb_t cb, void *ctx);
@@ -148,6 +159,14 @@ main(int  argc,				/* I - Number of command-line args */
   _cups_thread_t monitor = 0;		/* Monitoring thread ID */
 
 
+ /*
+  * Run as a worker for ippserver?  Workers only return here in the child
+  * process for each request, with the request's arguments and environment.
+  */
+
+  if (argc == 2 && !strcmp(argv[1], "--worker") && (status = run_worker(&argc, &argv)) >= 0)
+    return (status);
+
  /*
   * Process the command-line...
   */
@@ -1306,6 +1325,244 @@ raster_write_line(
 }
 
 
+/*
+ * 'run_worker()' - Run as a transform worker for ippserver.
+ *
+ * The worker reads requests from the socket on stdin.  Each request is a
+ * 32-bit length followed by the nul-terminated command-line arguments, an
+ * empty string, and the nul-terminated environment strings, and carries the
+ * file descriptors to use for stdin, stdout, and stderr.  The worker forks a
+ * child process for each request so that the transform starts with the
+ * worker's initialized MuPDF context, and then replies with the child's
+ * process ID and, once it exits, its wait status.  A zero status is sent when
+ * the worker is ready.
+ *
+ * Returns the worker's exit status, or -1 in the child process with "argc",
+ * "argv", and the environment set from the request.
+ */
+
+static int				/* O - Exit status or -1 in child */
+run_worker(int  *argc,			/* IO - Number of command-line args */
+           char ***argv)		/* IO - Command-line arguments */
+{
+  int		sock = 0;		/* Socket to ippserver */
+  unsigned	length;			/* Length of request */
+  char		*buffer = NULL,		/* Request buffer */
+		*bufptr,		/* Pointer into request */
+		*bufend;		/* End of request */
+  size_t	bufsize = 0;		/* Size of request buffer */
+  ssize_t	bytes;			/* Bytes read */
+  struct iovec	iov;			/* I/O vector for request length */
+  struct msghdr	msg;			/* Request message */
+  struct cmsghdr *cmsg;			/* Control message */
+  union
+  {
+    struct cmsghdr	cmsg;		/* Control message header */
+    char		data[CMSG_SPACE(3 * sizeof(int))];
+					/* Control message data */
+  }		control;		/* Control message buffer */
+  int		fds[3],			/* stdin, stdout, and stderr */
+		status = 0;		/* Wait status */
+  pid_t		pid;			/* Child process ID */
+  static char	*wargv[100],		/* Request arguments */
+		*wenvp[500];		/* Request environment */
+  int		wargc,			/* Number of arguments */
+		wenvc;			/* Number of environment strings */
+
+
+#ifdef HAVE_MUPDF
+ /*
+  * Initialize the MuPDF context and document handlers once for all requests...
+  */
+
+  if ((Context = fz_new_context(NULL, NULL, FZ_STORE_UNLIMITED)) == NULL)
+  {
+    fputs("ERROR: Unable to create context.\n", stderr);
+    return (1);
+  }
+
+  fz_register_document_handlers(Context);
+#endif /* HAVE_MUPDF */
+
+  if (write(sock, &status, sizeof(status)) != sizeof(status))
+    return (1);
+
+  for (;;)
+  {
+   /*
+    * Read the length of the request and the file descriptors...
+    */
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base       = &length;
+    iov.iov_len        = sizeof(length);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.data;
+    msg.msg_controllen = sizeof(control.data);
+
+    while ((bytes = recvmsg(sock, &msg, 0)) < 0 && errno == EINTR);
+
+    if (bytes <= 0)
+      break;				/* ippserver closed the socket */
+    else if (bytes != sizeof(length) || (cmsg = CMSG_FIRSTHDR(&msg)) == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+    {
+      fputs("ERROR: Bad worker request.\n", stderr);
+      return (1);
+    }
+
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+   /*
+    * Read the arguments and environment...
+    */
+
+    if (length == 0 || length > 1048576)
+    {
+      fputs("ERROR: Bad worker request length.\n", stderr);
+      return (1);
+    }
+
+    if (length >= bufsize)
+    {
+      free(buffer);
+
+      bufsize = length + 1;
+      if ((buffer = malloc(bufsize)) == NULL)
+      {
+        fputs("ERROR: Unable to allocate memory for worker request.\n", stderr);
+        return (1);
+      }
+    }
+
+    for (bufptr = buffer, bufend = buffer + length; bufptr < bufend; bufptr += bytes)
+    {
+      if ((bytes = read(sock, bufptr, (size_t)(bufend - bufptr))) <= 0)
+      {
+        if (bytes < 0 && errno == EINTR)
+        {
+          bytes = 0;
+          continue;
+        }
+
+	fputs("ERROR: Short worker request.\n", stderr);
+	return (1);
+      }
+    }
+
+    *bufend = '\0';
+
+    if ((pid = fork()) == 0)
+    {
+     /*
+      * Child process: use the request's file descriptors, arguments, and
+      * environment and return to main()...
+      */
+
+      dup2(fds[0], 0);
+      dup2(fds[1], 1);
+      dup2(fds[2], 2);
+      close(fds[0]);
+      close(fds[1]);
+      close(fds[2]);
+
+      for (bufptr = buffer, wargc = 0; bufptr < bufend && *bufptr && wargc < (int)(sizeof(wargv) / sizeof(wargv[0]) - 1); bufptr += strlen(bufptr) + 1)
+        wargv[wargc ++] = bufptr;
+      wargv[wargc] = NULL;
+
+      for (bufptr += strlen(bufptr) + 1, wenvc = 0; bufptr < bufend && wenvc < (int)(sizeof(wenvp) / sizeof(wenvp[0]) - 1); bufptr += strlen(bufptr) + 1)
+        wenvp[wenvc ++] = bufptr;
+      wenvp[wenvc] = NULL;
+
+      environ = wenvp;
+      *argc   = wargc;
+      *argv   = wargv;
+
+      set_limits();
+
+      return (-1);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    close(fds[2]);
+
+   /*
+    * Reply with the process ID so ippserver can apply resource limits, and
+    * then with the wait status...
+    */
+
+    status = (int)pid;
+
+    if (write(sock, &status, sizeof(status)) != sizeof(status))
+      break;
+
+    if (pid < 0)
+    {
+      fprintf(stderr, "ERROR: Unable to fork worker process: %s\n", strerror(errno));
+      status = 1 << 8;
+    }
+    else
+    {
+      while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    }
+
+    if (write(sock, &status, sizeof(status)) != sizeof(status))
+      break;
+  }
+
+  free(buffer);
+
+  return (0);
+}
+
+
+/*
+ * 'set_limits()' - Set the resource limits from ippserver for a worker child.
+ *
+ * ippserver passes the limits it would set for the command in the
+ * IPPTRANSFORM_CPU_LIMIT, IPPTRANSFORM_MEMORY_LIMIT, IPPTRANSFORM_NICE, and
+ * IPPTRANSFORM_IOPRIORITY environment variables.
+ */
+
+static void
+set_limits(void)
+{
+  const char	*value;			/* Environment variable value */
+  struct rlimit	limit;			/* Resource limit */
+
+
+  if ((value = getenv("IPPTRANSFORM_CPU_LIMIT")) != NULL && atoi(value) > 0)
+  {
+   /*
+    * Send SIGXCPU at the limit and SIGKILL a few seconds later...
+    */
+
+    limit.rlim_cur = (rlim_t)atoi(value);
+    limit.rlim_max = limit.rlim_cur + 5;
+
+    if (setrlimit(RLIMIT_CPU, &limit))
+      fprintf(stderr, "ERROR: Unable to set CPU time limit: %s\n", strerror(errno));
+  }
+
+  if ((value = getenv("IPPTRANSFORM_MEMORY_LIMIT")) != NULL && strtoll(value, NULL, 10) > 0)
+  {
+    limit.rlim_cur = limit.rlim_max = (rlim_t)strtoll(value, NULL, 10);
+
+    if (setrlimit(RLIMIT_AS, &limit))
+      fprintf(stderr, "ERROR: Unable to set memory limit: %s\n", strerror(errno));
+  }
+
+  if ((value = getenv("IPPTRANSFORM_NICE")) != NULL && atoi(value) && setpriority(PRIO_PROCESS, 0, atoi(value)))
+    fprintf(stderr, "ERROR: Unable to set nice value: %s\n", strerror(errno));
+
+#ifdef SYS_ioprio_set
+  if ((value = getenv("IPPTRANSFORM_IOPRIORITY")) != NULL && atoi(value) > 0 && syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, atoi(value)))
+    fprintf(stderr, "ERROR: Unable to set I/O priority: %s\n", strerror(errno));
+#endif /* SYS_ioprio_set */
+}
+
+
 /*
  * 'usage()' - Show program usage.
  */
@@ -1316,6 +1573,7 @@ usage(int status)			/* I - Exit status */
   puts("Usage: ipptransform [options] filename\n");
   puts("Options:");
   puts("  --help");
+  puts("  --worker");
   puts("  -d device-uri");
   puts("  -i input/format");
   puts("  -m output/format");
@@ -1977,13 +2235,16 @@ xform_document(
   * Open the PDF file...
   */
 
-  if ((context = fz_new_context(NULL, NULL, FZ_STORE_UNLIMITED)) == NULL)
+  if ((context = Context) == NULL)
   {
-    fputs("ERROR: Unable to create context.\n", stderr);
-    return (1);
-  }
+    if ((context = fz_new_context(NULL, NULL, FZ_STORE_UNLIMITED)) == NULL)
+    {
+      fputs("ERROR: Unable to create context.\n", stderr);
+      return (1);
+    }
 
-  fz_register_document_handlers(context);
+    fz_register_document_handlers(context);
+  }
 
   fz_try(context) document = fz_open_document(context, filename);
   fz_catch(context)
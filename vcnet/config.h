@@ -133,6 +133,27 @@ typedef unsigned long useconds_t;
 /* #undef HAVE_POSIX_SPAWN */
 
 
+/*
+ * Do we have splice?
+ */
+
+/* #undef HAVE_SPLICE */
+
+
+/*
+ * Do we have fallocate?
+ */
+
+/* #undef HAVE_FALLOCATE */
+
+
+/*
+ * Do we have Linux sendfile?
+ */
+
+/* #undef HAVE_SENDFILE */
+
+
 /*
  * Do we have ZLIB?
  */
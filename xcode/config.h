@@ -58,6 +58,27 @@
 #define HAVE_POSIX_SPAWN 1
 
 
+/*
+ * Do we have splice?
+ */
+
+/* #undef HAVE_SPLICE */
+
+
+/*
+ * Do we have fallocate?
+ */
+
+/* #undef HAVE_FALLOCATE */
+
+
+/*
+ * Do we have Linux sendfile?
+ */
+
+/* #undef HAVE_SENDFILE */
+
+
 /*
  * Do we have ZLIB?
  */